@@ -0,0 +1,2525 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+
+#define GL_GLEXT_PROTOTYPES 1
+#define GL3_PROTOTYPES 1
+#include <GLFW/glfw3.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "log.h"
+#include "pixelconv.h"
+#include "vertexpack.h"
+#include "cpucompute.h"
+#include "linmath_simd.h"
+#include "linmath_batch.h"
+#include "linmath_constexpr.h"
+#include "linmath_affine.h"
+#include "transform.h"
+#include "glstate.h"
+#include "gpumemory.h"
+#include "glresource.h"
+#include "framegraph.h"
+#include "shader.h"
+#include "vertexlayout.h"
+#include "vertexpool.h"
+#include "vertexbuf.h"
+#include "culling.h"
+#include "meshopt.h"
+#include "terrain.h"
+#include "effects.h"
+
+// Microbenchmarks for the CPU side kernels and the GL draw paths. Every
+// suite also checks its optimized paths against the reference and fails
+// loudly on mismatch. GL suites render to a hidden window.
+//   ./bench            run every suite
+//   ./bench pixelconv  run only the named suites
+//   ./bench golden     render the fixed scenes against their goldens
+
+static double Now() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs f until at least min_time has passed, returns seconds per call
+template<typename F>
+static double Time(const F& f, double min_time = 0.2) {
+  f(); // warm up
+  int iters = 0;
+  double start = Now(), elapsed = 0;
+  do {
+    f();
+    iters++;
+    elapsed = Now() - start;
+  } while (elapsed < min_time);
+  return elapsed / iters;
+}
+
+// Keeps the compiler from dropping results of the timed code
+static inline void Clobber(void* p) {
+  asm volatile("" : : "g"(p) : "memory");
+}
+
+static int failures = 0;
+
+// Hidden window for the GL suites, created on first use
+static GLFWwindow* GlContext() {
+  static GLFWwindow* window = nullptr;
+  if (!window) {
+    if (!glfwInit()) {
+      printf("Could not initialize glfw\n");
+      exit(2);
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(256, 256, "bench", NULL, NULL);
+    if (!window) {
+      printf("Could not create glfw window\n");
+      exit(2);
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    printf("Renderer:\t%s\n", glGetString(GL_RENDERER));
+  }
+  return window;
+}
+
+// CPU time to issue `submit`, and wall time until the GPU has finished it
+struct GlTiming {
+  double cpu;
+  double total;
+};
+
+template<typename F>
+static GlTiming TimeGl(const F& submit, int frames = 5) {
+  submit();
+  glFinish();
+  GlTiming t = { 0, 0 };
+  for(int i=0; i<frames; i++) {
+    double start = Now();
+    submit();
+    double issued = Now();
+    glFinish();
+    t.cpu += issued - start;
+    t.total += Now() - start;
+  }
+  t.cpu /= frames;
+  t.total /= frames;
+  return t;
+}
+
+static void Check(bool ok, const char* what) {
+  if (!ok) {
+    printf("MISMATCH: %s\n", what);
+    failures++;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// pixelconv
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchPixelConvSize(int w, int h) {
+  size_t pixels = (size_t)w * h;
+  uint8_t* rgb = (uint8_t*)malloc(pixels * 4);
+  for(size_t i=0; i<pixels*4; i++) rgb[i] = rand();
+
+  // big enough for the widest output (4 floats per pixel)
+  void* ref = aligned_alloc(64, pixels * 16 + 64);
+  void* out = aligned_alloc(64, pixels * 16 + 64);
+  uint8_t order[4] = {2, 1, 0, 3};
+
+  printf("%dx%d\n", w, h);
+  for(int k=0; k<PC_KERNEL_COUNT; k++) {
+    // elements per kernel: per byte for the channel kernels, per pixel for the others
+    size_t n = pc_in_size[k] == 1 ? pixels * 3 : pixels;
+    auto run = [&](void* dst) {
+      switch (k) {
+        case PC_U8_TO_F32:       ConvertU8ToF32((float*)dst, rgb, n, 1.0f / 256.0f); break;
+        case PC_RGB_TO_RGBA:     ConvertRgbToRgba((uint8_t*)dst, rgb, n); break;
+        case PC_RGB_TO_RGBA_F32: ConvertRgbToRgbaF32((float*)dst, rgb, n, 1.0f / 256.0f); break;
+        case PC_U8_TO_F16:       ConvertU8ToHalf((uint16_t*)dst, rgb, n, 1.0f / 255.0f); break;
+        case PC_SRGB_TO_LINEAR:  ConvertSrgbToLinear((float*)dst, rgb, n); break;
+        case PC_SWIZZLE_RGBA:    SwizzleRgba((uint8_t*)dst, rgb, n, order); break;
+      }
+    };
+    size_t bytes = n * (pc_in_size[k] + pc_out_size[k]);
+
+    PcSetLevel(PC_SCALAR);
+    run(ref);
+    for(int l=0; l<PC_LEVEL_COUNT; l++) {
+      if (PcSetLevel((PcLevel)l) != l) continue;
+      memset(out, 0xcd, n * pc_out_size[k]);
+      run(out);
+      char what[64];
+      snprintf(what, sizeof(what), "%s/%s", pc_kernel_names[k], pc_level_names[l]);
+      Check(memcmp(ref, out, n * pc_out_size[k]) == 0, what);
+
+      double t = Time([&]() { run(out); });
+      printf("  %-16s %-6s %8.2f GB/s\n", pc_kernel_names[k], pc_level_names[l], bytes / t * 1e-9);
+    }
+  }
+  PcSetLevel(PC_AVX2);
+
+  free(rgb);
+  free(ref);
+  free(out);
+}
+
+static void BenchPixelConv() {
+  printf("== pixelconv (%u threads, best level %s)\n",
+      GlobalPool().Size(), pc_level_names[PcSetLevel(PC_AVX2)]);
+  BenchPixelConvSize(894, 894);
+  BenchPixelConvSize(4096, 4096);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// linmath simd
+////////////////////////////////////////////////////////////////////////////////
+
+static float Randf() {
+  return rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+static void RandomMat(mat4x4 m) {
+  for(int i=0; i<4; i++)
+    for(int j=0; j<4; j++)
+      m[i][j] = Randf();
+  // keep it well conditioned for the inverse
+  for(int i=0; i<4; i++) m[i][i] += 4.0f;
+}
+
+static bool NearlyEqual(const float* a, const float* b, int n, float eps) {
+  for(int i=0; i<n; i++) {
+    float d = fabsf(a[i] - b[i]);
+    if (d > eps * (1.0f + fabsf(a[i]))) return false;
+  }
+  return true;
+}
+
+static void BenchLinmathSimd() {
+  printf("== linmath simd (%s)\n",
+#ifndef LINMATH_H_SIMD
+      "scalar fallback"
+#elif defined(__AVX__)
+      "avx"
+#else
+      "sse"
+#endif
+  );
+
+  const int N = 1024;
+  mat4x4a* a = (mat4x4a*)aligned_alloc(32, N * sizeof(mat4x4a));
+  mat4x4a* b = (mat4x4a*)aligned_alloc(32, N * sizeof(mat4x4a));
+  mat4x4a* r = (mat4x4a*)aligned_alloc(32, N * sizeof(mat4x4a));
+  vec4a* v = (vec4a*)aligned_alloc(16, N * sizeof(vec4a));
+  for(int i=0; i<N; i++) {
+    RandomMat(a[i]);
+    RandomMat(b[i]);
+    for(int k=0; k<4; k++) v[i][k] = Randf();
+  }
+
+  // correctness against the scalar versions, including aliased outputs
+  for(int i=0; i<N; i++) {
+    mat4x4 ref, out;
+    vec4 vref, vout;
+    float angle = Randf() * 3.0f;
+
+    mat4x4_mul(ref, a[i], b[i]);
+    mat4x4_mul_simd(out, a[i], b[i]);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "mat4x4_mul_simd");
+    mat4x4_dup(out, a[i]);
+    mat4x4_mul_simd(out, out, b[i]);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "mat4x4_mul_simd aliased");
+
+    mat4x4_mul_vec4(vref, a[i], v[i]);
+    mat4x4_mul_vec4_simd(vout, a[i], v[i]);
+    Check(NearlyEqual(vref, vout, 4, 1e-5f), "mat4x4_mul_vec4_simd");
+
+    mat4x4_transpose(ref, a[i]);
+    mat4x4_dup(out, a[i]);
+    mat4x4_transpose_simd(out, out);
+    Check(NearlyEqual(ref[0], out[0], 16, 0), "mat4x4_transpose_simd");
+
+    mat4x4_invert(ref, a[i]);
+    mat4x4_invert_simd(out, a[i]);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-4f), "mat4x4_invert_simd");
+
+    mat4x4_rotate_X(ref, a[i], angle);
+    mat4x4_rotate_X_simd(out, a[i], angle);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "mat4x4_rotate_X_simd");
+    mat4x4_rotate_Y(ref, a[i], angle);
+    mat4x4_rotate_Y_simd(out, a[i], angle);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "mat4x4_rotate_Y_simd");
+    mat4x4_rotate_Z(ref, a[i], angle);
+    mat4x4_dup(out, a[i]);
+    mat4x4_rotate_Z_simd(out, out, angle);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "mat4x4_rotate_Z_simd");
+  }
+
+#define BENCH_OP(name, expr) do { \
+    double t = Time([&]() { for(int i=0; i<N; i++) { expr; } Clobber(r); }); \
+    printf("  %-24s %7.2f ns\n", name, t / N * 1e9); \
+  } while(0)
+
+  BENCH_OP("mat4x4_mul",             mat4x4_mul(r[i], a[i], b[i]));
+  BENCH_OP("mat4x4_mul_simd",        mat4x4_mul_simd(r[i], a[i], b[i]));
+  BENCH_OP("mat4x4_mul_vec4",        mat4x4_mul_vec4(r[i][0], a[i], v[i]));
+  BENCH_OP("mat4x4_mul_vec4_simd",   mat4x4_mul_vec4_simd(r[i][0], a[i], v[i]));
+  BENCH_OP("mat4x4_transpose",       mat4x4_transpose(r[i], a[i]));
+  BENCH_OP("mat4x4_transpose_simd",  mat4x4_transpose_simd(r[i], a[i]));
+  BENCH_OP("mat4x4_invert",          mat4x4_invert(r[i], a[i]));
+  BENCH_OP("mat4x4_invert_simd",     mat4x4_invert_simd(r[i], a[i]));
+  BENCH_OP("mat4x4_rotate_Z",        mat4x4_rotate_Z(r[i], a[i], 0.3f));
+  BENCH_OP("mat4x4_rotate_Z_simd",   mat4x4_rotate_Z_simd(r[i], a[i], 0.3f));
+#undef BENCH_OP
+
+  free(a);
+  free(b);
+  free(r);
+  free(v);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// linmath batch
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchLinmathBatch() {
+  printf("== linmath batch\n");
+
+  const size_t N = 1 << 16;
+  float* mem = (float*)malloc(sizeof(float) * N * 15);
+  vec3_soa p[5];
+  for(int k=0; k<5; k++) {
+    p[k].x = mem + N * (3*k + 0);
+    p[k].y = mem + N * (3*k + 1);
+    p[k].z = mem + N * (3*k + 2);
+  }
+  for(size_t i=0; i<N*9; i++) mem[i] = Randf();
+  vec3_soa out = p[3], ref = p[4];
+  mat4x4 M;
+  RandomMat(M);
+
+  auto same = [&](const char* what) {
+    bool ok = true;
+    for(size_t i=0; i<N; i++)
+      ok = ok && out.x[i] == ref.x[i] && out.y[i] == ref.y[i] && out.z[i] == ref.z[i];
+    Check(ok, what);
+  };
+  auto report = [&](const char* name, double each, double batch) {
+    printf("  %-16s per-element %7.1f M/s   batch %7.1f M/s   (%.1fx)\n",
+        name, N / each * 1e-6, N / batch * 1e-6, each / batch);
+  };
+
+  // transform points, per element through mat4x4_mul_vec4
+  auto transform_each = [&]() {
+    for(size_t i=0; i<N; i++) {
+      vec4 v = { p[0].x[i], p[0].y[i], p[0].z[i], 1.f }, r;
+      mat4x4_mul_vec4(r, M, v);
+      ref.x[i] = r[0]; ref.y[i] = r[1]; ref.z[i] = r[2];
+    }
+    Clobber(ref.x);
+  };
+  auto transform_batch = [&]() { vec3_soa_transform_points(out, M, p[0], N); Clobber(out.x); };
+  transform_each();
+  transform_batch();
+  // mat4x4_mul_vec4 adds a 0 * x term first, allow for rounding
+  bool ok = true;
+  for(size_t i=0; i<N; i++)
+    ok = ok && fabsf(out.x[i] - ref.x[i]) < 1e-5f && fabsf(out.y[i] - ref.y[i]) < 1e-5f && fabsf(out.z[i] - ref.z[i]) < 1e-5f;
+  Check(ok, "vec3_soa_transform_points");
+  report("transform", Time(transform_each), Time(transform_batch));
+
+  // triangle normals, per element like VertexMesh used to
+  auto normals_each = [&]() {
+    for(size_t i=0; i<N; i++) {
+      vec3 p1 = { p[0].x[i], p[0].y[i], p[0].z[i] };
+      vec3 p2 = { p[1].x[i], p[1].y[i], p[1].z[i] };
+      vec3 p3 = { p[2].x[i], p[2].y[i], p[2].z[i] };
+      vec3 v1, v2, c, n;
+      vec3_sub(v1, p1, p2);
+      vec3_sub(v2, p3, p2);
+      vec3_mul_cross(c, v1, v2);
+      vec3_norm(n, c);
+      ref.x[i] = n[0]; ref.y[i] = n[1]; ref.z[i] = n[2];
+    }
+    Clobber(ref.x);
+  };
+  auto normals_batch = [&]() { vec3_soa_tri_normals(out, p[0], p[1], p[2], N); Clobber(out.x); };
+  normals_each();
+  normals_batch();
+  same("vec3_soa_tri_normals");
+  report("tri_normals", Time(normals_each), Time(normals_batch));
+
+  auto norm_each = [&]() {
+    for(size_t i=0; i<N; i++) {
+      vec3 v = { p[0].x[i], p[0].y[i], p[0].z[i] }, n;
+      vec3_norm(n, v);
+      ref.x[i] = n[0]; ref.y[i] = n[1]; ref.z[i] = n[2];
+    }
+    Clobber(ref.x);
+  };
+  auto norm_batch = [&]() { vec3_soa_norm(out, p[0], N); Clobber(out.x); };
+  norm_each();
+  norm_batch();
+  same("vec3_soa_norm");
+  report("norm", Time(norm_each), Time(norm_batch));
+
+  free(mem);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// linmath constexpr
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchLinmathConstexpr() {
+  printf("== linmath constexpr\n");
+
+  // the compile-time versions against the runtime ones over a range of inputs
+  int checked = 0;
+  for(float a = -10.0f; a <= 10.0f; a += 0.37f) {
+    mat4x4 ref, out, I;
+    mat4x4_identity(I);
+
+    mat4x4_rotate_X(ref, I, a);
+    cx::rotate_X(cx::identity(), a).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-6f), "cx::rotate_X");
+    mat4x4_rotate_Y(ref, I, a);
+    cx::rotate_Y(cx::identity(), a).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-6f), "cx::rotate_Y");
+    mat4x4_rotate_Z(ref, I, a);
+    cx::rotate_Z(cx::identity(), a).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-6f), "cx::rotate_Z");
+
+    float r = 1.0f + fabsf(a);
+    mat4x4_ortho(ref, -r, r, -1.0f, 1.0f, 1.0f, -1.0f);
+    cx::ortho(-r, r, -1.0f, 1.0f, 1.0f, -1.0f).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 0), "cx::ortho");
+    mat4x4_frustum(ref, -r, r, -1.0f, 1.0f, 0.1f, 10.0f);
+    cx::frustum(-r, r, -1.0f, 1.0f, 0.1f, 10.0f).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 0), "cx::frustum");
+    mat4x4_perspective(ref, 0.2f + fabsf(a) * 0.1f, r, 0.1f, 100.0f);
+    cx::perspective(0.2f + fabsf(a) * 0.1f, r, 0.1f, 100.0f).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "cx::perspective");
+
+    mat4x4 A, B;
+    RandomMat(A);
+    RandomMat(B);
+    cx::mat4 ca = {}, cb = {};
+    for(int i=0; i<4; i++)
+      for(int j=0; j<4; j++) {
+        ca.c[i].v[j] = A[i][j];
+        cb.c[i].v[j] = B[i][j];
+      }
+    mat4x4_mul(ref, A, B);
+    (ca * cb).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 0), "cx::mul");
+
+    vec3 eye = { a, 1.0f, 2.0f }, center = { 0, 0, 0 }, up = { 0, 1, 0 };
+    mat4x4_look_at(ref, eye, center, up);
+    cx::look_at({{ a, 1.0f, 2.0f, 0 }}, {{ 0, 0, 0, 0 }}, {{ 0, 1, 0, 0 }}).store(out);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "cx::look_at");
+    checked++;
+  }
+  printf("  %d input sets checked against linmath.h\n", checked);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// linmath affine
+////////////////////////////////////////////////////////////////////////////////
+
+static void RandomRigid(rigid* r) {
+  float axis[3] = { Randf(), Randf(), Randf() + 2.0f };
+  rigid_identity(r);
+  rigid_rotate(r, r, axis[0], axis[1], axis[2], Randf() * 3.0f);
+  for(int j=0; j<3; j++) r->t[j] = Randf() * 10.0f;
+}
+
+static void BenchLinmathAffine() {
+  printf("== linmath affine\n");
+
+  const int N = 1024;
+  rigid* ra = (rigid*)malloc(N * sizeof(rigid));
+  rigid* rb = (rigid*)malloc(N * sizeof(rigid));
+  rigid* rr = (rigid*)malloc(N * sizeof(rigid));
+  mat3x4* aa = (mat3x4*)malloc(N * sizeof(mat3x4));
+  mat3x4* ab = (mat3x4*)malloc(N * sizeof(mat3x4));
+  mat3x4* ar = (mat3x4*)malloc(N * sizeof(mat3x4));
+  mat4x4a* ma = (mat4x4a*)aligned_alloc(32, N * sizeof(mat4x4a));
+  mat4x4a* mb = (mat4x4a*)aligned_alloc(32, N * sizeof(mat4x4a));
+  mat4x4a* mr = (mat4x4a*)aligned_alloc(32, N * sizeof(mat4x4a));
+  vec4* pts = (vec4*)malloc(N * sizeof(vec4));
+
+  for(int i=0; i<N; i++) {
+    RandomRigid(&ra[i]);
+    RandomRigid(&rb[i]);
+    mat4x4_from_rigid(ma[i], &ra[i]);
+    mat4x4_from_rigid(mb[i], &rb[i]);
+    mat3x4_from_mat4x4(aa[i], ma[i]);
+    mat3x4_from_mat4x4(ab[i], mb[i]);
+    pts[i][0] = Randf(); pts[i][1] = Randf(); pts[i][2] = Randf(); pts[i][3] = 1.0f;
+  }
+
+  // everything against the general mat4x4 routines
+  for(int i=0; i<N; i++) {
+    mat4x4 ref, out;
+    vec4 pref;
+    vec3 pout;
+    rigid rt;
+    mat3x4 at;
+
+    rigid_from_mat4x4(&rt, ma[i]);
+    mat4x4_from_rigid(out, &rt);
+    Check(NearlyEqual(ma[i][0], out[0], 16, 1e-5f), "rigid_from_mat4x4 round trip");
+
+    mat4x4_mul(ref, ma[i], mb[i]);
+    mat3x4_mul(at, aa[i], ab[i]);
+    mat4x4_from_mat3x4(out, at);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-5f), "mat3x4_mul");
+    rigid_mul(&rt, &ra[i], &rb[i]);
+    mat4x4_from_rigid(out, &rt);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-4f), "rigid_mul");
+
+    mat4x4_invert(ref, ma[i]);
+    mat3x4_invert(at, aa[i]);
+    mat4x4_from_mat3x4(out, at);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-4f), "mat3x4_invert");
+    mat3x4_invert_orthonormal(at, aa[i]);
+    mat4x4_from_mat3x4(out, at);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-4f), "mat3x4_invert_orthonormal");
+    rigid_invert(&rt, &ra[i]);
+    mat4x4_from_rigid(out, &rt);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-4f), "rigid_invert");
+
+    // a non-orthonormal affine matrix for the general inverse
+    mat4x4 S;
+    mat4x4_scale_aniso(S, ma[i], 2.0f, 0.5f, 3.0f);
+    mat4x4_invert(ref, S);
+    mat3x4_from_mat4x4(at, S);
+    mat3x4_invert(at, at);
+    mat4x4_from_mat3x4(out, at);
+    Check(NearlyEqual(ref[0], out[0], 16, 1e-4f), "mat3x4_invert scaled");
+
+    mat4x4_mul_vec4(pref, ma[i], pts[i]);
+    mat3x4_mul_point(pout, aa[i], pts[i]);
+    Check(NearlyEqual(pref, pout, 3, 1e-5f), "mat3x4_mul_point");
+    rigid_mul_point(pout, &ra[i], pts[i]);
+    Check(NearlyEqual(pref, pout, 3, 1e-4f), "rigid_mul_point");
+  }
+
+#define BENCH_OP(name, expr) do { \
+    double t = Time([&]() { for(int i=0; i<N; i++) { expr; } Clobber(mr); Clobber(ar); Clobber(rr); }); \
+    printf("  %-28s %7.2f ns\n", name, t / N * 1e9); \
+  } while(0)
+
+  BENCH_OP("mat4x4_mul",                mat4x4_mul(mr[i], ma[i], mb[i]));
+  BENCH_OP("mat4x4_mul_simd",           mat4x4_mul_simd(mr[i], ma[i], mb[i]));
+  BENCH_OP("mat3x4_mul",                mat3x4_mul(ar[i], aa[i], ab[i]));
+  BENCH_OP("rigid_mul",                 rigid_mul(&rr[i], &ra[i], &rb[i]));
+  BENCH_OP("mat4x4_invert",             mat4x4_invert(mr[i], ma[i]));
+  BENCH_OP("mat4x4_invert_simd",        mat4x4_invert_simd(mr[i], ma[i]));
+  BENCH_OP("mat3x4_invert",             mat3x4_invert(ar[i], aa[i]));
+  BENCH_OP("mat3x4_invert_orthonormal", mat3x4_invert_orthonormal(ar[i], aa[i]));
+  BENCH_OP("rigid_invert",              rigid_invert(&rr[i], &ra[i]));
+  BENCH_OP("mat4x4_mul_vec4",           mat4x4_mul_vec4(mr[i][0], ma[i], pts[i]));
+  BENCH_OP("mat3x4_mul_point",          mat3x4_mul_point(ar[i][0], aa[i], pts[i]));
+  BENCH_OP("rigid_mul_point",           rigid_mul_point(ar[i][0], &ra[i], pts[i]));
+#undef BENCH_OP
+
+  free(ra); free(rb); free(rr);
+  free(aa); free(ab); free(ar);
+  free(ma); free(mb); free(mr);
+  free(pts);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// transform store
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchTransforms() {
+  printf("== transforms (%u threads)\n", GlobalPool().Size());
+
+  // a forest of 1000 random trees of 100 transforms each
+  const int Roots = 1000, PerRoot = 100;
+  TransformStore store;
+  for(int r=0; r<Roots; r++) {
+    TransformId root = store.Create();
+    for(int k=1; k<PerRoot; k++)
+      store.Create(root + rand() % k);
+  }
+  size_t n = store.Count();
+  for(TransformId id=0; id<n; id++) {
+    mat4x4 M;
+    rigid rt;
+    RandomRigid(&rt);
+    mat4x4_from_rigid(M, &rt);
+    mat3x4 A;
+    mat3x4_from_mat4x4(A, M);
+    store.SetLocal(id, A);
+  }
+
+  float* out = (float*)malloc(n * 16 * sizeof(float));
+  size_t updated = store.Update(out, n);
+  Check(updated == n, "first update recomputes everything");
+
+  // world matrices against a naive walk up the parents
+  bool ok = true;
+  for(TransformId id=0; id<n; id += 37) {
+    mat4x4 W, L;
+    mat4x4_identity(W);
+    for(TransformId x=id; x!=NO_TRANSFORM; x=store.parent[x]) {
+      mat4x4_from_mat3x4(L, store.local[x].m);
+      mat4x4_mul(W, L, W);
+    }
+    ok = ok && NearlyEqual(W[0], out + id * 16, 16, 1e-4f);
+  }
+  Check(ok, "TransformStore world matrices");
+
+  auto touch = [&](int count) {
+    for(int i=0; i<count; i++) {
+      TransformId id = (i * 7919) % n;
+      store.SetLocal(id, store.local[id].m);
+    }
+  };
+
+  double all = Time([&]() { touch(n); store.Update(out, n); Clobber(out); });
+  touch(Roots / 10);
+  updated = store.Update(out, n);
+  double some = Time([&]() { touch(Roots / 10); store.Update(out, n); Clobber(out); });
+  double none = Time([&]() { store.Update(out, n); Clobber(out); });
+
+  // a destination smaller than the store is not written past its end
+  touch(n);
+  memset(out, 0xff, n * 16 * sizeof(float));
+  store.Update(out, n / 2);
+  bool clamped = true;
+  for(size_t i=n/2*16; i<n*16; i++) clamped = clamped && ((uint32_t*)out)[i] == 0xffffffffu;
+  Check(clamped, "TransformStore wrote past the capacity");
+  printf("  %zu transforms, depth %zu\n", n, store.levels.size() - 1);
+  printf("  all dirty        %8.3f ms\n", all * 1e3);
+  printf("  %4d dirty       %8.3f ms  (%zu recomputed)\n", Roots / 10, some * 1e3, updated);
+  printf("  none dirty       %8.3f ms\n", none * 1e3);
+
+  free(out);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// instancing
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchInstancing() {
+  GlContext();
+  printf("== instancing\n");
+
+  const int MaxInstances = 100000;
+  VertexMesh mesh;
+  mesh.Init(2, 2);
+  InstanceBuffer instances;
+  instances.Init(MaxInstances);
+  InstanceBuffer single;
+  single.Init(1);
+
+  // small tiles spread over the viewport, the same in every region
+  std::vector<Instance> models(MaxInstances);
+  for(int i=0; i<MaxInstances; i++) {
+    mat4x4_translate(models[i].model, Randf(), Randf(), 0);
+    mat4x4_scale_aniso(models[i].model, models[i].model, 0.01f, 0.01f, 0.01f);
+  }
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    char* region = (char*)instances.Begin();
+    for(int i=0; i<MaxInstances; i++)
+      mat4x4_dup(((Instance*)(region + i * InstanceBuffer::stride))->model, models[i].model);
+    instances.End();
+  }
+  glFinish();
+
+  mat4x4 vp;
+  mat4x4_identity(vp);
+  GlState().Viewport(0, 0, 256, 256);
+
+  printf("  %9s  %22s  %22s\n", "instances", "draw per object", "one instanced draw");
+  printf("  %9s  %10s %11s  %10s %11s\n", "", "cpu", "total", "cpu", "total");
+  for(int n=1; n<=MaxInstances; n*=10) {
+    // the old path: one uniform upload and one draw call per object
+    GlTiming each = { -1, -1 };
+    if (n <= 10000) {
+      each = TimeGl([&]() {
+        mesh.shader.Bind(vp, 0);
+        single.Bind(0);
+        InstanceIdLayout::Bind(mesh.vao, InstanceIdBinding, single.ids);
+        GlState().BindVertexArray(mesh.vao);
+        for(int i=0; i<n; i++) {
+          mat4x4 mvp;
+          mat4x4_mul(mvp, vp, models[i].model);
+          glUniformMatrix4fv(mesh.shader.VP, 1, GL_FALSE, (const GLfloat*)mvp);
+          glDrawArrays(GL_TRIANGLES, 0, mesh.vertexCount / 4);
+        }
+      });
+    }
+    GlTiming inst = TimeGl([&]() {
+      mesh.DrawInstances(vp, 0, instances, n);
+    });
+
+    if (each.cpu >= 0)
+      printf("  %9d  %8.1fus %9.2fms  %8.1fus %9.2fms\n", n, each.cpu * 1e6, each.total * 1e3, inst.cpu * 1e6, inst.total * 1e3);
+    else
+      printf("  %9d  %10s %11s  %8.1fus %9.2fms\n", n, "-", "-", inst.cpu * 1e6, inst.total * 1e3);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// culling
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchCulling() {
+  GlContext();
+  printf("== culling\n");
+
+  const int MaxObjects = 100000;
+  VertexMesh mesh;
+  mesh.Init(2, 2);
+  InstanceBuffer instances;
+  instances.Init(MaxObjects);
+
+  // two draws over the same vertices, so the multi draw path is exercised
+  GpuCuller culler;
+  culler.Init(MaxObjects);
+  culler.AddDraw(0, mesh.vertexCount / 4, mesh.bounds);
+  culler.AddDraw(0, mesh.vertexCount / 4, mesh.bounds);
+  std::vector<uint32_t> objectDraw(MaxObjects);
+  for(int i=0; i<MaxObjects; i++) objectDraw[i] = i & 1;
+
+  // objects spread over [-2, 2]^2, about a quarter of them in view
+  std::vector<Instance> models(MaxObjects);
+  for(int i=0; i<MaxObjects; i++) {
+    mat4x4_translate(models[i].model, 2 * Randf(), 2 * Randf(), 0);
+    mat4x4_scale_aniso(models[i].model, models[i].model, 0.01f, 0.01f, 0.01f);
+  }
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    char* region = (char*)instances.Begin();
+    for(int i=0; i<MaxObjects; i++)
+      mat4x4_dup(((Instance*)(region + i * InstanceBuffer::stride))->model, models[i].model);
+    instances.End();
+  }
+  glFinish();
+
+  mat4x4 vp;
+  mat4x4_identity(vp);
+  vec4 planes[6];
+  frustum_planes(planes, vp);
+  GlState().Viewport(0, 0, 256, 256);
+
+  printf("  %9s  %8s %8s  %22s  %22s\n", "objects", "visible", "culled", "draw all instanced", "cull + multi draw");
+  printf("  %9s  %8s %8s  %10s %11s  %10s %11s\n", "", "", "", "cpu", "total", "cpu", "total");
+  for(int n=10; n<=MaxObjects; n*=10) {
+    culler.SetObjects(objectDraw.data(), n);
+
+    // CPU reference of the same sphere test; objects within rounding
+    // distance of a plane may go either way
+    uint32_t expected = 0, borderline = 0;
+    for(int i=0; i<n; i++) {
+      mat4x4& m = models[i].model;
+      vec4 c, s = { mesh.bounds[0], mesh.bounds[1], mesh.bounds[2], 1 };
+      mat4x4_mul_vec4(c, m, s);
+      float scale = 0;
+      for(int k=0; k<3; k++) scale = fmaxf(scale, vec3_mul_inner(m[k], m[k]));
+      float r = mesh.bounds[3] * sqrtf(scale);
+      bool inside = true, edge = false;
+      for(int p=0; p<6; p++) {
+        float d = vec3_mul_inner(planes[p], c) + planes[p][3] + r;
+        if (fabsf(d) < 1e-5f) edge = true;
+        if (d < 0) inside = false;
+      }
+      expected += inside;
+      borderline += edge;
+    }
+
+    GlTiming all = TimeGl([&]() {
+      mesh.DrawInstances(vp, 0, instances, n);
+    });
+    GlTiming culled = TimeGl([&]() {
+      culler.Cull(vp, instances);
+      mesh.DrawIndirect(vp, 0, instances, culler.visible, culler.commands, culler.DrawCount());
+    });
+
+    CullStats stats = culler.Stats();
+    uint32_t diff = stats.visible > expected ? stats.visible - expected : expected - stats.visible;
+    if (stats.objects != (uint32_t)n || diff > borderline) {
+      printf("  MISMATCH: %u of %u visible, expected %u\n", stats.visible, stats.objects, expected);
+      failures++;
+    }
+
+    // the per-draw counts written by the shader must add up to the counter
+    std::vector<DrawArraysIndirectCommand> cmds(culler.DrawCount());
+    glGetNamedBufferSubData(culler.commands, 0, cmds.size() * sizeof(cmds[0]), cmds.data());
+    uint32_t sum = 0;
+    for(const DrawArraysIndirectCommand& c : cmds) sum += c.instanceCount;
+    if (sum != stats.visible) {
+      printf("  MISMATCH: commands draw %u instances, counter says %u\n", sum, stats.visible);
+      failures++;
+    }
+
+    printf("  %9d  %8u %8u  %8.1fus %9.2fms  %8.1fus %9.2fms\n", n, stats.visible, stats.culled,
+        all.cpu * 1e6, all.total * 1e3, culled.cpu * 1e6, culled.total * 1e3);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// terrain
+////////////////////////////////////////////////////////////////////////////////
+
+// The selection must cover every visible level 0 cell at most once, and
+// neighbouring cells may differ by one level at most or the morph leaves cracks
+static bool CheckCdlodSelection(const CdlodTerrain& t) {
+  uint32_t cells = t.field->size / CdlodTerrain::PatchSize;
+  std::vector<int> level((size_t)cells * cells, -1);
+  for(size_t i=0; i<t.commands.size(); i++) {
+    const CdlodTerrain::Node& n = t.nodes[t.commands[i].baseInstance];
+    uint32_t x0 = n.x / CdlodTerrain::PatchSize, y0 = n.y / CdlodTerrain::PatchSize;
+    uint32_t span = n.size / CdlodTerrain::PatchSize;
+    if (t.commands[i].count != t.indexCount) {
+      uint32_t q = t.commands[i].firstIndex / t.commands[i].count;
+      span /= 2;
+      x0 += (q & 1) * span;
+      y0 += (q >> 1) * span;
+    }
+    for(uint32_t y=y0; y<y0+span; y++)
+      for(uint32_t x=x0; x<x0+span; x++) {
+        if (level[y * cells + x] >= 0) return false;
+        level[y * cells + x] = n.level;
+      }
+  }
+  for(uint32_t y=0; y<cells; y++)
+    for(uint32_t x=0; x<cells; x++) {
+      int l = level[y * cells + x];
+      if (l < 0) continue;
+      if (x + 1 < cells && level[y * cells + x + 1] >= 0 && abs(level[y * cells + x + 1] - l) > 1) return false;
+      if (y + 1 < cells && level[(y + 1) * cells + x] >= 0 && abs(level[(y + 1) * cells + x] - l) > 1) return false;
+    }
+  return true;
+}
+
+static void BenchTerrain() {
+  GlContext();
+  printf("== terrain\n");
+
+  // same camera for every size, looking across the terrain from a corner
+  const float fov = 60.0f * (float)M_PI / 180.0f;
+  vec3 eye = { 200, 200, 250 }, center = { 600, 600, 50 }, up = { 0, 0, 1 };
+  mat4x4 v, p, vp;
+  mat4x4_look_at(v, eye, center, up);
+  mat4x4_perspective(p, fov, 1.0f, 1.0f, 20000.0f);
+  mat4x4_mul(vp, p, v);
+  GlState().Viewport(0, 0, 256, 256);
+  glEnable(GL_DEPTH_TEST);
+
+  printf("  %6s  %9s  %8s  %6s %10s  %9s %9s  %10s\n", "size", "full tris", "mesh MB", "nodes", "triangles", "select", "frame", "height MB");
+  for(uint32_t size=512; size<=4096; size*=2) {
+    Heightfield field;
+    field.Generate(size, 1.0f, 120.0f);
+    field.Upload();
+    CdlodTerrain terrain;
+    terrain.Init(field);
+    terrain.SetView(fov, 1080, 2.0f);
+
+    double select = Time([&]() { terrain.Select(vp, eye); }, 0.1);
+    if (!CheckCdlodSelection(terrain)) {
+      printf("  MISMATCH: selection for %u overlaps or skips a level\n", size);
+      failures++;
+    }
+    GlTiming frame = TimeGl([&]() {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      terrain.Draw(vp, eye);
+    });
+
+    // what VertexMesh::Init(size, size) would hold: 6 vec4 positions and normals per quad
+    double meshBytes = (double)size * size * 6 * 2 * 4 * sizeof(float);
+    printf("  %6u  %9.0f  %8.0f  %6zu %10zu  %7.3fms %7.2fms  %10.1f\n", size, 2.0 * size * size, meshBytes / (1 << 20),
+        terrain.nodes.size(), terrain.triangles, select * 1e3, frame.total * 1e3, field.Bytes() / (double)(1 << 20));
+  }
+  glDisable(GL_DEPTH_TEST);
+}
+
+// Same view over the static VertexMesh grid, CDLOD and the tessellated
+// terrain. Triangles are what the rasterizer received, memory is what each
+// mode keeps on the GPU for geometry.
+static void BenchTessellation() {
+  GlContext();
+  printf("== tessellation\n");
+
+  const float fov = 60.0f * (float)M_PI / 180.0f;
+  vec3 eye = { 100, 100, 200 }, center = { 400, 400, 40 }, up = { 0, 0, 1 };
+  mat4x4 v, p, vp;
+  mat4x4_look_at(v, eye, center, up);
+  mat4x4_perspective(p, fov, 1.0f, 1.0f, 20000.0f);
+  mat4x4_mul(vp, p, v);
+  GlState().Viewport(0, 0, 256, 256);
+  glEnable(GL_DEPTH_TEST);
+
+  GLuint query;
+  glGenQueries(1, &query);
+  auto Measure = [&](const char* mode, uint32_t size, size_t bytes, const std::function<void()>& draw) {
+    GlTiming t = TimeGl([&]() {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      draw();
+    });
+    GLuint triangles = 0;
+    glBeginQuery(GL_PRIMITIVES_GENERATED, query);
+    draw();
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &triangles);
+    printf("  %6u  %-13s %10u  %8.2fms  %9.2f\n", size, mode, triangles, t.total * 1e3, bytes / (double)(1 << 20));
+  };
+
+  printf("  %6s  %-13s %10s  %10s  %9s\n", "size", "mode", "triangles", "frame", "geom MB");
+  for(uint32_t size=256; size<=1024; size*=2) {
+    Heightfield field;
+    field.Generate(size, 1.0f, 120.0f);
+    field.Upload();
+
+    if (size <= 512) {
+      // the grid spans [-1, 1]^2 with heights up to 0.1, stretch it over the field
+      VertexMesh mesh;
+      mesh.Init(size, size);
+      InstanceBuffer instances;
+      instances.Init(1);
+      float half = size * field.spacing / 2;
+      for(int c=0; c<InstanceBuffer::Copies; c++) {
+        Instance* inst = (Instance*)instances.Begin();
+        mat4x4_translate(inst->model, half, half, 0);
+        mat4x4_scale_aniso(inst->model, inst->model, half, half, field.scale * 10);
+        instances.End();
+      }
+      // vertex and normal buffers plus the normal pass's two copies
+      size_t bytes = mesh.vertexCount * sizeof(float) * 4;
+      Measure("static mesh", size, bytes, [&]() { mesh.DrawInstances(vp, 0, instances, 1); });
+    }
+
+    CdlodTerrain cdlod;
+    cdlod.Init(field);
+    cdlod.SetView(fov, 1080, 2.0f);
+    cdlod.Select(vp, eye);
+    Measure("cdlod", size, cdlod.Bytes() + field.Bytes(), [&]() { cdlod.Draw(vp, eye); });
+
+    TessTerrain tess;
+    tess.Init(field);
+    tess.SetView(fov, 1080, 8.0f);
+    Measure("tessellation", size, tess.Bytes() + field.Bytes(), [&]() { tess.Draw(vp); });
+  }
+  glDeleteQueries(1, &query);
+  glDisable(GL_DEPTH_TEST);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// procedural
+////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<float> RenderDepth(VertexMesh& mesh, mat4x4 vp, InstanceBuffer& instances) {
+  std::vector<float> depth(256 * 256);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  mesh.DrawInstances(vp, 0, instances, 1);
+  glReadPixels(0, 0, 256, 256, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
+  return depth;
+}
+
+static void BenchProcedural() {
+  GlContext();
+  printf("== procedural\n");
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    Instance* inst = (Instance*)instances.Begin();
+    mat4x4_identity(inst->model);
+    mat4x4_rotate_X(inst->model, inst->model, -0.8f);
+    instances.End();
+  }
+  mat4x4 vp;
+  mat4x4_ortho(vp, -1.5f, 1.5f, -1.5f, 1.5f, 2.0f, -2.0f);
+  GlState().Viewport(0, 0, 256, 256);
+  glEnable(GL_DEPTH_TEST);
+
+  // the procedural grid must land on the same depth as the stored one
+  {
+    srand(7);
+    VertexMesh stored;
+    stored.Init(128, 128);
+    srand(7);
+    VertexMesh generated;
+    generated.Init(128, 128, true);
+    std::vector<float> a = RenderDepth(stored, vp, instances), b = RenderDepth(generated, vp, instances);
+    size_t off = 0, covered = 0;
+    for(size_t i=0; i<a.size(); i++) {
+      off += fabsf(a[i] - b[i]) > 1e-5f;
+      covered += a[i] < 1.0f;
+    }
+    if (off > a.size() / 1000 || covered < a.size() / 4) {
+      printf("  MISMATCH: %zu of %zu depth samples differ, %zu covered\n", off, a.size(), covered);
+      failures++;
+    }
+  }
+
+  printf("  %6s  %-16s %10s  %10s\n", "size", "mode", "frame", "geom MB");
+  auto Measure = [&](uint32_t size, const char* mode, VertexMesh& mesh) {
+    GlTiming t = TimeGl([&]() {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      mesh.Draw(vp, 0, instances, 1);
+    });
+    printf("  %6u  %-16s %8.2fms  %10.2f\n", size, mode, t.total * 1e3, mesh.Bytes() / (double)(1 << 20));
+  };
+  for(uint32_t size=64; size<=1024; size*=4) {
+    if (size <= 256) {
+      VertexMesh mesh;
+      mesh.Init(size, size);
+      Measure(size, "vertex buffers", mesh);
+    }
+    VertexMesh r32f, r16;
+    r32f.Init(size, size, true, GL_R32F);
+    Measure(size, "procedural r32f", r32f);
+    r16.Init(size, size, true, GL_R16);
+    Measure(size, "procedural r16", r16);
+  }
+  glDisable(GL_DEPTH_TEST);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// pulling
+////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<uint8_t> ReadColor() {
+  std::vector<uint8_t> pixels(256 * 256 * 4);
+  glReadPixels(0, 0, 256, 256, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  return pixels;
+}
+
+// Many small meshes drawn the classic way, a VAO with attribute bindings
+// each, against the same meshes merged in a VertexPool and drawn with one
+// glMultiDrawArrays
+static void BenchPulling() {
+  GlContext();
+  printf("== pulling\n");
+
+  const int MaxMeshes = 10000, VerticesPerMesh = 24;
+  std::vector<PoolVertex> records(MaxMeshes * VerticesPerMesh);
+  for(int m=0; m<MaxMeshes; m++) {
+    float cx = Randf(), cy = Randf();
+    for(int i=0; i<VerticesPerMesh; i++) {
+      PoolVertex& v = records[m * VerticesPerMesh + i];
+      vec3 n = { Randf(), Randf(), Randf() + 2.0f };
+      vec3_norm(n, n);
+      float p[4] = { cx + 0.05f * Randf(), cy + 0.05f * Randf(), 0.05f * Randf(), 1 };
+      memcpy(v.position, p, sizeof(p));
+      for(int k=0; k<3; k++) v.normal[k] = n[k];
+      v.normal[3] = 0;
+    }
+  }
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  DefaultShader shader;
+  shader.Init();
+  mat4x4 vp;
+  mat4x4_identity(vp);
+
+  // classic: own position and normal buffers and a VAO per mesh
+  std::vector<GLuint> vaos(MaxMeshes), buffers(2 * MaxMeshes);
+  glCreateVertexArrays(MaxMeshes, vaos.data());
+  glCreateBuffers(2 * MaxMeshes, buffers.data());
+  for(int m=0; m<MaxMeshes; m++) {
+    float pos[VerticesPerMesh * 4], nrm[VerticesPerMesh * 4];
+    for(int i=0; i<VerticesPerMesh; i++) {
+      memcpy(pos + 4*i, records[m * VerticesPerMesh + i].position, 4 * sizeof(float));
+      memcpy(nrm + 4*i, records[m * VerticesPerMesh + i].normal, 4 * sizeof(float));
+    }
+    GLuint vao = vaos[m];
+    glNamedBufferStorage(buffers[2*m], sizeof(pos), pos, 0);
+    glNamedBufferStorage(buffers[2*m + 1], sizeof(nrm), nrm, 0);
+    MeshLayout::ApplySeparate(vao, 0);
+    MeshLayout::BindSeparate(vao, 0, &buffers[2*m]);
+    InstanceIdLayout::Apply(vao, InstanceIdBinding, 1);
+    InstanceIdLayout::Bind(vao, InstanceIdBinding, instances.ids);
+  }
+
+  // pulled: everything in one pool
+  VertexPool pool;
+  pool.Init(records.size());
+  std::vector<GLint> first(MaxMeshes);
+  std::vector<GLsizei> count(MaxMeshes);
+  for(int m=0; m<MaxMeshes; m++) {
+    MeshRange r = pool.Add(&records[m * VerticesPerMesh], VerticesPerMesh);
+    first[m] = r.first;
+    count[m] = r.count;
+  }
+  InstanceIdLayout::Bind(pool.vao, InstanceIdBinding, instances.ids);
+  GlState().Viewport(0, 0, 256, 256);
+
+  auto Classic = [&](int n) {
+    shader.Bind(vp, 0);
+    shader.BindGrid(0, 0, 0, 0);
+    shader.SetPulled(false);
+    glUniform1f(shader.iTime, 0); // same colors on every run
+    instances.Bind(0);
+    for(int m=0; m<n; m++) {
+      GlState().BindVertexArray(vaos[m]);
+      glDrawArrays(GL_TRIANGLES, 0, VerticesPerMesh);
+    }
+  };
+  auto Pulled = [&](int n) {
+    shader.Bind(vp, 0);
+    shader.BindGrid(0, 0, 0, 0);
+    shader.SetPulled(true);
+    glUniform1f(shader.iTime, 0); // same colors on every run
+    instances.Bind(0);
+    pool.Bind();
+    glMultiDrawArrays(GL_TRIANGLES, first.data(), count.data(), n);
+  };
+
+  // both paths must produce the same image
+  glClear(GL_COLOR_BUFFER_BIT);
+  Classic(1000);
+  std::vector<uint8_t> a = ReadColor();
+  glClear(GL_COLOR_BUFFER_BIT);
+  Pulled(1000);
+  std::vector<uint8_t> b = ReadColor();
+  if (a != b) {
+    printf("  MISMATCH: pulled vertices render differently\n");
+    failures++;
+  }
+
+  printf("  %7s  %22s  %22s\n", "meshes", "VAO per mesh", "pool + multi draw");
+  printf("  %7s  %10s %11s  %10s %11s\n", "", "cpu", "total", "cpu", "total");
+  for(int n=10; n<=MaxMeshes; n*=10) {
+    GlTiming c = TimeGl([&]() { Classic(n); });
+    GlTiming p = TimeGl([&]() { Pulled(n); });
+    printf("  %7d  %8.1fus %9.2fms  %8.1fus %9.2fms\n", n, c.cpu * 1e6, c.total * 1e3, p.cpu * 1e6, p.total * 1e3);
+  }
+
+  GlState().DeleteVertexArrays(MaxMeshes, vaos.data());
+  GlState().DeleteBuffers(2 * MaxMeshes, buffers.data());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// packed
+////////////////////////////////////////////////////////////////////////////////
+
+static float AngleBetween(const float a[3], const float b[3]) {
+  float d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+  return acosf(fminf(fmaxf(d, -1.0f), 1.0f));
+}
+
+// 48 byte float vertices (position and normal in separate buffers) against
+// 12 byte PackedVertex records with half or snorm16 positions
+static void BenchPacked() {
+  GlContext();
+  printf("== packed\n");
+
+  // octahedral round trip through snorm16
+  float worst = 0;
+  for(int i=0; i<100000; i++) {
+    vec3 n = { Randf(), Randf(), Randf() };
+    if (vec3_len(n) < 1e-3f) continue;
+    vec3_norm(n, n);
+    float e[2], d[3];
+    oct_encode(e, n);
+    e[0] = unpack_snorm16(pack_snorm16(e[0]));
+    e[1] = unpack_snorm16(pack_snorm16(e[1]));
+    oct_decode(d, e);
+    worst = fmaxf(worst, AngleBetween(n, d));
+  }
+  printf("  octahedral snorm16 normals: max error %.2e rad\n", worst);
+  Check(worst < 1e-3f, "octahedral normal round trip");
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    Instance* inst = (Instance*)instances.Begin();
+    mat4x4_identity(inst->model);
+    mat4x4_rotate_X(inst->model, inst->model, -0.8f);
+    instances.End();
+  }
+  mat4x4 vp;
+  mat4x4_ortho(vp, -1.5f, 1.5f, -1.5f, 1.5f, 2.0f, -2.0f);
+  GlState().Viewport(0, 0, 256, 256);
+  glEnable(GL_DEPTH_TEST);
+
+  // the compute pass must leave the normal of each triangle's decoded
+  // positions in all three of its vertices
+  const GLenum formats[2] = { GL_HALF_FLOAT, GL_SHORT };
+  const char* formatNames[2] = { "half", "snorm16" };
+  for(int f=0; f<2; f++) {
+    srand(7);
+    VertexMesh reference;
+    reference.Init(128, 128);
+    srand(7);
+    VertexMesh packed;
+    packed.Init(128, 128, MESH_PACKED, formats[f], nullptr);
+    packed.Draw(vp, 0, instances, 1);
+    glFinish();
+
+    size_t n = packed.vertexCount / 4;
+    std::vector<PackedVertex> records(n);
+    std::vector<PoolVertex> grid(n);
+    glGetNamedBufferSubData(packed.vertexBuffer, 0, n * sizeof(PackedVertex), records.data());
+    glGetNamedBufferSubData(reference.vertexBuffer, 0, n * sizeof(PoolVertex), grid.data());
+    float normalError = 0, positionError = 0;
+    for(size_t t=0; t<n/3; t++) {
+      float p[3][3], stored[3][3];
+      for(int k=0; k<3; k++) {
+        UnpackVertex(p[k], stored[k], &records[3*t + k], formats[f]);
+        for(int c=0; c<3; c++) positionError = fmaxf(positionError, fabsf(p[k][c] - grid[3*t + k].position[c]));
+      }
+      vec3 a, b, expected;
+      vec3_sub(a, p[0], p[1]);
+      vec3_sub(b, p[2], p[1]);
+      vec3_mul_cross(expected, a, b);
+      vec3_norm(expected, expected);
+      for(int k=0; k<3; k++) normalError = fmaxf(normalError, AngleBetween(expected, stored[k]));
+    }
+    printf("  %-7s positions: max error %.2e, normal pass max error %.2e rad\n", formatNames[f], positionError, normalError);
+    Check(normalError < 2e-3f, "packed normal pass");
+
+    // and land close to the float mesh on screen
+    std::vector<float> a = RenderDepth(reference, vp, instances), b = RenderDepth(packed, vp, instances);
+    size_t off = 0;
+    for(size_t i=0; i<a.size(); i++) off += fabsf(a[i] - b[i]) > 1e-3f;
+    if (off > a.size() / 100) {
+      printf("  MISMATCH: %zu of %zu depth samples of the %s mesh differ\n", off, a.size(), formatNames[f]);
+      failures++;
+    }
+  }
+
+  printf("  %6s  %-16s %10s  %10s\n", "size", "mode", "frame", "geom MB");
+  auto Measure = [&](uint32_t size, const char* mode, VertexMesh& mesh) {
+    GlTiming t = TimeGl([&]() {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      mesh.Draw(vp, 0, instances, 1);
+    });
+    printf("  %6u  %-16s %8.2fms  %10.2f\n", size, mode, t.total * 1e3, mesh.Bytes() / (double)(1 << 20));
+  };
+  for(uint32_t size=64; size<=512; size*=2) {
+    if (size == 128) continue;
+    VertexMesh floats, half, snorm;
+    floats.Init(size, size);
+    Measure(size, "float", floats);
+    half.Init(size, size, MESH_PACKED, GL_HALF_FLOAT, nullptr);
+    Measure(size, "packed half", half);
+    snorm.Init(size, size, MESH_PACKED, GL_SHORT, nullptr);
+    Measure(size, "packed snorm16", snorm);
+  }
+  glDisable(GL_DEPTH_TEST);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// meshopt
+////////////////////////////////////////////////////////////////////////////////
+
+// Indexed grid of size x size quads with shared vertices, drawn with
+// DefaultShader in each triangle order
+struct IndexedGrid {
+  std::vector<PoolVertex> vertices;
+  std::vector<uint32_t> indices;
+  GLuint vao, vbo, ibo;
+
+  void Build(uint32_t size) {
+    uint32_t n = size + 1;
+    vertices.resize((size_t)n * n);
+    for(uint32_t y=0; y<n; y++)
+      for(uint32_t x=0; x<n; x++) {
+        PoolVertex& v = vertices[y * n + x];
+        float p[4] = { 2.0f * x / size - 1, 2.0f * y / size - 1, 0.05f * sinf(x * 0.1f) * cosf(y * 0.1f), 1 };
+        float nrm[4] = { 0, 0, 1, 0 };
+        memcpy(v.position, p, sizeof(p));
+        memcpy(v.normal, nrm, sizeof(nrm));
+      }
+    indices.clear();
+    for(uint32_t y=0; y<size; y++)
+      for(uint32_t x=0; x<size; x++) {
+        uint32_t a = y * n + x, b = a + 1, c = a + n, d = c + 1;
+        uint32_t quad[6] = { a, b, d, a, d, c };
+        indices.insert(indices.end(), quad, quad + 6);
+      }
+  }
+
+  // Triangles and vertices in random order, like a mesh exported without care
+  void Shuffle() {
+    size_t triangles = indices.size() / 3;
+    for(size_t t=triangles-1; t>0; t--) {
+      size_t r = rand() % (t + 1);
+      for(int k=0; k<3; k++) std::swap(indices[3*t + k], indices[3*r + k]);
+    }
+    std::vector<uint32_t> remap(vertices.size());
+    for(size_t v=0; v<remap.size(); v++) remap[v] = v;
+    for(size_t v=remap.size()-1; v>0; v--) std::swap(remap[v], remap[rand() % (v + 1)]);
+    std::vector<PoolVertex> moved(vertices.size());
+    for(size_t v=0; v<remap.size(); v++) moved[remap[v]] = vertices[v];
+    vertices.swap(moved);
+    for(uint32_t& i : indices) i = remap[i];
+  }
+
+  void Upload(GLuint instanceIds) {
+    glCreateBuffers(1, &vbo);
+    glNamedBufferStorage(vbo, vertices.size() * sizeof(PoolVertex), vertices.data(), 0);
+    glCreateBuffers(1, &ibo);
+    glNamedBufferStorage(ibo, indices.size() * sizeof(uint32_t), indices.data(), 0);
+    glCreateVertexArrays(1, &vao);
+    MeshLayout::Apply(vao, 0);
+    MeshLayout::Bind(vao, 0, vbo);
+    glVertexArrayElementBuffer(vao, ibo);
+    InstanceIdLayout::Apply(vao, InstanceIdBinding, 1);
+    InstanceIdLayout::Bind(vao, InstanceIdBinding, instanceIds);
+  }
+
+  void Release() {
+    GlState().DeleteVertexArrays(1, &vao);
+    GlState().DeleteBuffers(1, &vbo);
+    GlState().DeleteBuffers(1, &ibo);
+  }
+};
+
+static void BenchMeshOpt() {
+  GlContext();
+  printf("== meshopt\n");
+
+  // CDLOD patch as built by CdlodTerrain, before and after
+  {
+    std::vector<float> grid;
+    std::vector<uint16_t> plain, optimized;
+    CdlodTerrain::BuildPatch(grid, plain, false);
+    CdlodTerrain::BuildPatch(grid, optimized, true);
+    VertexCacheStats a = AnalyzeVertexCache(plain.data(), plain.size(), grid.size() / 2);
+    VertexCacheStats b = AnalyzeVertexCache(optimized.data(), optimized.size(), grid.size() / 2);
+    printf("  cdlod patch      acmr %.3f -> %.3f  atvr %.3f -> %.3f\n", a.acmr, b.acmr, a.atvr, b.atvr);
+    Check(b.acmr < a.acmr, "cdlod patch vertex cache order");
+  }
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  DefaultShader shader;
+  shader.Init();
+  mat4x4 vp;
+  mat4x4_identity(vp);
+  GlState().Viewport(0, 0, 256, 256);
+
+  printf("  %6s  %-14s %7s %7s %10s\n", "size", "order", "acmr", "atvr", "frame");
+  for(uint32_t size=256; size<=1024; size*=2) {
+    srand(11);
+    IndexedGrid rows, shuffled, cache, fetch;
+    rows.Build(size);
+    shuffled = rows;
+    shuffled.Shuffle();
+    cache = shuffled;
+    OptimizeVertexCache(cache.indices.data(), shuffled.indices.data(), shuffled.indices.size(), shuffled.vertices.size());
+    fetch = cache;
+    OptimizeVertexFetch(fetch.vertices.data(), sizeof(PoolVertex), fetch.indices.data(), fetch.indices.size(), fetch.vertices.size());
+
+    IndexedGrid* orders[4] = { &rows, &shuffled, &cache, &fetch };
+    const char* names[4] = { "row-major", "shuffled", "forsyth", "forsyth+fetch" };
+    std::vector<uint8_t> reference;
+    float acmr[4];
+    for(int o=0; o<4; o++) {
+      IndexedGrid& g = *orders[o];
+      g.Upload(instances.ids);
+      auto Draw = [&]() {
+        glClear(GL_COLOR_BUFFER_BIT);
+        shader.Bind(vp, 0);
+        shader.BindGrid(0, 0, 0, 0);
+        shader.SetPulled(false);
+        shader.SetOctNormals(false);
+        glUniform1f(shader.iTime, 0);
+        instances.Bind(0);
+        GlState().BindVertexArray(g.vao);
+        glDrawElements(GL_TRIANGLES, g.indices.size(), GL_UNSIGNED_INT, 0);
+      };
+      Draw();
+      std::vector<uint8_t> image = ReadColor();
+      if (o == 0) reference = image;
+      else if (image != reference) {
+        printf("  MISMATCH: %s order renders differently\n", names[o]);
+        failures++;
+      }
+      VertexCacheStats st = AnalyzeVertexCache(g.indices.data(), g.indices.size(), g.vertices.size());
+      acmr[o] = st.acmr;
+      GlTiming t = TimeGl(Draw);
+      printf("  %6u  %-14s %7.3f %7.3f %8.2fms\n", size, names[o], st.acmr, st.atvr, t.total * 1e3);
+      g.Release();
+    }
+    Check(acmr[2] < acmr[0] && acmr[3] == acmr[2], "vertex cache optimization");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// layout
+////////////////////////////////////////////////////////////////////////////////
+
+// The same MeshLayout vertices fetched interleaved from one buffer (AoS)
+// and from a buffer per attribute (SoA)
+static void BenchLayout() {
+  GlContext();
+  printf("== layout\n");
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    Instance* inst = (Instance*)instances.Begin();
+    mat4x4_identity(inst->model);
+    mat4x4_rotate_X(inst->model, inst->model, -0.8f);
+    instances.End();
+  }
+  DefaultShader shader;
+  shader.Init();
+  mat4x4 vp;
+  mat4x4_ortho(vp, -1.5f, 1.5f, -1.5f, 1.5f, 2.0f, -2.0f);
+  GlState().Viewport(0, 0, 256, 256);
+  glEnable(GL_DEPTH_TEST);
+
+  printf("  %6s  %10s %10s  %10s %10s\n", "size", "AoS build", "draw", "SoA build", "draw");
+  for(uint32_t size=128; size<=512; size*=2) {
+    const size_t n = (size_t)size * size * 6;
+    std::vector<float> heights((size + 1) * (size + 1));
+    for(float& h : heights) h = 0.05f * (Randf() + 1);
+    auto Position = [&](size_t v, float* p) {
+      static const int cornerX[6] = { 0, 0, 1, 1, 0, 1 }, cornerY[6] = { 0, 1, 0, 0, 1, 1 };
+      size_t quad = v / 6;
+      int x = quad % size + cornerX[v % 6], y = quad / size + cornerY[v % 6];
+      p[0] = 2.0f * x / size - 1;
+      p[1] = 2.0f * y / size - 1;
+      p[2] = heights[x + y * (size + 1)];
+      p[3] = 1;
+    };
+
+    // AoS: records written in one pass
+    std::vector<PoolVertex> records(n);
+    double aosBuild = Time([&]() {
+      for(size_t v=0; v<n; v++) {
+        Position(v, MeshLayout::Get<0>(records.data(), v));
+        float* nrm = MeshLayout::Get<1>(records.data(), v);
+        nrm[0] = 0; nrm[1] = 0; nrm[2] = 1; nrm[3] = 0;
+      }
+      Clobber(records.data());
+    }, 0.1);
+    // SoA: an array per attribute
+    std::vector<float> positions(4 * n), normals(4 * n);
+    double soaBuild = Time([&]() {
+      for(size_t v=0; v<n; v++) Position(v, &positions[4*v]);
+      for(size_t v=0; v<n; v++) {
+        float* nrm = &normals[4*v];
+        nrm[0] = 0; nrm[1] = 0; nrm[2] = 1; nrm[3] = 0;
+      }
+      Clobber(positions.data());
+      Clobber(normals.data());
+    }, 0.1);
+
+    GLuint buffers[3], vaos[2];
+    glCreateBuffers(3, buffers);
+    glNamedBufferStorage(buffers[0], n * sizeof(PoolVertex), records.data(), 0);
+    glNamedBufferStorage(buffers[1], n * 4 * sizeof(float), positions.data(), 0);
+    glNamedBufferStorage(buffers[2], n * 4 * sizeof(float), normals.data(), 0);
+    glCreateVertexArrays(2, vaos);
+    MeshLayout::Apply(vaos[0], 0);
+    MeshLayout::Bind(vaos[0], 0, buffers[0]);
+    MeshLayout::ApplySeparate(vaos[1], 0);
+    MeshLayout::BindSeparate(vaos[1], 0, buffers + 1);
+    for(int i=0; i<2; i++) {
+      InstanceIdLayout::Apply(vaos[i], InstanceIdBinding, 1);
+      InstanceIdLayout::Bind(vaos[i], InstanceIdBinding, instances.ids);
+    }
+
+    auto Draw = [&](GLuint vao) {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      shader.Bind(vp, 0);
+      shader.BindGrid(0, 0, 0, 0);
+      shader.SetPulled(false);
+      shader.SetOctNormals(false);
+      glUniform1f(shader.iTime, 0);
+      instances.Bind(0);
+      GlState().BindVertexArray(vao);
+      glDrawArrays(GL_TRIANGLES, 0, n);
+    };
+    Draw(vaos[0]);
+    std::vector<uint8_t> a = ReadColor();
+    Draw(vaos[1]);
+    std::vector<uint8_t> b = ReadColor();
+    Check(a == b, "AoS and SoA vertices render differently");
+
+    GlTiming aos = TimeGl([&]() { Draw(vaos[0]); });
+    GlTiming soa = TimeGl([&]() { Draw(vaos[1]); });
+    printf("  %6u  %8.2fms %8.2fms  %8.2fms %8.2fms\n", size, aosBuild * 1e3, aos.total * 1e3, soaBuild * 1e3, soa.total * 1e3);
+
+    GlState().DeleteVertexArrays(2, vaos);
+    GlState().DeleteBuffers(3, buffers);
+  }
+  glDisable(GL_DEPTH_TEST);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// strips
+////////////////////////////////////////////////////////////////////////////////
+
+// Triangle list grid (6 vertices per quad) against the shared vertex grid
+// drawn as one strip per row with primitive restart
+static void BenchStrips() {
+  GlContext();
+  printf("== strips\n");
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    Instance* inst = (Instance*)instances.Begin();
+    mat4x4_identity(inst->model);
+    mat4x4_rotate_X(inst->model, inst->model, -0.8f);
+    instances.End();
+  }
+  mat4x4 vp;
+  mat4x4_ortho(vp, -1.5f, 1.5f, -1.5f, 1.5f, 2.0f, -2.0f);
+  GlState().Viewport(0, 0, 256, 256);
+  glEnable(GL_DEPTH_TEST);
+
+  // same triangles, so the same depth
+  for(uint32_t size : { 64u, 300u }) {
+    srand(7);
+    VertexMesh list;
+    list.Init(size, size);
+    srand(7);
+    VertexMesh strips;
+    strips.Init(size, size, MESH_STRIPS, 0, nullptr);
+    std::vector<float> a = RenderDepth(list, vp, instances), b = RenderDepth(strips, vp, instances);
+    size_t off = 0, covered = 0;
+    for(size_t i=0; i<a.size(); i++) {
+      off += fabsf(a[i] - b[i]) > 1e-5f;
+      covered += a[i] < 1.0f;
+    }
+    if (off > a.size() / 1000 || covered < a.size() / 4) {
+      printf("  MISMATCH: %ux%u strips: %zu of %zu depth samples differ, %zu covered\n", size, size, off, a.size(), covered);
+      failures++;
+    }
+  }
+
+  printf("  %6s  %-10s %12s %10s  %10s\n", "size", "topology", "elements", "frame", "geom MB");
+  auto Measure = [&](uint32_t size, const char* mode, VertexMesh& mesh, size_t elements) {
+    GlTiming t = TimeGl([&]() {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      mesh.DrawInstances(vp, 0, instances, 1);
+    });
+    printf("  %6u  %-10s %12zu %8.2fms  %10.2f\n", size, mode, elements, t.total * 1e3, mesh.Bytes() / (double)(1 << 20));
+  };
+  for(uint32_t size=16; size<=1024; size*=4) {
+    VertexMesh list, strips;
+    list.Init(size, size);
+    Measure(size, "list", list, list.vertexCount / 4);
+    strips.Init(size, size, MESH_STRIPS, 0, nullptr);
+    Measure(size, "strips", strips, strips.indexCount);
+  }
+  glDisable(GL_DEPTH_TEST);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// state
+////////////////////////////////////////////////////////////////////////////////
+
+// Bind calls per frame as the number of passes grows, with the state cache
+// dropping redundant ones and with every call going to GL
+static void BenchState() {
+  GlContext();
+  printf("== state\n");
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    Instance* inst = (Instance*)instances.Begin();
+    mat4x4_identity(inst->model);
+    mat4x4_rotate_X(inst->model, inst->model, -0.8f);
+    instances.End();
+  }
+  mat4x4 vp;
+  mat4x4_ortho(vp, -1.5f, 1.5f, -1.5f, 1.5f, 2.0f, -2.0f);
+  glEnable(GL_DEPTH_TEST);
+
+  // two meshes per pass: pooled ones share the VAO and vertex storage,
+  // each mesh has its own program
+  VertexPool pool;
+  pool.Init(1 << 16);
+  VertexMesh meshes[3];
+  meshes[0].Init(16, 16, pool);
+  meshes[1].Init(16, 16, pool);
+  meshes[2].Init(16, 16, true);
+  auto Frame = [&](int passes) {
+    GlState().Viewport(0, 0, 256, 256);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    for(int p=0; p<passes; p++) {
+      meshes[0].DrawInstances(vp, 0, instances, 1);
+      meshes[p % 2 + 1].DrawInstances(vp, 0, instances, 1);
+    }
+    GlState().EndFrame();
+  };
+
+  // dropping calls must not change the image. Colors follow glfwGetTime,
+  // so both frames start at time 0 after a warm up and may differ by a
+  // rounding step where the clock moved on.
+  Frame(4);
+  GlState().enabled = true;
+  glfwSetTime(0);
+  Frame(4);
+  std::vector<uint8_t> a = ReadColor();
+  GlState().enabled = false;
+  glfwSetTime(0);
+  Frame(4);
+  std::vector<uint8_t> b = ReadColor();
+  GlState().enabled = true;
+  bool same = true;
+  for(size_t i=0; i<a.size(); i++) same &= abs(a[i] - b[i]) <= 2;
+  Check(same, "state cache changes the image");
+
+  printf("  %6s  %10s %10s %10s  %10s %10s\n", "passes", "issued", "elided", "cpu", "uncached", "cpu");
+  for(int passes=1; passes<=64; passes*=4) {
+    GlState().enabled = true;
+    GlTiming cached = TimeGl([&]() { Frame(passes); });
+    GlStateCache::Counters c = GlState().last;
+    GlState().enabled = false;
+    GlTiming uncached = TimeGl([&]() { Frame(passes); });
+    GlStateCache::Counters u = GlState().last;
+    GlState().enabled = true;
+    printf("  %6d  %10u %10u %8.1fus  %10u %8.1fus\n", passes, c.issued, c.elided, cached.cpu * 1e6, u.issued, uncached.cpu * 1e6);
+  }
+  glDisable(GL_DEPTH_TEST);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// log
+////////////////////////////////////////////////////////////////////////////////
+
+// What gl_debug_output did per message before the log: six lines, every
+// one flushed
+static void LogDirect(FILE* out, GLenum source, GLenum type, GLuint id, GLenum severity, const char* message) {
+  fprintf(out, "---------------\n"); fflush(out);
+  fprintf(out, "Debug message (%u): %s\n", id, message); fflush(out);
+  fprintf(out, "Source: %s\n", source == GL_DEBUG_SOURCE_API ? "API" : "Other"); fflush(out);
+  fprintf(out, "Type: %s\n", type == GL_DEBUG_TYPE_PERFORMANCE ? "Performance" : "Other"); fflush(out);
+  fprintf(out, "Severity: %s\n", severity == GL_DEBUG_SEVERITY_MEDIUM ? "medium" : "other"); fflush(out);
+  fprintf(out, "\n"); fflush(out);
+}
+
+static FILE* logDirectOut;
+
+static void APIENTRY LogDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user) {
+  Logger* log = (Logger*)user;
+  if (log) log->GlMessage(source, type, id, severity, length, message);
+  else LogDirect(logDirectOut, source, type, id, severity, message);
+}
+
+static std::vector<std::string> ReadLines(FILE* f) {
+  std::vector<std::string> lines;
+  rewind(f);
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\n")] = 0;
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+static void BenchLog() {
+  printf("== log\n");
+  FILE* null = fopen("/dev/null", "w");
+  const char* text = "Buffer object 3 will use VIDEO memory as the source for buffer object operations.";
+
+  // cost on the calling thread, which is the driver's with synchronous output
+  Logger* log = new Logger();
+  log->Start(null);
+  double direct = Time([&]() {
+    for(int i=0; i<256; i++) LogDirect(null, GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_PERFORMANCE, 131185, GL_DEBUG_SEVERITY_MEDIUM, text);
+  }) / 256;
+  double pushed = Time([&]() {
+    for(int i=0; i<256; i++) log->GlMessage(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_PERFORMANCE, 131185 + (i & 7), GL_DEBUG_SEVERITY_MEDIUM, -1, text);
+    log->Flush();
+  }, 0.2) / 256;
+  log->Stop();
+  printf("  per message: direct %8.1fns  ring %8.1fns (incl. waiting for the writer)\n", direct * 1e9, pushed * 1e9);
+  delete log;
+
+  // every message from concurrent producers comes out once
+  {
+    FILE* out = tmpfile();
+    Logger* log = new Logger();
+    log->Start(out);
+    const int Threads = 4, PerThread = 1000;
+    std::vector<std::thread> threads;
+    for(int t=0; t<Threads; t++)
+      threads.emplace_back([&, t]() {
+        for(int i=0; i<PerThread; i++) log->Printf("producer %d message %d", t, i);
+      });
+    for(std::thread& t : threads) t.join();
+    log->Stop();
+    Logger::Stats s = log->GetStats();
+    std::vector<int> seen(Threads * PerThread, 0);
+    int t, i;
+    for(const std::string& line : ReadLines(out))
+      if (sscanf(line.c_str(), "producer %d message %d", &t, &i) == 2) seen[t * PerThread + i]++;
+    bool once = true;
+    for(int n : seen) once &= n == 1;
+    Check(s.dropped == 0 && once, "log loses or duplicates messages");
+    printf("  %d producers: %llu pushed, %llu written\n", Threads, (unsigned long long)s.pushed, (unsigned long long)s.written);
+    fclose(out);
+    delete log;
+  }
+
+  // a spamming id prints `burst` messages and a count, identical messages fold
+  {
+    FILE* out = tmpfile();
+    Logger* log = new Logger();
+    log->Start(out);
+    char message[64];
+    for(int i=0; i<1000; i++) {
+      snprintf(message, sizeof(message), "texture %d", i);
+      log->GlMessage(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER, 7, GL_DEBUG_SEVERITY_LOW, -1, message);
+    }
+    for(int i=0; i<1000; i++) log->GlMessage(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_ERROR, 9, GL_DEBUG_SEVERITY_HIGH, -1, "same");
+    log->Stop();
+    std::vector<std::string> lines = ReadLines(out);
+    int limited = 0, repeated = 0;
+    bool counted = false, folded = false;
+    for(const std::string& line : lines) {
+      if (!line.compare(0, 5, "GL 7 ")) limited++;
+      if (line == "GL 7: 995 more messages suppressed") counted = true;
+      if (!line.compare(0, 5, "GL 9 ")) repeated++;
+      if (line == "GL 9: last message repeated 999 times") folded = true;
+    }
+    Check(limited == log->burst && counted, "log rate limit");
+    Check(repeated == 1 && folded, "log repeat folding");
+    printf("  2000 spammed messages: %zu lines\n", lines.size());
+    fclose(out);
+    delete log;
+  }
+
+  // through the driver: messages inserted with debug output on, written
+  // from the callback or pushed to the log
+  GlContext();
+  glEnable(GL_DEBUG_OUTPUT);
+  glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+  logDirectOut = null;
+  log = new Logger();
+  log->Start(null);
+  for(int pass=0; pass<2; pass++) {
+    Logger* target = pass ? log : nullptr;
+    glDebugMessageCallback(LogDebugCallback, target);
+    GlTiming t = TimeGl([&]() {
+      for(int i=0; i<256; i++) glDebugMessageInsert(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_PERFORMANCE, i, GL_DEBUG_SEVERITY_MEDIUM, -1, text);
+    });
+    printf("  256 inserted messages, %s: %8.1fus\n", pass ? "ring" : "direct", t.cpu * 1e6);
+  }
+  glDebugMessageCallback(nullptr, nullptr);
+  glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  glDisable(GL_DEBUG_OUTPUT);
+  log->Stop();
+  delete log;
+  fclose(null);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// resources
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchResources() {
+  GlContext();
+  printf("== resources\n");
+
+  // a mesh initialized again at the same size reuses its storage
+  GlPool().Trim();
+  GlResourcePool::Counters before = GlPool().buffers;
+  GLuint first;
+  {
+    VertexMesh mesh;
+    mesh.Init(64, 64);
+    first = mesh.vertexBuffer;
+    for(int i=0; i<8; i++) mesh.Init(64, 64);
+    Check(mesh.vertexBuffer == first, "re-initialized mesh has new storage");
+  }
+  GlResourcePool::Counters after = GlPool().buffers;
+  printf("  9 inits: %u buffers created, %u reused\n", after.created - before.created, after.reused - before.reused);
+  Check(after.created - before.created == 1, "mesh re-init creates buffers");
+  GlPool().Trim();
+  Check(!glIsBuffer(first), "trimmed pool leaks buffers");
+
+  // handles delete what they own and keep the state shadow honest
+  GLuint name;
+  {
+    GlBuffer b = CreateBuffer(MEM_OTHER, 64, NULL, 0);
+    name = b;
+    GlState().BindStorageBuffer(7, b);
+    GlBuffer moved = std::move(b);
+    Check(!b && moved == name, "moved handle");
+  }
+  Check(!glIsBuffer(name) && GlState().storage[7].buffer == 0, "handle leaks its buffer");
+
+  // 1 MB into new storage, or into a recycled buffer of the same size
+  std::vector<char> data(1 << 20, 1);
+  double fresh = Time([&]() {
+    GlBuffer b = CreateBuffer(MEM_OTHER, data.size(), data.data(), 0);
+    glFinish();
+  });
+  double pooled = Time([&]() {
+    GlBuffer b = GlPool().AcquireBuffer(MEM_OTHER, data.size(), data.data());
+    GlPool().Recycle(b);
+    glFinish();
+  });
+  printf("  1MB buffer: new %8.1fus  recycled %8.1fus\n", fresh * 1e6, pooled * 1e6);
+
+  // terrain streams stay in their buffers while the selection fits
+  Heightfield field;
+  field.Generate(256, 1.0f, 40.0f);
+  field.Upload();
+  CdlodTerrain terrain;
+  terrain.Init(field);
+  mat4x4 proj, view, vp;
+  mat4x4_perspective(proj, 60.0f * (float)M_PI / 180.0f, 1.0f, 0.5f, 2000.0f);
+  vec3 eye = { 128, -40, 60 }, center = { 128, 128, 0 }, up = { 0, 0, 1 };
+  mat4x4_look_at(view, eye, center, up);
+  mat4x4_mul(vp, proj, view);
+  terrain.Select(vp, eye);
+  terrain.Draw(vp, eye);
+  glFinish();
+  before = GlPool().buffers;
+  GlTiming t = TimeGl([&]() { terrain.Draw(vp, eye); }, 20);
+  after = GlPool().buffers;
+  Check(after.created == before.created && after.reused == before.reused, "terrain streams reallocate");
+  printf("  terrain draw, %zu nodes: %8.1fus cpu\n", terrain.nodes.size(), t.cpu * 1e6);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// memory
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchMemory() {
+  GlContext();
+  printf("== memory\n");
+  GlPool().Trim();
+  size_t base = GpuMem().Total();
+
+  // the accounted sizes are the storage the meshes ask for
+  {
+    VertexMesh meshes[4];
+    meshes[0].Init(64, 64);
+    meshes[1].Init(64, 64, MESH_PACKED, GL_HALF_FLOAT, nullptr);
+    meshes[2].Init(64, 64, MESH_STRIPS, 0, nullptr);
+    meshes[3].Init(64, 64, true, GL_R16);
+    size_t expected = 0;
+    for(VertexMesh& m : meshes) expected += m.Bytes();
+    printf("  4 meshes: %zu bytes accounted, %zu by Bytes()\n", GpuMem().Live(MEM_MESH), expected);
+    Check(GpuMem().Live(MEM_MESH) == expected, "mesh accounting");
+  }
+  GlPool().Trim();
+  Check(GpuMem().Total() == base, "memory accounted after delete");
+
+  {
+    Quad quad;
+    quad.Init();
+    GLint w = 0, h = 0;
+    glGetTextureLevelParameteriv(quad.tex, 0, GL_TEXTURE_WIDTH, &w);
+    glGetTextureLevelParameteriv(quad.tex, 0, GL_TEXTURE_HEIGHT, &h);
+    int levels = 1;
+    while ((w | h) >> levels) levels++;
+    Check(GpuMem().Live(MEM_QUAD) == TextureBytes(GL_RGBA32F, w, h, levels) + 6 * QuadLayout::stride, "quad accounting");
+    // the effect output is made by the first Run
+    Check(GpuMem().Live(MEM_EFFECTS) == 0, "no effect output before drawing");
+    quad.Draw(0);
+    Check(GpuMem().Live(MEM_EFFECTS) == TextureBytes(GL_RGBA32F, w, h, 1), "effect accounting");
+    GpuMem().Report();
+    GlobalLog().Flush();
+  }
+  GlPool().Trim();
+
+  // a rejecting budget throws before allocating, a warning one lets it through
+  GpuMem().SetBudget(MEM_OTHER, 1 << 20, BUDGET_REJECT);
+  bool rejected = false;
+  try {
+    GlBuffer b = CreateBuffer(MEM_OTHER, 2 << 20, NULL, 0);
+  } catch (const std::runtime_error&) {
+    rejected = true;
+  }
+  Check(rejected && GpuMem().Live(MEM_OTHER) == 0, "budget rejects");
+  GpuMem().ParseBudgets("other=1M:warn");
+  {
+    GlBuffer b = CreateBuffer(MEM_OTHER, 2 << 20, NULL, 0);
+    Check(GpuMem().budgets[MEM_OTHER].warned && GpuMem().Live(MEM_OTHER) == 2 << 20, "budget warns");
+  }
+  Check(!GpuMem().budgets[MEM_OTHER].warned, "budget warning resets");
+  GpuMem().SetBudget(MEM_OTHER, 0);
+  GlobalLog().Flush();
+
+  // bookkeeping cost per buffer
+  GLuint names[256];
+  double raw = Time([&]() {
+    glCreateBuffers(256, names);
+    for(GLuint& n : names) glNamedBufferStorage(n, 256, NULL, 0);
+    glDeleteBuffers(256, names);
+  }) / 256;
+  double tracked = Time([&]() {
+    for(int i=0; i<256; i++) CreateBuffer(MEM_OTHER, 256, NULL, 0);
+  }) / 256;
+  printf("  create and delete a buffer: raw %6.2fus  tracked %6.2fus\n", raw * 1e6, tracked * 1e6);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// framegraph
+////////////////////////////////////////////////////////////////////////////////
+
+static void BenchFrameGraph() {
+  GlContext();
+  printf("== framegraph\n");
+  auto Nop = []() {};
+
+  // barrier bits follow the reader, and a bit is issued once per write
+  {
+    FrameGraph fg;
+    FgResource verts = fg.ImportBuffer("vertices", 101);
+    FgResource image = fg.ImportTexture("effect", 102);
+    FgResource unused = fg.ImportBuffer("unused", 103);
+    int normals = fg.AddPass("normals", Nop).Write(verts, FG_STORAGE).pass;
+    int effect = fg.AddPass("effect", Nop).Write(image, FG_IMAGE).pass;
+    int orphan = fg.AddPass("orphan", Nop).Read(verts, FG_STORAGE).Write(unused, FG_STORAGE).pass;
+    int draw = fg.AddPass("draw", Nop).Read(verts, FG_VERTEX).Read(image, FG_SAMPLED).SideEffect().pass;
+    int again = fg.AddPass("again", Nop).Read(verts, FG_VERTEX).SideEffect().pass;
+    fg.Compile();
+    Check(!fg.Barrier(normals) && !fg.Barrier(effect), "barrier before the first write");
+    Check(fg.Culled(orphan), "pass with unused output kept");
+    Check(fg.Barrier(draw) == (GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT), "draw barrier bits");
+    Check(!fg.Barrier(again), "barrier repeated for the same write");
+    Check(fg.stats.barriers == 1, "barrier count");
+
+    // a write nothing read this frame is still pending in the next one
+    fg.Reset();
+    verts = fg.ImportBuffer("vertices", 101);
+    fg.Export(verts);
+    fg.AddPass("normals", Nop).Write(verts, FG_STORAGE);
+    fg.Compile();
+    fg.Reset();
+    verts = fg.ImportBuffer("vertices", 101);
+    int indirect = fg.AddPass("indirect", Nop).Read(verts, FG_INDIRECT).SideEffect().pass;
+    fg.Compile();
+    Check(fg.Barrier(indirect) == GL_COMMAND_BARRIER_BIT, "barrier carried to the next frame");
+
+    // culling follows the chain back
+    fg.Reset();
+    FgResource a = fg.CreateTexture("a", GL_RGBA8, 64, 64);
+    FgResource b = fg.CreateTexture("b", GL_RGBA8, 64, 64);
+    int first = fg.AddPass("first", Nop).Write(a, FG_IMAGE).pass;
+    int second = fg.AddPass("second", Nop).Read(a, FG_IMAGE).Write(b, FG_IMAGE).pass;
+    fg.Compile();
+    Check(fg.Culled(first) && fg.Culled(second) && fg.stats.physical == 0, "dead chain kept");
+  }
+
+  // transients of the same size share storage once their lifetimes end,
+  // and the next frame gets the same objects from the pool
+  {
+    FrameGraph fg;
+    GLuint names[3][2];
+    GlResourcePool::Counters before = GlPool().textures;
+    for(int frame=0; frame<2; frame++) {
+      fg.Reset();
+      FgResource t[3];
+      for(int i=0; i<3; i++) t[i] = fg.CreateTexture("ping", GL_RGBA16F, 512, 512);
+      fg.AddPass("a", [&]() { names[0][frame] = fg.Texture(t[0]); }).Write(t[0], FG_IMAGE);
+      fg.AddPass("b", [&]() { names[1][frame] = fg.Texture(t[1]); }).Read(t[0], FG_IMAGE).Write(t[1], FG_IMAGE);
+      fg.AddPass("c", [&]() { names[2][frame] = fg.Texture(t[2]); }).Read(t[1], FG_IMAGE).Write(t[2], FG_IMAGE);
+      fg.AddPass("d", Nop).Read(t[2], FG_SAMPLED).SideEffect();
+      fg.Execute();
+    }
+    GlResourcePool::Counters after = GlPool().textures;
+    printf("  3 transients: %u textures, %.2f MB instead of %.2f MB\n", fg.stats.physical, fg.stats.physicalBytes / 1048576.0, fg.stats.transientBytes / 1048576.0);
+    Check(fg.stats.physical == 2 && names[0][0] == names[2][0] && names[0][0] != names[1][0], "transient aliasing");
+    Check(names[0][1] == names[0][0] && names[1][1] == names[1][0], "transients move between frames");
+    Check(after.created - before.created == 2, "transients created");
+    Check(GpuMem().Live(MEM_TRANSIENT) == fg.stats.physicalBytes, "transient accounting");
+    fg.Reset();
+    fg.Execute();
+    Check(GpuMem().Live(MEM_TRANSIENT) == 0, "transients kept by an empty frame");
+  }
+
+  // the quad through the graph draws what Quad::Draw does
+  {
+    Quad quad;
+    quad.Init();
+    GlState().Viewport(0, 0, 256, 256);
+    glClear(GL_COLOR_BUFFER_BIT);
+    quad.Draw(1.5f);
+    std::vector<uint8_t> direct = ReadColor();
+
+    FrameGraph fg;
+    auto Frame = [&](bool drawn) {
+      fg.Reset();
+      FgResource src = fg.ImportTexture("quad", quad.tex);
+      FgResource effect = fg.CreateTexture("effect", GL_RGBA32F, quad.worker.w, quad.worker.h);
+      fg.AddPass("effect", [&, effect]() { quad.worker.Dispatch(1.5f, fg.Texture(effect)); }).Read(src, FG_IMAGE).Write(effect, FG_IMAGE);
+      if (drawn) fg.AddPass("quad", [&, effect]() { quad.DrawTexture(fg.Texture(effect)); }).Read(effect, FG_SAMPLED).SideEffect();
+      fg.Execute();
+    };
+    glClear(GL_COLOR_BUFFER_BIT);
+    Frame(true);
+    Check(direct == ReadColor(), "frame graph quad differs");
+    Check(fg.Barrier(1) == GL_TEXTURE_FETCH_BARRIER_BIT, "quad barrier");
+    Frame(false);
+    Check(fg.Culled(0) && fg.stats.physical == 0, "effect without a reader kept");
+
+    GlTiming t = TimeGl([&]() { Frame(true); }, 20);
+    GlTiming d = TimeGl([&]() { quad.Draw(1.5f); }, 20);
+    printf("  quad: Draw %8.1fus cpu  graph %8.1fus cpu\n", d.cpu * 1e6, t.cpu * 1e6);
+  }
+  GlPool().Trim();
+
+  // building and compiling a graph of 32 passes
+  FrameGraph fg;
+  double build = Time([&]() {
+    fg.Reset();
+    FgResource prev = fg.CreateBuffer("b", 4096);
+    for(int i=0; i<32; i++) {
+      FgResource next = fg.CreateBuffer("b", 4096);
+      fg.AddPass("p", Nop).Read(prev, FG_STORAGE).Write(next, FG_STORAGE);
+      prev = next;
+    }
+    fg.AddPass("out", Nop).Read(prev, FG_VERTEX).SideEffect();
+    fg.Compile();
+  });
+  printf("  32 pass graph: %6.2fus to build and compile, %u buffers\n", build * 1e6, fg.stats.physical);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// effects
+////////////////////////////////////////////////////////////////////////////////
+
+// Effect chains fused into as few kernels as they allow against a kernel
+// per stage, into an image and onto the quad
+static void BenchEffects() {
+  GlContext();
+  printf("== effects\n");
+  Quad quad;
+  quad.Init();
+  GLsizei w = quad.worker.w, h = quad.worker.h;
+  const float time = 1.5f;
+
+  auto Kernels = [](std::initializer_list<EffectStage> list, bool fuse) {
+    EffectChain chain;
+    for(const EffectStage& s : list) chain.Add(s);
+    chain.Build(64, 64, EFFECT_TO_IMAGE, fuse);
+    return chain.kernels.size();
+  };
+  Check(Kernels({ ChromaticStage(), WarpStage(), VignetteStage() }, true) == 1, "point stages after the first fused");
+  Check(Kernels({ ChromaticStage(), WarpStage(), BlurStage(), VignetteStage() }, true) == 2, "neighborhood stage fused");
+  Check(Kernels({ ChromaticStage(), WarpStage(), BlurStage(), VignetteStage() }, false) == 4, "unfused chain");
+
+  // Runs the chain on the quad texture through a frame graph, drawing the
+  // quad with a fragment kernel, returns the image or the screen
+  FrameGraph fg;
+  std::vector<float> image(w * h * 4);
+  auto Run = [&](EffectChain& chain) {
+    fg.Reset();
+    FgResource src = fg.ImportTexture("quad", quad.tex);
+    FgResource out = chain.AddPasses(fg, src, time);
+    if (chain.target == EFFECT_TO_FRAGMENT) {
+      fg.AddPass("quad", [&, out]() {
+        chain.BindFragment(fg.Texture(out), time, false);
+        quad.DrawVertices();
+      }).Read(out, FG_SAMPLED).SideEffect();
+    } else {
+      fg.AddPass("readback", [&, out]() {
+        glGetTextureImage(fg.Texture(out), 0, GL_RGBA, GL_FLOAT, image.size() * sizeof(float), image.data());
+      }).Read(out, FG_TEXTURE_UPDATE).SideEffect();
+    }
+    fg.Execute();
+  };
+  auto MaxError = [](const std::vector<float>& a, const std::vector<float>& b) {
+    float e = 0;
+    for(size_t i=0; i<a.size(); i++) e = fmaxf(e, fabsf(a[i] - b[i]));
+    return e;
+  };
+
+  // point stages read their input at texel centers, so fused and unfused
+  // agree up to filtering precision
+  {
+    EffectChain fused, split;
+    for(EffectChain* c : { &fused, &split }) {
+      c->Add(VignetteStage());
+      c->Add(GrainStage());
+      c->Add(VignetteStage());
+    }
+    fused.Build(w, h, EFFECT_TO_IMAGE, true);
+    split.Build(w, h, EFFECT_TO_IMAGE, false);
+    Run(fused);
+    std::vector<float> a = image;
+    Run(split);
+    float e = MaxError(a, image);
+    printf("  point chain: fused against unfused max error %g\n", e);
+    Check(e < 1e-3f, "fused point chain differs");
+  }
+
+  // per stage timing and bandwidth of the chains
+  struct Case {
+    const char* name;
+    std::initializer_list<EffectStage> stages;
+    EffectTarget target;
+  };
+  std::vector<uint8_t> screens[2];
+  Case cases[] = {
+    { "chromatic+warp, quad", { ChromaticStage(), WarpStage() }, EFFECT_TO_FRAGMENT },
+    { "chromatic+vignette+grain", { ChromaticStage(), VignetteStage(), GrainStage() }, EFFECT_TO_IMAGE },
+    { "chromatic+blur+vignette", { ChromaticStage(), BlurStage(), VignetteStage() }, EFFECT_TO_IMAGE },
+  };
+  GlState().Viewport(0, 0, 256, 256);
+  for(Case& c : cases) {
+    for(int fuse=1; fuse>=0; fuse--) {
+      EffectChain chain;
+      for(const EffectStage& s : c.stages) chain.Add(s);
+      chain.Build(w, h, c.target, fuse);
+      GlTiming t = TimeGl([&]() { Run(chain); }, 10);
+      printf("  %-26s %-7s %u kernels  %6.2f MB intermediates  %8.2fms\n", c.name, fuse ? "fused" : "unfused",
+          (unsigned)chain.kernels.size(), chain.IntermediateBytes() / 1048576.0, t.total * 1e3);
+      if (c.target == EFFECT_TO_FRAGMENT) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        Run(chain);
+        screens[fuse] = ReadColor();
+      }
+    }
+  }
+
+  // the quad fused samples the source where unfused resamples an
+  // intermediate, so they only agree on average
+  double sum = 0;
+  for(size_t i=0; i<screens[0].size(); i++) sum += abs(screens[0][i] - screens[1][i]);
+  double mean = sum / screens[0].size();
+  printf("  quad: fused against unfused mean error %.3f of 255\n", mean);
+  Check(mean < 4, "fused quad differs");
+  fg.Release();
+  GlPool().Trim();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// precision
+////////////////////////////////////////////////////////////////////////////////
+
+// Effect outputs and intermediates in reduced precision formats against
+// the float32 path
+static void BenchPrecision() {
+  GlContext();
+  printf("== precision\n");
+  // k/255 values, mostly not exact in half floats; the quad's photo is
+  // scaled by 1/256 and would pass through rgba16f untouched
+  const GLsizei w = 512, h = 512;
+  const float time = 1.5f;
+  std::vector<float> texels(w * h * 4);
+  for(GLsizei y=0; y<h; y++)
+    for(GLsizei x=0; x<w; x++)
+      for(int c=0; c<4; c++) texels[(y * w + x) * 4 + c] = ((x * 7 + y * 13 + c * 29) % 256) / 255.0f;
+  GlTexture source = CreateTexture2D(MEM_OTHER, GL_RGBA32F, w, h);
+  glTextureSubImage2D(source, 0, 0, 0, w, h, GL_RGBA, GL_FLOAT, texels.data());
+  glTextureParameteri(source, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTextureParameteri(source, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTextureParameteri(source, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(source, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  struct Format {
+    GLenum format;
+    float bound; // max error expected, values are 0..1
+  };
+  const Format formats[] = {
+    { GL_RGBA32F, 0 },
+    { GL_RGBA16F, 2e-3f },
+    { GL_R11F_G11F_B10F, 0.05f },
+    { GL_RGBA8, 0.02f },
+  };
+  std::vector<float> reference, image(w * h * 4);
+  auto Compare = [&](GLuint tex) {
+    glGetTextureImage(tex, 0, GL_RGBA, GL_FLOAT, image.size() * sizeof(float), image.data());
+    if (reference.empty()) reference = image;
+    float e = 0;
+    for(size_t i=0; i<image.size(); i++) e = fmaxf(e, fabsf(image[i] - reference[i]));
+    return e;
+  };
+
+  // the chromatic effect's output
+  for(const Format& f : formats) {
+    TextureComputeShader worker;
+    worker.Init(source, w, h, f.format);
+    worker.Run(time);
+    float e = Compare(worker.tex);
+    GlTiming t = TimeGl([&]() { worker.Run(time); }, 10);
+    printf("  effect output %-15s %2zu bytes/px  %8.1f Mpx/s  max error %g\n", ImageFormatQualifier(f.format),
+        TextureFormatBytes(f.format), w * h / t.total * 1e-6, e);
+    Check(e <= f.bound, "effect output error");
+  }
+
+  // a kernel per stage, every intermediate in the format, the output float
+  reference.clear();
+  FrameGraph fg;
+  for(const Format& f : formats) {
+    EffectChain chain;
+    chain.Add(ChromaticStage());
+    chain.Add(BlurStage());
+    chain.Add(VignetteStage());
+    chain.Add(GrainStage());
+    chain.Build(w, h, EFFECT_TO_IMAGE, false, f.format);
+    chain.SetFormat(chain.kernels.size() - 1, GL_RGBA32F);
+    float e = 0;
+    auto Run = [&](bool compare) {
+      fg.Reset();
+      FgResource out = chain.AddPasses(fg, fg.ImportTexture("source", source), time);
+      fg.AddPass("readback", [&, out]() { if (compare) e = Compare(fg.Texture(out)); }).Read(out, FG_TEXTURE_UPDATE).SideEffect();
+      fg.Execute();
+    };
+    Run(true);
+    GlTiming t = TimeGl([&]() { Run(false); }, 10);
+    printf("  4 stage chain %-15s %5.2f MB intermediates  %8.1f Mpx/s  max error %g\n", ImageFormatQualifier(f.format),
+        chain.IntermediateBytes() / 1048576.0, w * h / t.total * 1e-6, e);
+    Check(e <= f.bound * 2, "chain intermediate error");
+  }
+  fg.Release();
+  GlPool().Trim();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cpucompute
+////////////////////////////////////////////////////////////////////////////////
+
+// The CPU backend of the compute passes against the shaders, by level and
+// with or without the thread pool
+static void BenchCpuCompute() {
+  GlContext();
+  printf("== cpucompute\n");
+  CcLevel best = CcGetLevel();
+
+  // chromatic offset of the quad texture
+  Quad quad;
+  quad.Init();
+  TextureComputeShader& worker = quad.worker;
+  int w = worker.w, h = worker.h;
+  const float time = 1.5f;
+  worker.SetBackend(COMPUTE_GL);
+  worker.Run(time);
+  std::vector<float> gpu(w * h * 4);
+  glGetTextureImage(worker.tex, 0, GL_RGBA, GL_FLOAT, gpu.size() * sizeof(float), gpu.data());
+  GlTiming tg = TimeGl([&]() { worker.Run(time); }, 5);
+  printf("  chromatic %dx%d  gl %8.2fms\n", w, h, tg.total * 1e3);
+
+  worker.SetBackend(COMPUTE_CPU);
+  for(int level=CC_SCALAR; level<=best; level++)
+    for(int threads=0; threads<2; threads++) {
+      CcSetLevel((CcLevel)level);
+      CcSetThreads(threads);
+      std::fill(worker.pixels.begin(), worker.pixels.end(), -1.0f);
+      CpuChromatic(worker.pixels.data(), worker.source.data(), w, h, time);
+      size_t differ = 0;
+      for(size_t i=0; i<gpu.size(); i++) differ += worker.pixels[i] != gpu[i];
+      double t = Time([&]() { CpuChromatic(worker.pixels.data(), worker.source.data(), w, h, time); });
+      printf("  chromatic %dx%d  %-6s %-9s %8.2fms  %zu values differ\n", w, h, cc_level_names[level], threads ? "threaded" : "1 thread", t * 1e3, differ);
+      // sin and cos on the GPU may round differently, moving an offset by a pixel
+      Check(differ <= gpu.size() / 1000, "cpu chromatic differs from the shader");
+    }
+
+  // and through the GL, as Run uploads it
+  worker.Run(time);
+  std::vector<float> uploaded(gpu.size());
+  glGetTextureImage(worker.tex, 0, GL_RGBA, GL_FLOAT, uploaded.size() * sizeof(float), uploaded.data());
+  Check(uploaded == worker.pixels, "cpu backend upload");
+  GlTiming tc = TimeGl([&]() { worker.Run(time); }, 5);
+  printf("  chromatic cpu backend Run with upload %8.2fms\n", tc.total * 1e3);
+
+  // flat normals of a vertex buffer mesh
+  VertexMesh mesh;
+  mesh.Init(256, 256);
+  size_t triangles = mesh.worker.triangles;
+  std::vector<float> records(triangles * 24), reference(records.size());
+  glGetNamedBufferSubData(mesh.vertexBuffer, 0, records.size() * sizeof(float), records.data());
+  // scramble the normals so the pass has to write them
+  for(size_t v=0; v<triangles*3; v++) records[8*v + 4] = 7;
+  glNamedBufferSubData(mesh.vertexBuffer, 0, records.size() * sizeof(float), records.data());
+  mesh.worker.SetBackend(COMPUTE_GL);
+  mesh.worker.Run();
+  glGetNamedBufferSubData(mesh.vertexBuffer, 0, reference.size() * sizeof(float), reference.data());
+  GlTiming ng = TimeGl([&]() { mesh.worker.Run(); }, 5);
+  printf("  normals %zu triangles  gl %8.2fms\n", triangles, ng.total * 1e3);
+  for(int level=CC_SCALAR; level<=best; level++)
+    for(int threads=0; threads<2; threads++) {
+      CcSetLevel((CcLevel)level);
+      CcSetThreads(threads);
+      std::vector<float> v = records;
+      CpuFlatNormals(v.data(), triangles);
+      float e = 0;
+      for(size_t i=0; i<v.size(); i++) e = fmaxf(e, fabsf(v[i] - reference[i]));
+      double t = Time([&]() { CpuFlatNormals(v.data(), triangles); });
+      printf("  normals %zu triangles  %-6s %-9s %8.2fms  max error %g\n", triangles, cc_level_names[level], threads ? "threaded" : "1 thread", t * 1e3, e);
+      Check(e < 1e-5f, "cpu normals differ from the shader");
+    }
+  CcSetLevel(best);
+  CcSetThreads(true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// golden
+////////////////////////////////////////////////////////////////////////////////
+
+// Fixed scenes rendered at fixed times into a target of their own,
+// compared with golden images and timed in the same run. The goldens are
+// PPMs in $GOLDEN_DIR (default "golden") with baseline.json next to them,
+// the frame time of each scene in ms; both are committed and only
+// rewritten with GOLDEN_UPDATE=1, a scene without them fails. A scene fails
+// if more than 0.1% of its pixels are off by more than 2 in some channel or
+// its PSNR drops below 40 dB, its frame is then left as
+// <scene>.actual.ppm; it regresses if it takes longer than $GOLDEN_SLACK
+// (default 1.5) times the baseline + 0.5ms.
+
+static const int GoldenSize = 256;
+
+// RGB rows top down, from the bottom up rows of a GoldenSize^2 texture
+static std::vector<uint8_t> TextureRgb(GLuint texture) {
+  const size_t row = GoldenSize * 3;
+  std::vector<uint8_t> pixels(row * GoldenSize), rgb(pixels.size());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glGetTextureImage(texture, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.size(), pixels.data());
+  for(int y=0; y<GoldenSize; y++)
+    memcpy(&rgb[y * row], &pixels[(GoldenSize - 1 - y) * row], row);
+  return rgb;
+}
+
+static bool WritePpm(const std::string& path, const std::vector<uint8_t>& rgb) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  fprintf(f, "P6\n%d %d\n255\n", GoldenSize, GoldenSize);
+  bool ok = fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+  return fclose(f) == 0 && ok;
+}
+
+static bool ReadPpm(const std::string& path, std::vector<uint8_t>& rgb) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  int w = 0, h = 0, max = 0;
+  bool ok = fscanf(f, "P6 %d %d %d", &w, &h, &max) == 3 && fgetc(f) != EOF && w == GoldenSize && h == GoldenSize && max == 255;
+  rgb.resize(GoldenSize * GoldenSize * 3);
+  ok = ok && fread(rgb.data(), 1, rgb.size(), f) == rgb.size();
+  fclose(f);
+  return ok;
+}
+
+// baseline.json is one flat object of "scene": ms pairs
+static std::map<std::string, double> ReadBaseline(const std::string& path) {
+  std::map<std::string, double> times;
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) return times;
+  char name[128];
+  double ms;
+  while(fscanf(f, " %*[{,] \"%127[^\"]\" : %lf", name, &ms) == 2) times[name] = ms;
+  fclose(f);
+  return times;
+}
+
+static void WriteBaseline(const std::string& path, const std::map<std::string, double>& times) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) return;
+  const char* sep = "{\n";
+  for(const auto& t : times) {
+    fprintf(f, "%s  \"%s\": %.3f", sep, t.first.c_str(), t.second);
+    sep = ",\n";
+  }
+  fprintf(f, "\n}\n");
+  fclose(f);
+}
+
+static void BenchGolden() {
+  GlContext();
+  printf("== golden\n");
+  const char* env = getenv("GOLDEN_DIR");
+  std::string dir = env ? env : "golden";
+  bool update = getenv("GOLDEN_UPDATE") && atoi(getenv("GOLDEN_UPDATE"));
+  double slack = getenv("GOLDEN_SLACK") ? atof(getenv("GOLDEN_SLACK")) : 1.5;
+  std::string baselinePath = dir + "/baseline.json";
+  std::map<std::string, double> baseline = ReadBaseline(baselinePath), times;
+  if (update) mkdir(dir.c_str(), 0755);
+
+  // the window's own pixels need not be rendered while it is hidden
+  GlTexture color = CreateTexture2D(MEM_OTHER, GL_RGBA8, GoldenSize, GoldenSize);
+  GlTexture depth = CreateTexture2D(MEM_OTHER, GL_DEPTH_COMPONENT24, GoldenSize, GoldenSize);
+  GlFramebuffer target = CreateFramebuffer();
+  glNamedFramebufferTexture(target, GL_COLOR_ATTACHMENT0, color, 0);
+  glNamedFramebufferTexture(target, GL_DEPTH_ATTACHMENT, depth, 0);
+  Check(glCheckNamedFramebufferStatus(target, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "golden render target incomplete");
+
+  Quad quad;
+  quad.Init();
+  EffectChain chain;
+  chain.Add(ChromaticStage());
+  chain.Add(BlurStage());
+  chain.Add(VignetteStage());
+  chain.Build(quad.worker.w, quad.worker.h, EFFECT_TO_FRAGMENT);
+  FrameGraph fg;
+
+  InstanceBuffer instances;
+  instances.Init(1);
+  for(int c=0; c<InstanceBuffer::Copies; c++) {
+    Instance* inst = (Instance*)instances.Begin();
+    mat4x4_identity(inst->model);
+    mat4x4_rotate_X(inst->model, inst->model, -0.8f);
+    instances.End();
+  }
+  mat4x4 ortho;
+  mat4x4_ortho(ortho, -1.5f, 1.5f, -1.5f, 1.5f, 2.0f, -2.0f);
+  srand(7);
+  VertexMesh mesh;
+  mesh.Init(64, 64);
+  srand(7);
+  VertexMesh packed;
+  packed.Init(64, 64, MESH_PACKED, GL_SHORT, nullptr);
+
+  // BenchTerrain's camera
+  const float fov = 60.0f * (float)M_PI / 180.0f;
+  vec3 eye = { 200, 200, 250 }, center = { 600, 600, 50 }, up = { 0, 0, 1 };
+  mat4x4 v, p, vp;
+  mat4x4_look_at(v, eye, center, up);
+  mat4x4_perspective(p, fov, 1.0f, 1.0f, 20000.0f);
+  mat4x4_mul(vp, p, v);
+  Heightfield field;
+  field.Generate(1024, 1.0f, 120.0f);
+  field.Upload();
+  CdlodTerrain terrain;
+  terrain.Init(field);
+  terrain.SetView(fov, 1080, 2.0f);
+  terrain.Select(vp, eye);
+
+  struct Scene {
+    const char* name;
+    bool depth;
+    std::function<void()> draw;
+  };
+  Scene scenes[] = {
+    { "quad@0.5", false, [&]() { quad.Draw(0.5f); } },
+    { "quad@2.0", false, [&]() { quad.Draw(2.0f); } },
+    { "effects@1.0", false, [&]() {
+      fg.Reset();
+      FgResource out = chain.AddPasses(fg, fg.ImportTexture("quad", quad.tex), 1.0f);
+      fg.AddPass("quad", [&, out]() {
+        chain.BindFragment(fg.Texture(out), 1.0f, false);
+        quad.DrawVertices();
+      }).Read(out, FG_SAMPLED).SideEffect();
+      fg.Execute();
+    } },
+    { "mesh@1.0", true, [&]() { mesh.Draw(ortho, 1.0f, instances, 1); } },
+    { "packed@1.0", true, [&]() { packed.Draw(ortho, 1.0f, instances, 1); } },
+    { "terrain", true, [&]() { terrain.Draw(vp, eye); } },
+  };
+
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  GlState().Viewport(0, 0, GoldenSize, GoldenSize);
+  printf("  %-12s %9s %9s  %10s %10s  %s\n", "scene", "PSNR", "off", "frame", "baseline", "");
+  for(Scene& s : scenes) {
+    if (s.depth) glEnable(GL_DEPTH_TEST);
+    auto Frame = [&]() {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      s.draw();
+    };
+    Frame();
+    glFinish();
+    std::vector<uint8_t> actual = TextureRgb(color), golden;
+    double ms = TimeGl(Frame, 10).total * 1e3;
+    if (s.depth) glDisable(GL_DEPTH_TEST);
+    times[s.name] = ms;
+
+    std::string path = dir + "/" + s.name + ".ppm";
+    if (update) {
+      Check(WritePpm(path, actual), "golden not written");
+      printf("  %-12s %9s %9s  %8.2fms %10s  recorded\n", s.name, "-", "-", ms, "-");
+      continue;
+    }
+    if (!ReadPpm(path, golden)) {
+      Check(false, (path + " missing, record it with GOLDEN_UPDATE=1").c_str());
+      continue;
+    }
+
+    double sse = 0;
+    size_t off = 0;
+    for(size_t i=0; i<actual.size(); i+=3) {
+      int worst = 0;
+      for(int c=0; c<3; c++) {
+        int d = abs(actual[i + c] - golden[i + c]);
+        sse += d * d;
+        worst = d > worst ? d : worst;
+      }
+      off += worst > 2;
+    }
+    double mse = sse / actual.size();
+    double psnr = mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : INFINITY;
+    bool same = off * 1000 <= actual.size() / 3 && psnr >= 40;
+    if (!same) WritePpm(dir + "/" + s.name + ".actual.ppm", actual);
+    Check(same, (std::string(s.name) + " differs from its golden").c_str());
+
+    auto base = baseline.find(s.name);
+    if (base == baseline.end()) {
+      Check(false, (std::string(s.name) + " has no baseline time, record it with GOLDEN_UPDATE=1").c_str());
+      printf("  %-12s %7.1fdB %9zu  %8.2fms %10s  %s\n", s.name, psnr, off, ms, "-", !same ? "DIFFERS" : "");
+      continue;
+    }
+    bool slow = ms > base->second * slack + 0.5;
+    Check(!slow, (std::string(s.name) + " frame time regressed").c_str());
+    printf("  %-12s %7.1fdB %9zu  %8.2fms %8.2fms  %s\n", s.name, psnr, off, ms, base->second, !same ? "DIFFERS" : slow ? "SLOWER" : "");
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // the baseline keeps its times unless asked, so regressions cannot creep in
+  if (update) {
+    WriteBaseline(baselinePath, times);
+    printf("  baseline written to %s\n", baselinePath.c_str());
+  }
+  fg.Release();
+  GlPool().Trim();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Suite {
+  const char* name;
+  void (*run)();
+};
+
+static const Suite suites[] = {
+  { "pixelconv", BenchPixelConv },
+  { "linmath",   BenchLinmathSimd },
+  { "batch",     BenchLinmathBatch },
+  { "constexpr", BenchLinmathConstexpr },
+  { "affine",    BenchLinmathAffine },
+  { "transform", BenchTransforms },
+  { "instancing", BenchInstancing },
+  { "culling",   BenchCulling },
+  { "terrain",   BenchTerrain },
+  { "tessellation", BenchTessellation },
+  { "procedural", BenchProcedural },
+  { "pulling",   BenchPulling },
+  { "packed",    BenchPacked },
+  { "meshopt",   BenchMeshOpt },
+  { "layout",    BenchLayout },
+  { "strips",    BenchStrips },
+  { "state",     BenchState },
+  { "log",       BenchLog },
+  { "resources", BenchResources },
+  { "memory",    BenchMemory },
+  { "framegraph", BenchFrameGraph },
+  { "effects",   BenchEffects },
+  { "precision", BenchPrecision },
+  { "cpucompute", BenchCpuCompute },
+  { "golden",    BenchGolden },
+};
+
+int main(int argc, char** argv) {
+  GlobalLog().Start(stdout);
+  for(const Suite& s : suites) {
+    bool selected = argc < 2;
+    for(int i=1; i<argc; i++)
+      if (!strcmp(argv[i], s.name)) selected = true;
+    if (selected) s.run();
+  }
+
+  GlobalLog().Stop();
+  if (failures) printf("%d mismatches\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+#ifndef CPUCOMPUTE_H
+#define CPUCOMPUTE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "threadpool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+  #define CC_X86 1
+  #include <immintrin.h>
+#endif
+
+// CPU versions of the compute shaders, for hosts where the GL is a
+// software rasterizer anyway. They work on plain float arrays, no context
+// needed, and give the same results: TextureComputeShader's chromatic
+// offset bit for bit, ComputeShader's flat normals to float rounding. Rows
+// and triangle ranges are split over the thread pool.
+
+enum CcLevel { CC_SCALAR, CC_AVX2, CC_LEVEL_COUNT };
+
+// printed by the bench
+[[maybe_unused]] static const char* cc_level_names[CC_LEVEL_COUNT] = { "scalar", "avx2" };
+
+// Image rows and triangles per chunk handed to the pool
+#ifndef CC_PARALLEL_PIXELS
+  #define CC_PARALLEL_PIXELS 16384
+#endif
+#ifndef CC_PARALLEL_TRIANGLES
+  #define CC_PARALLEL_TRIANGLES 4096
+#endif
+
+struct CcChromaticParams {
+  float abbx, abby; // sin(iTime) * 20, cos(iTime) * 20
+};
+
+typedef void (*CcChromaticKernel)(float* dst, const float* src, int w, int h, const CcChromaticParams* p, int y0, int y1);
+typedef void (*CcNormalsKernel)(float* vertices, size_t t0, size_t t1);
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar reference kernels
+////////////////////////////////////////////////////////////////////////////////
+
+// One pixel of TextureComputeShader::src. GLSL converts coord + offset to
+// int by truncation and imageLoad reads zeros outside the image.
+static inline void cc_chromatic_pixel(float* dst, const float* src, int w, int h, const CcChromaticParams* p, int x, int y)
+{
+  int gx = (int)((float)x + p->abbx * 1), gy = (int)((float)y + p->abby);
+  int bx = (int)((float)x + p->abbx * 2), by = (int)((float)y + p->abby * 2);
+  float* o = dst + 4 * ((size_t)y * w + x);
+  o[0] = src[4 * ((size_t)y * w + x) + 0];
+  o[1] = gx >= 0 && gx < w && gy >= 0 && gy < h ? src[4 * ((size_t)gy * w + gx) + 1] : 0;
+  o[2] = bx >= 0 && bx < w && by >= 0 && by < h ? src[4 * ((size_t)by * w + bx) + 2] : 0;
+  o[3] = 1;
+}
+
+static void cc_chromatic_scalar(float* dst, const float* src, int w, int h, const CcChromaticParams* p, int y0, int y1)
+{
+  for(int y=y0; y<y1; y++)
+    for(int x=0; x<w; x++) cc_chromatic_pixel(dst, src, w, h, p, x, y);
+}
+
+// ComputeShader::src on MeshVertex records, 4 floats of position and 4 of
+// normal, 3 per triangle
+static void cc_normals_scalar(float* v, size_t t0, size_t t1)
+{
+  for(size_t t=t0; t<t1; t++) {
+    float* p1 = v + 24*t, *p2 = p1 + 8, *p3 = p1 + 16;
+    float ax = p1[0] - p2[0], ay = p1[1] - p2[1], az = p1[2] - p2[2];
+    float bx = p3[0] - p2[0], by = p3[1] - p2[1], bz = p3[2] - p2[2];
+    float cx = ay*bz - az*by;
+    float cy = az*bx - ax*bz;
+    float cz = ax*by - ay*bx;
+    float k = 1.f / sqrtf(cx*cx + cy*cy + cz*cz);
+    for(int i=0; i<3; i++) {
+      float* n = p1 + 8*i + 4;
+      n[0] = cx * k;
+      n[1] = cy * k;
+      n[2] = cz * k;
+      n[3] = 0;
+    }
+  }
+}
+
+#ifdef CC_X86
+////////////////////////////////////////////////////////////////////////////////
+// AVX2 kernels
+////////////////////////////////////////////////////////////////////////////////
+
+// Channel `c` of 8 pixels at x..x+7 + offset in row `row`, zero where the
+// pixel is outside the image
+__attribute__((target("avx2")))
+static inline __m256 cc_gather_channel_avx2(const float* src, int w, int h, __m256i xs, float offset, int row, int c)
+{
+  if (row < 0 || row >= h) return _mm256_setzero_ps();
+  __m256i x = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_cvtepi32_ps(xs), _mm256_set1_ps(offset)));
+  __m256i in = _mm256_and_si256(_mm256_cmpgt_epi32(x, _mm256_set1_epi32(-1)), _mm256_cmpgt_epi32(_mm256_set1_epi32(w), x));
+  __m256i idx = _mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(_mm256_set1_epi32(row * w), x), 2), _mm256_set1_epi32(c));
+  return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), src, idx, _mm256_castsi256_ps(in), 4);
+}
+
+// 8 pixels of r, g, b and a in 4 registers -> 8 interleaved rgba pixels
+__attribute__((target("avx2")))
+static inline void cc_store_rgba8_avx2(float* dst, __m256 r, __m256 g, __m256 b, __m256 a)
+{
+  __m256 rg_lo = _mm256_unpacklo_ps(r, g), rg_hi = _mm256_unpackhi_ps(r, g);
+  __m256 ba_lo = _mm256_unpacklo_ps(b, a), ba_hi = _mm256_unpackhi_ps(b, a);
+  __m256 p04 = _mm256_shuffle_ps(rg_lo, ba_lo, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 p15 = _mm256_shuffle_ps(rg_lo, ba_lo, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 p26 = _mm256_shuffle_ps(rg_hi, ba_hi, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 p37 = _mm256_shuffle_ps(rg_hi, ba_hi, _MM_SHUFFLE(3, 2, 3, 2));
+  _mm256_storeu_ps(dst +  0, _mm256_permute2f128_ps(p04, p15, 0x20));
+  _mm256_storeu_ps(dst +  8, _mm256_permute2f128_ps(p26, p37, 0x20));
+  _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+  _mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void cc_chromatic_avx2(float* dst, const float* src, int w, int h, const CcChromaticParams* p, int y0, int y1)
+{
+  const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 one = _mm256_set1_ps(1);
+  for(int y=y0; y<y1; y++) {
+    int gy = (int)((float)y + p->abby), by = (int)((float)y + p->abby * 2);
+    int x = 0;
+    for(; x+8<=w; x+=8) {
+      __m256i xs = _mm256_add_epi32(_mm256_set1_epi32(x), iota);
+      __m256 r = cc_gather_channel_avx2(src, w, h, xs, 0, y, 0);
+      __m256 g = cc_gather_channel_avx2(src, w, h, xs, p->abbx * 1, gy, 1);
+      __m256 b = cc_gather_channel_avx2(src, w, h, xs, p->abbx * 2, by, 2);
+      cc_store_rgba8_avx2(dst + 4 * ((size_t)y * w + x), r, g, b, one);
+    }
+    for(; x<w; x++) cc_chromatic_pixel(dst, src, w, h, p, x, y);
+  }
+}
+
+// 8 triangles at a time: positions gathered at a 24 float stride, normals
+// transposed back and stored to each of the 3 records
+__attribute__((target("avx2")))
+static void cc_normals_avx2(float* v, size_t t0, size_t t1)
+{
+  const __m256i stride = _mm256_setr_epi32(0, 24, 48, 72, 96, 120, 144, 168);
+  size_t t = t0;
+  for(; t+8<=t1; t+=8) {
+    float* base = v + 24*t;
+    __m256 p[3][3];
+    for(int i=0; i<3; i++)
+      for(int k=0; k<3; k++) p[i][k] = _mm256_i32gather_ps(base + 8*i + k, stride, 4);
+    __m256 ax = _mm256_sub_ps(p[0][0], p[1][0]), ay = _mm256_sub_ps(p[0][1], p[1][1]), az = _mm256_sub_ps(p[0][2], p[1][2]);
+    __m256 bx = _mm256_sub_ps(p[2][0], p[1][0]), by = _mm256_sub_ps(p[2][1], p[1][1]), bz = _mm256_sub_ps(p[2][2], p[1][2]);
+    __m256 cx = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by));
+    __m256 cy = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz));
+    __m256 cz = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+    __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz));
+    __m256 k = _mm256_div_ps(_mm256_set1_ps(1), _mm256_sqrt_ps(len2));
+    float n[32];
+    cc_store_rgba8_avx2(n, _mm256_mul_ps(cx, k), _mm256_mul_ps(cy, k), _mm256_mul_ps(cz, k), _mm256_setzero_ps());
+    for(int j=0; j<8; j++) {
+      __m128 nj = _mm_loadu_ps(n + 4*j);
+      for(int i=0; i<3; i++) _mm_storeu_ps(base + 24*j + 8*i + 4, nj);
+    }
+  }
+  cc_normals_scalar(v, t, t1);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+////////////////////////////////////////////////////////////////////////////////
+
+struct CcDispatch {
+  CcChromaticKernel chromatic[CC_LEVEL_COUNT];
+  CcNormalsKernel normals[CC_LEVEL_COUNT];
+  CcLevel supported;
+  CcLevel level;
+  bool threads;
+
+  CcDispatch() {
+    for(int l=0; l<CC_LEVEL_COUNT; l++) {
+      chromatic[l] = cc_chromatic_scalar;
+      normals[l] = cc_normals_scalar;
+    }
+    supported = CC_SCALAR;
+#ifdef CC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      chromatic[CC_AVX2] = cc_chromatic_avx2;
+      normals[CC_AVX2] = cc_normals_avx2;
+      supported = CC_AVX2;
+    }
+#endif
+    level = supported;
+    threads = true;
+  }
+};
+
+static inline CcDispatch& cc_dispatch()
+{
+  static CcDispatch dispatch;
+  return dispatch;
+}
+
+// Force a lower instruction set level, clamped to what the cpu supports
+static inline CcLevel CcSetLevel(CcLevel level)
+{
+  CcDispatch& d = cc_dispatch();
+  d.level = level < d.supported ? level : d.supported;
+  return d.level;
+}
+
+static inline CcLevel CcGetLevel() { return cc_dispatch().level; }
+static inline void CcSetThreads(bool enabled) { cc_dispatch().threads = enabled; }
+
+////////////////////////////////////////////////////////////////////////////////
+// Public kernels
+////////////////////////////////////////////////////////////////////////////////
+
+// TextureComputeShader at iTime `time`: w x h rgba floats from src to dst
+static inline void CpuChromatic(float* dst, const float* src, int w, int h, float time)
+{
+  CcDispatch& d = cc_dispatch();
+  CcChromaticKernel kernel = d.chromatic[d.level];
+  CcChromaticParams p = { sinf(time) * 20, cosf(time) * 20 };
+  size_t rows = w > 0 ? (CC_PARALLEL_PIXELS + w - 1) / w : 1;
+  if (!d.threads) {
+    kernel(dst, src, w, h, &p, 0, h);
+    return;
+  }
+  ParallelFor(h, rows, [&](size_t b, size_t e) { kernel(dst, src, w, h, &p, b, e); });
+}
+
+// ComputeShader in place on 3 * triangles MeshVertex records
+static inline void CpuFlatNormals(float* vertices, size_t triangles)
+{
+  CcDispatch& d = cc_dispatch();
+  CcNormalsKernel kernel = d.normals[d.level];
+  if (!d.threads) {
+    kernel(vertices, 0, triangles);
+    return;
+  }
+  ParallelFor(triangles, CC_PARALLEL_TRIANGLES, [&](size_t b, size_t e) { kernel(vertices, b, e); });
+}
+
+// Where the compute passes run. COMPUTE_BACKEND=gl|cpu in the environment
+// picks the default.
+enum ComputeBackend { COMPUTE_GL, COMPUTE_CPU };
+
+inline ComputeBackend ComputeBackendFromEnv() {
+  const char* e = getenv("COMPUTE_BACKEND");
+  return e && !strcmp(e, "cpu") ? COMPUTE_CPU : COMPUTE_GL;
+}
+
+#endif // CPUCOMPUTE_H
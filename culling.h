@@ -0,0 +1,227 @@
+#include <vector>
+
+// Planes of the clip volume of M, as (normal, d) with the normals pointing
+// inwards and normalized, so dot(n, p) + d is the signed distance of p.
+// Order: left, right, bottom, top, near, far.
+static inline void frustum_planes(vec4 planes[6], mat4x4 M) {
+  for(int i=0; i<3; i++)
+    for(int k=0; k<4; k++) {
+      planes[2*i + 0][k] = M[k][3] + M[k][i];
+      planes[2*i + 1][k] = M[k][3] - M[k][i];
+    }
+  for(int i=0; i<6; i++) {
+    float l = sqrtf(planes[i][0]*planes[i][0] + planes[i][1]*planes[i][1] + planes[i][2]*planes[i][2]);
+    vec4_scale(planes[i], planes[i], 1.0f / l);
+  }
+}
+
+struct DrawArraysIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint first;
+  GLuint baseInstance;
+};
+
+struct CullStats {
+  uint32_t objects;
+  uint32_t visible;
+  uint32_t culled;
+};
+
+// Frustum culling on the GPU. Every object is an instance record in an
+// InstanceBuffer plus the draw it belongs to; a draw is a vertex range with
+// a bounding sphere in model space. Cull() tests each object's transformed
+// sphere against the frustum of vp and appends the visible ones to the
+// range of `visible` reserved for their draw, counting them in the draw's
+// instanceCount. The commands are then consumed by one
+// glMultiDrawArraysIndirect, so the CPU cost doesn't depend on the scene.
+//
+// The visible count of each frame lands in a slot of a persistently mapped
+// buffer; Stats() reports the newest slot the GPU has finished with, so
+// reading it never stalls.
+struct GpuCuller {
+  static const int Copies = 3;
+  static const char* src;
+  GlProgram program;
+  GLint planesLoc, countLoc;
+
+  GlBuffer visible;    // compacted instance record indices
+  GlBuffer objectDraw; // draw index of every object
+  GlBuffer commands;   // DrawArraysIndirectCommand per draw, written by Cull
+  GlBuffer templates;  // the same with zero instances, copied over commands
+  GlBuffer drawBounds; // vec4 sphere per draw
+  GlBuffer counters;
+  GLint counterStride;
+  uint32_t* counterMap;
+  GlFence fences[Copies];
+  int slot;
+  uint32_t slotObjects[Copies];
+  CullStats stats;
+
+  size_t capacity;
+  uint32_t objectCount;
+  std::vector<DrawArraysIndirectCommand> draws;
+  std::vector<float> bounds;
+
+  GpuCuller() {}
+  void Init(size_t capacity) {
+    this->capacity = capacity;
+    objectCount = 0;
+    stats = { 0, 0, 0 };
+
+    program = LinkProgram({ CompileShader(GL_COMPUTE_SHADER, &src) });
+    planesLoc = glGetUniformLocation(program, "planes");
+    countLoc = glGetUniformLocation(program, "objectCount");
+
+    GlPool().Recycle(visible);
+    GlPool().Recycle(objectDraw);
+    visible = GlPool().AcquireBuffer(MEM_CULLING, capacity * sizeof(uint32_t));
+    objectDraw = GlPool().AcquireBuffer(MEM_CULLING, capacity * sizeof(uint32_t));
+
+    counterStride = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &counterStride);
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    counters = CreateBuffer(MEM_CULLING, counterStride * Copies, NULL, flags);
+    counterMap = (uint32_t*)glMapNamedBufferRange(counters, 0, counterStride * Copies, flags);
+    for(int i=0; i<Copies; i++) {
+      fences[i].Reset();
+      slotObjects[i] = 0;
+    }
+    slot = 0;
+  }
+
+  // Adds a draw of `count` vertices from `first`, returns its index
+  uint32_t AddDraw(GLuint first, GLuint count, vec4 sphere) {
+    DrawArraysIndirectCommand c = { count, 0, first, 0 };
+    draws.push_back(c);
+    for(int k=0; k<4; k++) bounds.push_back(sphere[k]);
+    return draws.size() - 1;
+  }
+
+  // Object i is instance record i and belongs to draw objectDraws[i], or to
+  // draw 0 when objectDraws is null. Call again whenever objects change.
+  void SetObjects(const uint32_t* objectDraws, uint32_t count) {
+    if (count > capacity) throw std::runtime_error("GpuCuller: too many objects");
+    objectCount = count;
+    std::vector<uint32_t> ids(count, 0);
+    if (objectDraws) ids.assign(objectDraws, objectDraws + count);
+
+    // each draw gets a range of `visible` as large as its object count
+    std::vector<uint32_t> perDraw(draws.size(), 0);
+    for(uint32_t d : ids) perDraw[d]++;
+    uint32_t base = 0;
+    for(size_t d=0; d<draws.size(); d++) {
+      draws[d].baseInstance = base;
+      base += perDraw[d];
+    }
+    if (count) glNamedBufferSubData(objectDraw, 0, count * sizeof(uint32_t), ids.data());
+
+    // unchanged draws get the same buffers back from the pool
+    size_t size = draws.size() * sizeof(DrawArraysIndirectCommand);
+    GlPool().Recycle(templates);
+    GlPool().Recycle(commands);
+    GlPool().Recycle(drawBounds);
+    templates = GlPool().AcquireBuffer(MEM_CULLING, size, draws.data());
+    commands = GlPool().AcquireBuffer(MEM_CULLING, size, draws.data());
+    drawBounds = GlPool().AcquireBuffer(MEM_CULLING, bounds.size() * sizeof(float), bounds.data());
+  }
+
+  GLsizei DrawCount() const { return draws.size(); }
+
+  // Culls against vp using the current region of `instances`. Call after
+  // the instance records of this frame have been written.
+  void Cull(mat4x4 vp, InstanceBuffer& instances) {
+    Dispatch(vp, instances);
+    // commands are read as indirect arguments, visible as a vertex attribute
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  }
+
+  // Cull without the barrier before drawing, for a FrameGraph pass. The
+  // counters are read back here, so their barrier and fence stay.
+  void Dispatch(mat4x4 vp, InstanceBuffer& instances) {
+    slot = (slot + 1) % Copies;
+    if (fences[slot]) {
+      glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, ~0ull);
+      fences[slot].Reset();
+    }
+
+    glCopyNamedBufferSubData(templates, commands, 0, 0, draws.size() * sizeof(DrawArraysIndirectCommand));
+    glClearNamedBufferSubData(counters, GL_R32UI, slot * counterStride, sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+    vec4 planes[6];
+    frustum_planes(planes, vp);
+
+    GlState().UseProgram(program);
+    glUniform4fv(planesLoc, 6, (const GLfloat*)planes);
+    glUniform1ui(countLoc, objectCount);
+    instances.Bind(0);
+    GlState().BindStorageBuffer(1, visible);
+    GlState().BindStorageBuffer(2, objectDraw);
+    GlState().BindStorageBuffer(3, drawBounds);
+    GlState().BindStorageBuffer(4, commands);
+    GlState().BindStorageBufferRange(5, counters, slot * counterStride, sizeof(uint32_t));
+    glDispatchCompute((objectCount + 63) / 64, 1, 1);
+
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    fences[slot].Reset(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    slotObjects[slot] = objectCount;
+  }
+
+  // Counters of the newest Cull the GPU has completed
+  CullStats Stats() {
+    for(int i=0; i<Copies; i++) {
+      int s = (slot + Copies - i) % Copies;
+      if (!fences[s]) continue;
+      GLenum r = glClientWaitSync(fences[s], 0, 0);
+      if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED) continue;
+      stats.objects = slotObjects[s];
+      stats.visible = counterMap[s * counterStride / sizeof(uint32_t)];
+      stats.culled = stats.objects - stats.visible;
+      break;
+    }
+    return stats;
+  }
+};
+
+const char* GpuCuller::src = R"(
+#version 430 core
+layout(local_size_x = 64) in;
+struct Instance {
+  mat4 model;
+  vec4 color;
+  float timeOffset;
+};
+struct Command {
+  uint count;
+  uint instanceCount;
+  uint first;
+  uint baseInstance;
+};
+layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout(std430, binding = 1) writeonly buffer Visible { uint visible[]; };
+layout(std430, binding = 2) readonly buffer ObjectDraw { uint objectDraw[]; };
+layout(std430, binding = 3) readonly buffer DrawBounds { vec4 drawBounds[]; };
+layout(std430, binding = 4) buffer Commands { Command commands[]; };
+layout(std430, binding = 5) buffer Counters { uint visibleCount; };
+uniform vec4 planes[6];
+uniform uint objectCount;
+
+void main() {
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= objectCount) return;
+
+  uint draw = objectDraw[id];
+  vec4 sphere = drawBounds[draw];
+  mat4 m = instances[id].model;
+  vec3 center = (m * vec4(sphere.xyz, 1)).xyz;
+  float scale = max(max(dot(m[0].xyz, m[0].xyz), dot(m[1].xyz, m[1].xyz)), dot(m[2].xyz, m[2].xyz));
+  float radius = sphere.w * sqrt(scale);
+
+  for(int i=0; i<6; i++)
+    if (dot(planes[i].xyz, center) + planes[i].w < -radius) return;
+
+  uint slot = atomicAdd(commands[draw].instanceCount, 1u);
+  visible[commands[draw].baseInstance + slot] = id;
+  atomicAdd(visibleCount, 1u);
+}
+)";
@@ -0,0 +1,202 @@
+#include <string>
+#include <vector>
+
+// Per pixel image effects as GLSL snippets, chained and fused into as few
+// kernels as their inputs allow. A stage body is the inside of
+// `vec4 Effect(vec2 uv)` and reads its input with Input(uv); iTime and
+// texel (1 / image size) are there too. uv is in texture space, wrapped:
+// 0..1 across an image kernel, the quad's texCoord in a fragment kernel.
+//
+// A point stage reads its input once, at any uv, so it can run in the
+// kernel of the stage before it by calling it. A neighborhood stage reads
+// it several times; fused it would compute everything before it once per
+// tap, so it starts a kernel of its own reading the last one's output,
+// unless it is first and reads the chain's source anyway.
+enum EffectKind { EFFECT_POINT, EFFECT_NEIGHBORHOOD };
+
+struct EffectStage {
+  const char* name;
+  EffectKind kind;
+  const char* body;
+};
+
+// Color fringes, channels taken from the source shifted along a circle
+static inline EffectStage ChromaticStage() {
+  return { "chromatic", EFFECT_NEIGHBORHOOD, R"(
+    vec2 shift = vec2(sin(iTime), cos(iTime)) * 20 * texel;
+    return vec4(Input(uv).r, Input(uv + shift).g, Input(uv + 2 * shift).b, 1);
+  )" };
+}
+
+// BareShader's horizontal wobble
+static inline EffectStage WarpStage() {
+  return { "warp", EFFECT_POINT, R"(
+    return Input(vec2(uv.x + 0.05f * sin(uv.x * 10), uv.y));
+  )" };
+}
+
+static inline EffectStage VignetteStage() {
+  return { "vignette", EFFECT_POINT, R"(
+    vec4 c = Input(uv);
+    vec2 d = fract(uv) - 0.5;
+    return vec4(c.rgb * (1 - 1.5 * dot(d, d)), c.a);
+  )" };
+}
+
+// Film grain from the hash the old effect shader carried
+static inline EffectStage GrainStage() {
+  return { "grain", EFFECT_POINT, R"(
+    uvec2 p = uvec2(fract(uv) / texel);
+    uint seed = p.x + p.y * 2048u + uint(iTime * 60) * 4194304u;
+    seed = (seed ^ 61u) ^ (seed >> 16);
+    seed *= 9u;
+    seed = seed ^ (seed >> 4);
+    seed *= 0x27d4eb2du;
+    seed = seed ^ (seed >> 15);
+    vec4 c = Input(uv);
+    return vec4(c.rgb + (seed * (1.0 / 4294967296.0) - 0.5) * 0.08, c.a);
+  )" };
+}
+
+// 3x3 box blur
+static inline EffectStage BlurStage() {
+  return { "blur", EFFECT_NEIGHBORHOOD, R"(
+    vec4 sum = vec4(0);
+    for(int y=-1; y<=1; y++)
+      for(int x=-1; x<=1; x++) sum += Input(uv + vec2(x, y) * texel);
+    return sum / 9;
+  )" };
+}
+
+// Where the last kernel writes: a w x h image, or the fragments of a draw
+// with BareShader's vertex shader
+enum EffectTarget { EFFECT_TO_IMAGE, EFFECT_TO_FRAGMENT };
+
+// Stages run in order on a w x h source texture. Build() cuts them into
+// kernels, each stage its own with fuse off, and generates and links one
+// program per kernel. Kernels before the last write intermediates,
+// FrameGraph transients, read by the next one as a texture. Each image
+// kernel writes its own format, GL_RGBA32F, GL_RGBA16F, GL_RGBA8 or
+// GL_R11F_G11F_B10F, with the image qualifier generated to match: Build
+// gives all of them one, SetFormat changes a kernel's. rgba8 clamps to
+// 0..1 and r11f_g11f_b10f drops alpha, which reads back as 1.
+struct EffectChain {
+  struct Kernel {
+    size_t first, count; // stages
+    bool fragment;
+    GLenum format;       // of the image it writes
+    GlProgram program;
+    GLint iTime, texel, outSize, pulled;
+  };
+
+  std::vector<EffectStage> stages;
+  std::vector<Kernel> kernels;
+  GLsizei w = 0, h = 0;
+  EffectTarget target = EFFECT_TO_IMAGE;
+  bool fused = true;
+
+  void Add(const EffectStage& stage) { stages.push_back(stage); }
+
+  void Build(GLsizei w, GLsizei h, EffectTarget target, bool fuse = true, GLenum format = GL_RGBA32F) {
+    this->w = w;
+    this->h = h;
+    this->target = target;
+    fused = fuse;
+    kernels.clear();
+    for(size_t i=0; i<stages.size(); i++) {
+      bool split = kernels.empty() || !fuse || stages[i].kind == EFFECT_NEIGHBORHOOD;
+      if (split) kernels.push_back(Kernel{ i, 0, false, format, GlProgram(), -1, -1, -1, -1 });
+      kernels.back().count++;
+    }
+    for(size_t k=0; k<kernels.size(); k++) {
+      kernels[k].fragment = target == EFFECT_TO_FRAGMENT && k + 1 == kernels.size();
+      Link(kernels[k]);
+    }
+  }
+
+  // Image kernel k writes `format` from now on
+  void SetFormat(size_t k, GLenum format) {
+    if (kernels[k].fragment || kernels[k].format == format) return;
+    kernels[k].format = format;
+    Link(kernels[k]);
+  }
+
+  // Bytes of the intermediates, each written once and read at least once
+  size_t IntermediateBytes() const {
+    size_t bytes = 0;
+    for(size_t k=0; k+1<kernels.size(); k++) bytes += TextureBytes(kernels[k].format, w, h, 1);
+    return bytes;
+  }
+
+  // Declares a pass per image kernel on fg, the first reading `source`.
+  // Returns the output image, or with EFFECT_TO_FRAGMENT the texture the
+  // fragment kernel samples: the source itself if it is the only kernel.
+  FgResource AddPasses(FrameGraph& fg, FgResource source, float time) {
+    FgResource input = source;
+    for(size_t k=0; k<kernels.size(); k++) {
+      if (kernels[k].fragment) break;
+      FgResource output = fg.CreateTexture(stages[kernels[k].first].name, kernels[k].format, w, h);
+      fg.AddPass(stages[kernels[k].first].name, [this, &fg, k, input, output, time]() {
+        Dispatch(k, fg.Texture(input), fg.Texture(output), time);
+      }).Read(input, FG_SAMPLED).Write(output, FG_IMAGE);
+      input = output;
+    }
+    return input;
+  }
+
+  // Runs image kernel k from `input` into `output`, without a barrier
+  void Dispatch(size_t k, GLuint input, GLuint output, float time) {
+    Kernel& kernel = kernels[k];
+    GlState().UseProgram(kernel.program);
+    glUniform1f(kernel.iTime, time);
+    glUniform2f(kernel.texel, 1.0f / w, 1.0f / h);
+    glUniform2i(kernel.outSize, w, h);
+    GlState().BindTextureUnit(0, input);
+    GlState().BindImageTexture(1, output, 0, GL_WRITE_ONLY, kernel.format);
+    glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+  }
+
+  // Binds the fragment kernel sampling `input` for the caller's draw
+  void BindFragment(GLuint input, float time, bool pulled) {
+    Kernel& kernel = kernels.back();
+    GlState().UseProgram(kernel.program);
+    glUniform1f(kernel.iTime, time);
+    glUniform2f(kernel.texel, 1.0f / w, 1.0f / h);
+    glUniform1i(kernel.pulled, pulled);
+    GlState().BindTextureUnit(0, input);
+  }
+
+private:
+  void Link(Kernel& kernel) {
+    std::string src = Source(kernel);
+    const char* text = src.c_str();
+    if (kernel.fragment)
+      kernel.program = LinkProgram({ CompileShader(GL_VERTEX_SHADER, &BareShader::vs), CompileShader(GL_FRAGMENT_SHADER, &text) });
+    else
+      kernel.program = LinkProgram({ CompileShader(GL_COMPUTE_SHADER, &text) });
+    kernel.iTime = glGetUniformLocation(kernel.program, "iTime");
+    kernel.texel = glGetUniformLocation(kernel.program, "texel");
+    kernel.outSize = glGetUniformLocation(kernel.program, "outSize");
+    kernel.pulled = glGetUniformLocation(kernel.program, "pulled");
+  }
+
+  // One function per stage, Input of each the one before; the kernel's
+  // first stage reads the input texture
+  std::string Source(const Kernel& kernel) const {
+    std::string s = kernel.fragment ? "#version 430 core\n" : "#version 430 core\nlayout(local_size_x = 8, local_size_y = 8) in;\n";
+    s += "uniform float iTime;\nuniform vec2 texel;\nlayout(binding = 0) uniform sampler2D chainInput;\n";
+    s += "vec4 Stage0(vec2 uv) { return textureLod(chainInput, uv, 0); }\n";
+    for(size_t i=0; i<kernel.count; i++) {
+      std::string n = std::to_string(i + 1);
+      s += "// " + std::string(stages[kernel.first + i].name) + "\n";
+      s += "#define Input Stage" + std::to_string(i) + "\n";
+      s += "vec4 Stage" + n + "(vec2 uv) {" + stages[kernel.first + i].body + "}\n#undef Input\n";
+    }
+    std::string last = "Stage" + std::to_string(kernel.count);
+    if (kernel.fragment)
+      return s + "in vec2 texCoord;\nout vec4 color;\nvoid main() { color = " + last + "(texCoord); }\n";
+    return s + "layout(" + ImageFormatQualifier(kernel.format) + ", binding = 1) uniform writeonly image2D chainOutput;\nuniform ivec2 outSize;\n"
+      "void main() {\n  ivec2 c = ivec2(gl_GlobalInvocationID.xy);\n  if (any(greaterThanEqual(c, outSize))) return;\n"
+      "  imageStore(chainOutput, c, " + last + "((vec2(c) + 0.5) * texel));\n}\n";
+  }
+};
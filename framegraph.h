@@ -0,0 +1,355 @@
+#include <functional>
+#include <vector>
+#include <unordered_map>
+
+// How a pass touches a resource. A read decides which barrier bit makes an
+// earlier shader write visible to it: a buffer written as storage and read
+// as vertex attributes needs GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, not
+// GL_SHADER_STORAGE_BARRIER_BIT.
+enum FgAccess {
+  FG_STORAGE,        // shader storage buffer
+  FG_IMAGE,          // image load/store
+  FG_SAMPLED,        // texture fetch
+  FG_VERTEX,         // vertex attributes
+  FG_INDEX,          // element array
+  FG_INDIRECT,       // indirect draw or dispatch arguments
+  FG_UNIFORM,        // uniform buffer
+  FG_BUFFER_UPDATE,  // glNamedBufferSubData, copies, clears, readback
+  FG_TEXTURE_UPDATE, // glTextureSubImage, readback
+  FG_MAPPED,         // read through a persistent mapping
+  FG_FRAMEBUFFER,    // render target
+  FG_ACCESS_KINDS
+};
+
+static const GLbitfield fgBarrierBits[FG_ACCESS_KINDS] = {
+  GL_SHADER_STORAGE_BARRIER_BIT,
+  GL_SHADER_IMAGE_ACCESS_BARRIER_BIT,
+  GL_TEXTURE_FETCH_BARRIER_BIT,
+  GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT,
+  GL_ELEMENT_ARRAY_BARRIER_BIT,
+  GL_COMMAND_BARRIER_BIT,
+  GL_UNIFORM_BARRIER_BIT,
+  GL_BUFFER_UPDATE_BARRIER_BIT,
+  GL_TEXTURE_UPDATE_BARRIER_BIT,
+  GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT,
+  GL_FRAMEBUFFER_BARRIER_BIT,
+};
+
+// Only shader storage and image stores are incoherent; everything else GL
+// orders by itself
+static inline bool FgIncoherentWrite(FgAccess a) { return a == FG_STORAGE || a == FG_IMAGE; }
+
+typedef int FgResource;
+
+// One frame of passes in submission order. Each pass declares the
+// resources it reads and writes and how; Compile() then
+//  - culls passes none of whose writes reach a later live pass, an
+//    exported resource or a side effect (drawing to the window),
+//  - puts a glMemoryBarrier before a pass with exactly the bits its reads
+//    and writes of earlier shader writes need, each bit once per write,
+//  - gives transient resources GL objects, sharing one between transients
+//    of the same description whose live passes don't overlap.
+// The graph keeps the objects of its transients from one frame to the
+// next, a slot of the same description takes last frame's object again and
+// what no slot took goes back to GlPool(), so a graph built the same way
+// every frame allocates nothing and asks GL nothing after the first.
+// Textures sample linearly with repeat. Shader writes to imported
+// resources that nothing in the frame made visible carry over to the next
+// frame's graph, by GL name.
+struct FrameGraph {
+  struct Use {
+    FgResource resource;
+    FgAccess access;
+    bool write;
+  };
+  struct Pass {
+    const char* name;
+    std::function<void()> run;
+    std::vector<Use> uses;
+    bool sideEffect;
+    bool culled;
+    GLbitfield barrier;
+  };
+  struct TextureDesc {
+    GLenum format;
+    GLsizei w, h;
+  };
+  struct Resource {
+    const char* name;
+    bool texture;
+    bool imported;
+    bool exported;
+    GLuint object;       // imported, or the physical one
+    TextureDesc desc;    // transient textures
+    GLsizeiptr size;     // transient buffers
+    int physical;
+    int first, last;     // live passes using it
+  };
+  struct Physical {
+    bool texture;
+    TextureDesc desc;
+    GLsizeiptr size;
+    GlBuffer buffer;
+    GlTexture tex;
+  };
+  struct Stats {
+    uint32_t passes, culled;
+    uint32_t barriers;       // glMemoryBarrier calls
+    uint32_t transients;     // transient resources used
+    uint32_t physical;       // GL objects they got
+    size_t transientBytes;   // what they'd take unaliased
+    size_t physicalBytes;
+  };
+  // Pending shader writes of an imported resource
+  struct Hazard {
+    bool dirty;
+    GLbitfield visible; // bits issued since the write
+  };
+
+  // Returned by AddPass to declare what the pass touches
+  struct PassBuilder {
+    FrameGraph* graph;
+    int pass;
+    PassBuilder& Read(FgResource r, FgAccess access) { graph->passes[pass].uses.push_back({ r, access, false }); return *this; }
+    PassBuilder& Write(FgResource r, FgAccess access) { graph->passes[pass].uses.push_back({ r, access, true }); return *this; }
+    // Kept even if nothing reads what it writes
+    PassBuilder& SideEffect() { graph->passes[pass].sideEffect = true; return *this; }
+  };
+
+  std::vector<Pass> passes;
+  std::vector<Resource> resources;
+  std::vector<Physical> physical;
+  std::vector<Physical> retained; // last frame's objects
+  std::unordered_map<GLuint, Hazard> bufferHazards, textureHazards;
+  Stats stats = {};
+  bool compiled = false;
+
+  // Drops the passes and resources of the last frame
+  void Reset() {
+    passes.clear();
+    resources.clear();
+    physical.clear();
+    compiled = false;
+  }
+
+  FgResource ImportBuffer(const char* name, GLuint buffer) { return Import(name, buffer, false); }
+  FgResource ImportTexture(const char* name, GLuint texture) { return Import(name, texture, true); }
+
+  FgResource CreateBuffer(const char* name, GLsizeiptr size) {
+    Resource r = Resource();
+    r.name = name;
+    r.size = size;
+    return Add(r);
+  }
+
+  FgResource CreateTexture(const char* name, GLenum format, GLsizei w, GLsizei h) {
+    Resource r = Resource();
+    r.name = name;
+    r.texture = true;
+    r.desc = { format, w, h };
+    return Add(r);
+  }
+
+  // Its writers stay live even if no pass reads it
+  void Export(FgResource r) { resources[r].exported = true; }
+
+  PassBuilder AddPass(const char* name, std::function<void()> run) {
+    Pass p = Pass();
+    p.name = name;
+    p.run = std::move(run);
+    passes.push_back(std::move(p));
+    return PassBuilder{ this, (int)passes.size() - 1 };
+  }
+
+  // GL name of r, valid while the passes run
+  GLuint Buffer(FgResource r) const { return resources[r].object; }
+  GLuint Texture(FgResource r) const { return resources[r].object; }
+
+  void Compile() {
+    stats = Stats();
+    stats.passes = passes.size();
+    Cull();
+    Allocate();
+    PlaceBarriers();
+    compiled = true;
+  }
+
+  void Execute() {
+    if (!compiled) Compile();
+    Acquire();
+    for(Pass& p : passes) {
+      if (p.culled) continue;
+      if (p.barrier) glMemoryBarrier(p.barrier);
+      p.run();
+    }
+    retained = std::move(physical);
+    physical.clear();
+  }
+
+  // Hands the kept transient objects to GlPool()
+  void Release() {
+    for(Physical& ph : retained) {
+      if (ph.texture) GlPool().Recycle(ph.tex);
+      else GlPool().Recycle(ph.buffer);
+    }
+    retained.clear();
+  }
+
+  bool Culled(int pass) const { return passes[pass].culled; }
+  GLbitfield Barrier(int pass) const { return passes[pass].barrier; }
+  int Slot(FgResource r) const { return resources[r].physical; }
+
+private:
+  FgResource Import(const char* name, GLuint object, bool texture) {
+    Resource r = Resource();
+    r.name = name;
+    r.texture = texture;
+    r.imported = true;
+    r.object = object;
+    return Add(r);
+  }
+
+  FgResource Add(Resource& r) {
+    r.physical = -1;
+    r.first = r.last = -1;
+    resources.push_back(r);
+    return resources.size() - 1;
+  }
+
+  // Backwards from the end, a pass lives if it has a side effect or writes
+  // something needed later; what a live pass reads is needed before it.
+  // Writes are taken as partial, so a resource stays needed further back.
+  void Cull() {
+    std::vector<bool> needed(resources.size());
+    for(size_t r=0; r<resources.size(); r++) needed[r] = resources[r].exported;
+    for(int i=(int)passes.size() - 1; i>=0; i--) {
+      Pass& p = passes[i];
+      bool live = p.sideEffect;
+      for(const Use& u : p.uses) live = live || (u.write && needed[u.resource]);
+      p.culled = !live;
+      if (!live) {
+        stats.culled++;
+        continue;
+      }
+      for(const Use& u : p.uses)
+        if (!u.write) needed[u.resource] = true;
+    }
+  }
+
+  static size_t Bytes(const Resource& r) {
+    return r.texture ? TextureBytes(r.desc.format, r.desc.w, r.desc.h, 1) : (size_t)r.size;
+  }
+
+  // Lifetimes over the live passes, then a transient takes a free physical
+  // resource of its description at its first use and frees it after its last
+  void Allocate() {
+    for(size_t i=0; i<passes.size(); i++) {
+      if (passes[i].culled) continue;
+      for(const Use& u : passes[i].uses) {
+        Resource& r = resources[u.resource];
+        if (r.first < 0) r.first = i;
+        r.last = i;
+      }
+    }
+    std::vector<int> free;
+    for(size_t i=0; i<passes.size(); i++) {
+      if (passes[i].culled) continue;
+      for(const Use& u : passes[i].uses) {
+        Resource& r = resources[u.resource];
+        if (r.imported || r.first != (int)i || r.physical >= 0) continue;
+        stats.transients++;
+        stats.transientBytes += Bytes(r);
+        for(size_t f=0; f<free.size() && r.physical < 0; f++) {
+          Physical& ph = physical[free[f]];
+          if (ph.texture != r.texture) continue;
+          if (r.texture ? ph.desc.format != r.desc.format || ph.desc.w != r.desc.w || ph.desc.h != r.desc.h : ph.size != r.size) continue;
+          r.physical = free[f];
+          free.erase(free.begin() + f);
+        }
+        if (r.physical < 0) {
+          Physical ph;
+          ph.texture = r.texture;
+          ph.desc = r.desc;
+          ph.size = r.size;
+          physical.push_back(std::move(ph));
+          r.physical = physical.size() - 1;
+          stats.physicalBytes += Bytes(r);
+        }
+      }
+      for(size_t r=0; r<resources.size(); r++)
+        if (!resources[r].imported && resources[r].last == (int)i) free.push_back(resources[r].physical);
+    }
+    stats.physical = physical.size();
+  }
+
+  // A barrier goes in front of a pass that touches a resource with a shader
+  // write pending, with the bit of each such access not issued since that
+  // write. glMemoryBarrier covers all earlier writes, so its bits count as
+  // issued for every pending resource. Transients are never pending at
+  // their first use; imported resources pick up where the last frame ended.
+  void PlaceBarriers() {
+    std::vector<Hazard> state(resources.size());
+    for(size_t r=0; r<resources.size(); r++) {
+      const Resource& res = resources[r];
+      state[r] = Hazard{ false, 0 };
+      if (!res.imported) continue;
+      auto& hazards = res.texture ? textureHazards : bufferHazards;
+      auto it = hazards.find(res.object);
+      if (it != hazards.end()) state[r] = it->second;
+    }
+    for(Pass& p : passes) {
+      p.barrier = 0;
+      if (p.culled) continue;
+      for(const Use& u : p.uses) {
+        const Hazard& h = state[u.resource];
+        GLbitfield bit = fgBarrierBits[u.access];
+        if (h.dirty && !(h.visible & bit)) p.barrier |= bit;
+      }
+      if (p.barrier) {
+        stats.barriers++;
+        for(Hazard& h : state)
+          if (h.dirty) h.visible |= p.barrier;
+      }
+      for(const Use& u : p.uses)
+        if (u.write && FgIncoherentWrite(u.access)) state[u.resource] = Hazard{ true, 0 };
+    }
+    for(size_t r=0; r<resources.size(); r++) {
+      const Resource& res = resources[r];
+      if (!res.imported) continue;
+      auto& hazards = res.texture ? textureHazards : bufferHazards;
+      if (state[r].dirty) hazards[res.object] = state[r];
+      else hazards.erase(res.object);
+    }
+  }
+
+  static bool Same(const Physical& a, const Physical& b) {
+    if (a.texture != b.texture) return false;
+    if (!a.texture) return a.size == b.size;
+    return a.desc.format == b.desc.format && a.desc.w == b.desc.w && a.desc.h == b.desc.h;
+  }
+
+  void Acquire() {
+    for(Physical& ph : physical) {
+      for(size_t i=0; i<retained.size(); i++) {
+        if (!Same(ph, retained[i])) continue;
+        ph.tex = std::move(retained[i].tex);
+        ph.buffer = std::move(retained[i].buffer);
+        retained.erase(retained.begin() + i);
+        break;
+      }
+      if (ph.tex || ph.buffer) continue;
+      if (ph.texture) {
+        ph.tex = GlPool().AcquireTexture(MEM_TRANSIENT, ph.desc.format, ph.desc.w, ph.desc.h);
+        glTextureParameteri(ph.tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(ph.tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTextureParameteri(ph.tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(ph.tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      } else {
+        ph.buffer = GlPool().AcquireBuffer(MEM_TRANSIENT, ph.size);
+      }
+    }
+    Release();
+    for(Resource& r : resources)
+      if (!r.imported && r.physical >= 0) r.object = physical[r.physical].texture ? (GLuint)physical[r.physical].tex : (GLuint)physical[r.physical].buffer;
+  }
+};
@@ -0,0 +1,216 @@
+#include <map>
+#include <utility>
+
+// Move-only owner of a GL object, deleted with the handle or when another
+// one is moved or Reset() in. Converts to the raw name for GL calls. Kind
+// supplies the name type, and Delete, which goes through GlState() where
+// the object may be bound so its shadow doesn't outlive it. Objects of
+// globals are dropped without a call once the context is gone, it took
+// them along.
+template<typename Kind>
+struct GlHandle {
+  typedef typename Kind::Name Name;
+  Name name = Name();
+
+  GlHandle() {}
+  explicit GlHandle(Name name) : name(name) {}
+  GlHandle(GlHandle&& other) : name(other.name) { other.name = Name(); }
+  GlHandle& operator=(GlHandle&& other) {
+    if (this != &other) Reset(other.Release());
+    return *this;
+  }
+  GlHandle(const GlHandle&) = delete;
+  GlHandle& operator=(const GlHandle&) = delete;
+  ~GlHandle() { Reset(); }
+
+  operator Name() const { return name; }
+
+  void Reset(Name replacement = Name()) {
+    if (name && glfwGetCurrentContext()) Kind::Delete(name);
+    name = replacement;
+  }
+
+  // Gives up ownership without deleting
+  Name Release() {
+    Name n = name;
+    name = Name();
+    return n;
+  }
+};
+
+struct GlBufferKind {
+  typedef GLuint Name;
+  static void Delete(GLuint n) {
+    GpuMem().RemoveBuffer(n);
+    GlState().DeleteBuffers(1, &n);
+  }
+};
+struct GlTextureKind {
+  typedef GLuint Name;
+  static void Delete(GLuint n) {
+    GpuMem().RemoveTexture(n);
+    GlState().DeleteTextures(1, &n);
+  }
+};
+struct GlVertexArrayKind {
+  typedef GLuint Name;
+  static void Delete(GLuint n) { GlState().DeleteVertexArrays(1, &n); }
+};
+struct GlFramebufferKind {
+  typedef GLuint Name;
+  static void Delete(GLuint n) { glDeleteFramebuffers(1, &n); }
+};
+struct GlProgramKind {
+  typedef GLuint Name;
+  static void Delete(GLuint n) { GlState().DeleteProgram(n); }
+};
+struct GlFenceKind {
+  typedef GLsync Name;
+  static void Delete(GLsync n) { glDeleteSync(n); }
+};
+
+typedef GlHandle<GlBufferKind> GlBuffer;
+typedef GlHandle<GlTextureKind> GlTexture;
+typedef GlHandle<GlVertexArrayKind> GlVertexArray;
+typedef GlHandle<GlFramebufferKind> GlFramebuffer;
+typedef GlHandle<GlProgramKind> GlProgram;
+typedef GlHandle<GlFenceKind> GlFence;
+
+// Immutable storage; `flags` as for glNamedBufferStorage. Both are
+// accounted to `owner` in GpuMem() and throw if its budget rejects them.
+inline GlBuffer CreateBuffer(GpuMemOwner owner, GLsizeiptr size, const void* data, GLbitfield flags) {
+  GpuMem().Reserve(owner, size);
+  GLuint n;
+  glCreateBuffers(1, &n);
+  glNamedBufferStorage(n, size, data, flags);
+  GpuMem().AddBuffer(n, owner, size);
+  return GlBuffer(n);
+}
+
+inline GlTexture CreateTexture2D(GpuMemOwner owner, GLenum format, GLsizei w, GLsizei h, GLsizei levels = 1) {
+  size_t bytes = TextureBytes(format, w, h, levels);
+  GpuMem().Reserve(owner, bytes);
+  GLuint n;
+  glCreateTextures(GL_TEXTURE_2D, 1, &n);
+  glTextureStorage2D(n, levels, format, w, h);
+  GpuMem().AddTexture(n, owner, bytes);
+  return GlTexture(n);
+}
+
+inline GlVertexArray CreateVertexArray() {
+  GLuint n;
+  glCreateVertexArrays(1, &n);
+  return GlVertexArray(n);
+}
+
+inline GlFramebuffer CreateFramebuffer() {
+  GLuint n;
+  glCreateFramebuffers(1, &n);
+  return GlFramebuffer(n);
+}
+
+// Free lists of buffers and 2D textures by exact size, so resources that
+// are dropped and made again at the same size (a mesh initialized again,
+// per frame streams, culling commands after the object set changed) keep
+// their driver memory. Pool buffers have immutable storage with only
+// GL_DYNAMIC_STORAGE_BIT, so a recycled one can be filled again with
+// glNamedBufferSubData; its old contents are left in place otherwise. A
+// recycled texture keeps the sampler parameters of its last user. Recycle
+// asks GL for the size, so it takes anything of that kind, and deletes
+// what it can't hand out again. Free resources are accounted to
+// MEM_POOL_FREE, acquired ones to their new owner.
+struct GlResourcePool {
+  struct TextureDesc {
+    GLenum format;
+    GLsizei w, h, levels;
+    bool operator<(const TextureDesc& o) const {
+      if (format != o.format) return format < o.format;
+      if (w != o.w) return w < o.w;
+      if (h != o.h) return h < o.h;
+      return levels < o.levels;
+    }
+  };
+  struct Counters {
+    uint32_t created;
+    uint32_t reused;
+  };
+
+  Counters buffers = { 0, 0 };
+  Counters textures = { 0, 0 };
+
+  std::multimap<GLsizeiptr, GlBuffer> freeBuffers;
+  std::multimap<TextureDesc, GlTexture> freeTextures;
+
+  GlBuffer AcquireBuffer(GpuMemOwner owner, GLsizeiptr size, const void* data = nullptr) {
+    auto it = freeBuffers.find(size);
+    if (it == freeBuffers.end()) {
+      buffers.created++;
+      return CreateBuffer(owner, size, data, GL_DYNAMIC_STORAGE_BIT);
+    }
+    GpuMem().MoveBuffer(it->second, owner);
+    buffers.reused++;
+    GlBuffer b = std::move(it->second);
+    freeBuffers.erase(it);
+    if (data) glNamedBufferSubData(b, 0, size, data);
+    return b;
+  }
+
+  GlTexture AcquireTexture(GpuMemOwner owner, GLenum format, GLsizei w, GLsizei h, GLsizei levels = 1) {
+    TextureDesc desc = { format, w, h, levels };
+    auto it = freeTextures.find(desc);
+    if (it == freeTextures.end()) {
+      textures.created++;
+      return CreateTexture2D(owner, format, w, h, levels);
+    }
+    GpuMem().MoveTexture(it->second, owner);
+    textures.reused++;
+    GlTexture t = std::move(it->second);
+    freeTextures.erase(it);
+    return t;
+  }
+
+  // Takes b back, leaving it empty
+  void Recycle(GlBuffer& b) {
+    if (!b) return;
+    GLint immutable = 0, flags = 0;
+    GLint64 size = 0;
+    glGetNamedBufferParameteriv(b, GL_BUFFER_IMMUTABLE_STORAGE, &immutable);
+    glGetNamedBufferParameteriv(b, GL_BUFFER_STORAGE_FLAGS, &flags);
+    glGetNamedBufferParameteri64v(b, GL_BUFFER_SIZE, &size);
+    if (immutable && flags == GL_DYNAMIC_STORAGE_BIT) {
+      GpuMem().MoveBuffer(b, MEM_POOL_FREE);
+      freeBuffers.emplace(size, std::move(b));
+    } else {
+      b.Reset();
+    }
+  }
+
+  void Recycle(GlTexture& t) {
+    if (!t) return;
+    GLint target = 0, immutable = 0, levels = 0, format = 0, w = 0, h = 0;
+    glGetTextureParameteriv(t, GL_TEXTURE_TARGET, &target);
+    glGetTextureParameteriv(t, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+    glGetTextureParameteriv(t, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+    glGetTextureLevelParameteriv(t, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glGetTextureLevelParameteriv(t, 0, GL_TEXTURE_WIDTH, &w);
+    glGetTextureLevelParameteriv(t, 0, GL_TEXTURE_HEIGHT, &h);
+    TextureDesc desc = { (GLenum)format, w, h, levels };
+    if (target == GL_TEXTURE_2D && immutable) {
+      GpuMem().MoveTexture(t, MEM_POOL_FREE);
+      freeTextures.emplace(desc, std::move(t));
+    } else {
+      t.Reset();
+    }
+  }
+
+  // Deletes everything on the free lists
+  void Trim() {
+    freeBuffers.clear();
+    freeTextures.clear();
+  }
+};
+
+inline GlResourcePool& GlPool() {
+  static GlResourcePool pool;
+  return pool;
+}
@@ -0,0 +1,187 @@
+#include <stdint.h>
+
+// Shadow of the GL bindings the draw paths set every frame: program, vertex
+// array, texture and image units, storage buffer bindings, the draw
+// indirect buffer, the viewport and primitive restart. A call only reaches GL when it changes
+// the binding; either way it is counted as issued or elided, per frame.
+// Everything binding these has to go through here or the shadow goes
+// stale, and objects are deleted through Delete* so a recycled name never
+// looks bound already. Invalidate() forgets the shadow after code that
+// bypassed it. With `enabled` off every call is issued, for comparisons.
+struct GlStateCache {
+  static const int TextureUnits = 16;
+  static const int ImageUnits = 8;
+  static const int StorageBindings = 16;
+  static const GLuint Unknown = 0xffffffffu;
+
+  struct ImageBinding {
+    GLuint texture;
+    GLint level;
+    GLenum access;
+    GLenum format;
+  };
+  struct BufferRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size; // 0 for the whole buffer
+  };
+  struct Counters {
+    uint32_t issued;
+    uint32_t elided;
+  };
+
+  bool enabled = true;
+  Counters frame = { 0, 0 };
+  Counters last = { 0, 0 }; // the frame before the last EndFrame
+
+  GLuint program;
+  GLuint vao;
+  GLuint indirect;
+  GLuint textures[TextureUnits];
+  ImageBinding images[ImageUnits];
+  BufferRange storage[StorageBindings];
+  GLint viewport[4];
+  int primitiveRestart; // GL_PRIMITIVE_RESTART_FIXED_INDEX, -1 unknown
+
+  GlStateCache() { Invalidate(); }
+
+  void Invalidate() {
+    program = vao = indirect = Unknown;
+    for(int i=0; i<TextureUnits; i++) textures[i] = Unknown;
+    for(int i=0; i<ImageUnits; i++) images[i].texture = Unknown;
+    for(int i=0; i<StorageBindings; i++) storage[i].buffer = Unknown;
+    viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+    primitiveRestart = -1;
+  }
+
+  void EndFrame() {
+    last = frame;
+    frame.issued = frame.elided = 0;
+  }
+
+  void UseProgram(GLuint p) {
+    if (Changed(program != p)) {
+      glUseProgram(p);
+      program = p;
+    }
+  }
+
+  void BindVertexArray(GLuint v) {
+    if (Changed(vao != v)) {
+      glBindVertexArray(v);
+      vao = v;
+    }
+  }
+
+  void BindTextureUnit(GLuint unit, GLuint texture) {
+    if (unit >= TextureUnits) return glBindTextureUnit(unit, texture);
+    if (Changed(textures[unit] != texture)) {
+      glBindTextureUnit(unit, texture);
+      textures[unit] = texture;
+    }
+  }
+
+  // Level `level` of a 2D texture, not layered
+  void BindImageTexture(GLuint unit, GLuint texture, GLint level, GLenum access, GLenum format) {
+    if (unit >= ImageUnits) return glBindImageTexture(unit, texture, level, GL_FALSE, 0, access, format);
+    ImageBinding& b = images[unit];
+    if (Changed(b.texture != texture || b.level != level || b.access != access || b.format != format)) {
+      glBindImageTexture(unit, texture, level, GL_FALSE, 0, access, format);
+      b = { texture, level, access, format };
+    }
+  }
+
+  void BindStorageBuffer(GLuint binding, GLuint buffer) {
+    BindStorageBufferRange(binding, buffer, 0, 0);
+  }
+
+  // size 0 binds the whole buffer
+  void BindStorageBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    if (binding < StorageBindings) {
+      BufferRange& b = storage[binding];
+      if (!Changed(b.buffer != buffer || b.offset != offset || b.size != size)) return;
+      b = { buffer, offset, size };
+    }
+    if (size) glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, offset, size);
+    else glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+  }
+
+  void BindIndirectBuffer(GLuint buffer) {
+    if (Changed(indirect != buffer)) {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+      indirect = buffer;
+    }
+  }
+
+  void Viewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+    if (Changed(viewport[0] != x || viewport[1] != y || viewport[2] != w || viewport[3] != h)) {
+      glViewport(x, y, w, h);
+      viewport[0] = x;
+      viewport[1] = y;
+      viewport[2] = w;
+      viewport[3] = h;
+    }
+  }
+
+  // Only GL_PRIMITIVE_RESTART_FIXED_INDEX is shadowed, other caps are
+  // passed through and counted as issued
+  void Enable(GLenum cap) { SetCap(cap, true); }
+  void Disable(GLenum cap) { SetCap(cap, false); }
+
+  // GL unbinds deleted objects from the current context, so do the shadow
+  void DeleteBuffers(GLsizei n, const GLuint* names) {
+    for(GLsizei i=0; i<n; i++) {
+      for(int b=0; b<StorageBindings; b++)
+        if (storage[b].buffer == names[i]) storage[b] = { 0, 0, 0 };
+      if (indirect == names[i]) indirect = 0;
+    }
+    glDeleteBuffers(n, names);
+  }
+
+  void DeleteVertexArrays(GLsizei n, const GLuint* names) {
+    for(GLsizei i=0; i<n; i++)
+      if (vao == names[i]) vao = 0;
+    glDeleteVertexArrays(n, names);
+  }
+
+  void DeleteTextures(GLsizei n, const GLuint* names) {
+    for(GLsizei i=0; i<n; i++) {
+      for(int u=0; u<TextureUnits; u++)
+        if (textures[u] == names[i]) textures[u] = 0;
+      for(int u=0; u<ImageUnits; u++)
+        if (images[u].texture == names[i]) images[u].texture = 0;
+    }
+    glDeleteTextures(n, names);
+  }
+
+  // a deleted program stays current until replaced, GL must see the next
+  // UseProgram even if it gets the same name
+  void DeleteProgram(GLuint p) {
+    if (program == p) program = Unknown;
+    glDeleteProgram(p);
+  }
+
+private:
+  void SetCap(GLenum cap, bool on) {
+    int* shadow = cap == GL_PRIMITIVE_RESTART_FIXED_INDEX ? &primitiveRestart : nullptr;
+    if (shadow ? Changed(*shadow != on) : Changed(true)) {
+      if (on) glEnable(cap);
+      else glDisable(cap);
+      if (shadow) *shadow = on;
+    }
+  }
+
+  bool Changed(bool differs) {
+    if (!enabled || differs) {
+      frame.issued++;
+      return true;
+    }
+    frame.elided++;
+    return false;
+  }
+};
+
+inline GlStateCache& GlState() {
+  static GlStateCache state;
+  return state;
+}
@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdexcept>
+#include <unordered_map>
+
+// Subsystems GPU memory is accounted to
+enum GpuMemOwner {
+  MEM_INSTANCES,   // InstanceBuffer
+  MEM_MESH,        // VertexMesh
+  MEM_VERTEX_POOL, // VertexPool
+  MEM_QUAD,        // Quad's texture and vertices
+  MEM_EFFECTS,     // compute effect outputs
+  MEM_CULLING,     // GpuCuller
+  MEM_TERRAIN,     // heightfield and terrain geometry
+  MEM_TRANSIENT,   // FrameGraph transients
+  MEM_POOL_FREE,   // GlPool() free lists
+  MEM_OTHER,
+  MEM_OWNERS
+};
+
+enum GpuBudgetPolicy { BUDGET_WARN, BUDGET_REJECT };
+
+static const char* gpuMemOwnerNames[MEM_OWNERS] = {
+  "instances", "mesh", "vertexpool", "quad", "effects", "culling", "terrain", "transient", "poolfree", "other"
+};
+
+// Bytes per texel of the formats textures are created with
+static inline size_t TextureFormatBytes(GLenum format) {
+  switch (format) {
+    case GL_RGBA32F: return 16;
+    case GL_RGBA16F: return 8;
+    case GL_RGBA8: case GL_R32F: case GL_R11F_G11F_B10F: case GL_DEPTH_COMPONENT24: return 4;
+    case GL_R16: case GL_R16F: return 2;
+    case GL_R8: return 1;
+    default: return 16;
+  }
+}
+
+// All levels of a 2D texture
+static inline size_t TextureBytes(GLenum format, GLsizei w, GLsizei h, GLsizei levels) {
+  size_t texels = 0;
+  for(GLsizei l=0; l<levels; l++) {
+    size_t lw = w >> l, lh = h >> l;
+    texels += (lw ? lw : 1) * (lh ? lh : 1);
+  }
+  return texels * TextureFormatBytes(format);
+}
+
+// Every buffer and texture the resource layer creates, by name, with its
+// owner and size, and the live totals of each owner. A budget caps an
+// owner's total: over it, BUDGET_WARN logs once until the owner is back
+// under, BUDGET_REJECT throws before anything is allocated. Budgets come
+// from GPU_MEM_BUDGETS, e.g. "mesh=64M,quad=16M:reject", and with
+// GPU_MEM_REPORT=seconds Tick() logs a report that often.
+struct GpuMemory {
+  struct Allocation {
+    GpuMemOwner owner;
+    size_t bytes;
+  };
+  struct Budget {
+    size_t bytes; // 0 for none
+    GpuBudgetPolicy policy;
+    bool warned;
+  };
+
+  std::unordered_map<GLuint, Allocation> buffers, textures;
+  size_t live[MEM_OWNERS] = {};
+  size_t peak[MEM_OWNERS] = {};
+  uint32_t objects[MEM_OWNERS] = {};
+  Budget budgets[MEM_OWNERS] = {};
+  double reportInterval = 0;
+  double lastReport = 0;
+
+  GpuMemory() {
+    const char* e = getenv("GPU_MEM_BUDGETS");
+    if (e) ParseBudgets(e);
+    e = getenv("GPU_MEM_REPORT");
+    if (e) reportInterval = atof(e);
+  }
+
+  void SetBudget(GpuMemOwner owner, size_t bytes, GpuBudgetPolicy policy = BUDGET_WARN) {
+    budgets[owner] = { bytes, policy, false };
+  }
+
+  // Comma separated owner=size[K|M|G][:warn|:reject]
+  void ParseBudgets(const char* spec) {
+    while (*spec) {
+      const char* end = strchr(spec, ',');
+      if (!end) end = spec + strlen(spec);
+      const char* eq = (const char*)memchr(spec, '=', end - spec);
+      if (eq) {
+        char* unit;
+        double bytes = strtod(eq + 1, &unit);
+        if (*unit == 'K' || *unit == 'k') bytes *= 1 << 10;
+        if (*unit == 'M' || *unit == 'm') bytes *= 1 << 20;
+        if (*unit == 'G' || *unit == 'g') bytes *= 1 << 30;
+        const char* colon = (const char*)memchr(eq, ':', end - eq);
+        GpuBudgetPolicy policy = colon && !strncmp(colon + 1, "reject", 6) ? BUDGET_REJECT : BUDGET_WARN;
+        for(int o=0; o<MEM_OWNERS; o++)
+          if (strlen(gpuMemOwnerNames[o]) == (size_t)(eq - spec) && !strncmp(spec, gpuMemOwnerNames[o], eq - spec))
+            SetBudget((GpuMemOwner)o, (size_t)bytes, policy);
+      }
+      spec = *end ? end + 1 : end;
+    }
+  }
+
+  // Throws if `bytes` more would break a rejecting budget of owner
+  void Reserve(GpuMemOwner owner, size_t bytes) {
+    Budget& b = budgets[owner];
+    if (!b.bytes || live[owner] + bytes <= b.bytes) return;
+    if (b.policy == BUDGET_REJECT) {
+      GlobalLog().Printf("gpu memory: %s rejected %zu bytes, %zu of %zu in use", gpuMemOwnerNames[owner], bytes, live[owner], b.bytes);
+      throw std::runtime_error("GpuMemory: over budget");
+    }
+    if (!b.warned) GlobalLog().Printf("gpu memory: %s over budget, %zu of %zu bytes", gpuMemOwnerNames[owner], live[owner] + bytes, b.bytes);
+    b.warned = true;
+  }
+
+  void AddBuffer(GLuint name, GpuMemOwner owner, size_t bytes) { Add(buffers, name, owner, bytes); }
+  void AddTexture(GLuint name, GpuMemOwner owner, size_t bytes) { Add(textures, name, owner, bytes); }
+  void RemoveBuffer(GLuint name) { Remove(buffers, name); }
+  void RemoveTexture(GLuint name) { Remove(textures, name); }
+
+  // Hands an allocation to another owner, checking its budget
+  void MoveBuffer(GLuint name, GpuMemOwner owner) { Move(buffers, name, owner); }
+  void MoveTexture(GLuint name, GpuMemOwner owner) { Move(textures, name, owner); }
+
+  size_t Live(GpuMemOwner owner) const { return live[owner]; }
+
+  size_t Total() const {
+    size_t total = 0;
+    for(int o=0; o<MEM_OWNERS; o++) total += live[o];
+    return total;
+  }
+
+  void Report() {
+    GlobalLog().Printf("gpu memory: %.2f MB in %zu buffers, %zu textures", Total() / 1048576.0, buffers.size(), textures.size());
+    for(int o=0; o<MEM_OWNERS; o++) {
+      if (!live[o] && !peak[o]) continue;
+      if (budgets[o].bytes)
+        GlobalLog().Printf("  %-10s %9.2f MB  peak %9.2f MB  %4u objects  budget %.2f MB", gpuMemOwnerNames[o], live[o] / 1048576.0, peak[o] / 1048576.0, objects[o], budgets[o].bytes / 1048576.0);
+      else
+        GlobalLog().Printf("  %-10s %9.2f MB  peak %9.2f MB  %4u objects", gpuMemOwnerNames[o], live[o] / 1048576.0, peak[o] / 1048576.0, objects[o]);
+    }
+  }
+
+  // Reports every reportInterval seconds, if set
+  void Tick(double now) {
+    if (reportInterval <= 0 || now - lastReport < reportInterval) return;
+    lastReport = now;
+    Report();
+  }
+
+private:
+  void Add(std::unordered_map<GLuint, Allocation>& map, GLuint name, GpuMemOwner owner, size_t bytes) {
+    map[name] = { owner, bytes };
+    Charge(owner, bytes, 1);
+  }
+
+  void Remove(std::unordered_map<GLuint, Allocation>& map, GLuint name) {
+    auto it = map.find(name);
+    if (it == map.end()) return;
+    Charge(it->second.owner, -(ptrdiff_t)it->second.bytes, -1);
+    map.erase(it);
+  }
+
+  void Move(std::unordered_map<GLuint, Allocation>& map, GLuint name, GpuMemOwner owner) {
+    auto it = map.find(name);
+    if (it == map.end() || it->second.owner == owner) return;
+    Reserve(owner, it->second.bytes);
+    Charge(it->second.owner, -(ptrdiff_t)it->second.bytes, -1);
+    Charge(owner, it->second.bytes, 1);
+    it->second.owner = owner;
+  }
+
+  void Charge(GpuMemOwner owner, ptrdiff_t bytes, int count) {
+    live[owner] += bytes;
+    objects[owner] += count;
+    if (live[owner] > peak[owner]) peak[owner] = live[owner];
+    Budget& b = budgets[owner];
+    if (b.warned && live[owner] <= b.bytes) b.warned = false;
+  }
+};
+
+inline GpuMemory& GpuMem() {
+  static GpuMemory memory;
+  return memory;
+}
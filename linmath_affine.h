@@ -0,0 +1,273 @@
+#ifndef LINMATH_AFFINE_H
+#define LINMATH_AFFINE_H
+
+#include "linmath.h"
+
+/*
+  Affine and rigid transforms. Everything main.c builds (rotations,
+  translations, ortho) keeps the last row of the mat4x4 at (0, 0, 0, 1), so
+  that row doesn't need storing or multiplying:
+
+    mat3x4  column-major 3x3 linear part plus a translation column,
+            A[0..2] are the basis vectors and A[3] the translation
+    rigid   unit quaternion rotation plus translation, no scale or shear
+
+  Composition costs 36 (mat3x4) or 31 (rigid) multiplies instead of 64, the
+  orthonormal and rigid inverses are a transpose or conjugate instead of the
+  full cofactor expansion of mat4x4_invert.
+
+  Like linmath.h, outputs may alias inputs and matrices are column-major.
+*/
+
+#ifdef LINMATH_H_ROW_MAJOR
+	#error "linmath_affine.h only supports the column-major layout"
+#endif
+
+typedef vec3 mat3x4[4];
+
+typedef struct {
+	quat q;
+	vec3 t;
+} rigid;
+
+////////////////////////////////////////////////////////////////////////////////
+// mat3x4
+////////////////////////////////////////////////////////////////////////////////
+
+static inline void mat3x4_identity(mat3x4 A)
+{
+	for(int i=0; i<4; ++i)
+		for(int j=0; j<3; ++j)
+			A[i][j] = (i==j) ? 1.f : 0.f;
+}
+static inline void mat3x4_dup(mat3x4 A, mat3x4 B)
+{
+	for(int i=0; i<4; ++i)
+		vec3_dup(A[i], B[i]);
+}
+/* drops the last row, M must be affine */
+static inline void mat3x4_from_mat4x4(mat3x4 A, mat4x4 M)
+{
+	for(int i=0; i<4; ++i)
+		for(int j=0; j<3; ++j)
+			A[i][j] = M[i][j];
+}
+static inline void mat4x4_from_mat3x4(mat4x4 M, mat3x4 A)
+{
+	for(int i=0; i<4; ++i) {
+		for(int j=0; j<3; ++j)
+			M[i][j] = A[i][j];
+		M[i][3] = (i==3) ? 1.f : 0.f;
+	}
+}
+static inline void mat3x4_translate(mat3x4 A, float x, float y, float z)
+{
+	mat3x4_identity(A);
+	A[3][0] = x;
+	A[3][1] = y;
+	A[3][2] = z;
+}
+static inline void mat3x4_mul(mat3x4 R, mat3x4 a, mat3x4 b)
+{
+	float b00 = b[0][0], b01 = b[0][1], b02 = b[0][2];
+	float b10 = b[1][0], b11 = b[1][1], b12 = b[1][2];
+	float b20 = b[2][0], b21 = b[2][1], b22 = b[2][2];
+	float b30 = b[3][0], b31 = b[3][1], b32 = b[3][2];
+	for(int r=0; r<3; ++r) {
+		float a0 = a[0][r], a1 = a[1][r], a2 = a[2][r], a3 = a[3][r];
+		R[0][r] = a0*b00 + a1*b01 + a2*b02;
+		R[1][r] = a0*b10 + a1*b11 + a2*b12;
+		R[2][r] = a0*b20 + a1*b21 + a2*b22;
+		R[3][r] = a0*b30 + a1*b31 + a2*b32 + a3;
+	}
+}
+static inline void mat3x4_mul_point(vec3 r, mat3x4 A, vec3 p)
+{
+	vec3 t;
+	for(int j=0; j<3; ++j)
+		t[j] = A[0][j]*p[0] + A[1][j]*p[1] + A[2][j]*p[2] + A[3][j];
+	vec3_dup(r, t);
+}
+static inline void mat3x4_mul_dir(vec3 r, mat3x4 A, vec3 d)
+{
+	vec3 t;
+	for(int j=0; j<3; ++j)
+		t[j] = A[0][j]*d[0] + A[1][j]*d[1] + A[2][j]*d[2];
+	vec3_dup(r, t);
+}
+static inline void mat3x4_rotate_X(mat3x4 Q, mat3x4 A, float angle)
+{
+	float s = sinf(angle);
+	float c = cosf(angle);
+	vec3 a1, a2;
+	vec3_dup(a1, A[1]);
+	vec3_dup(a2, A[2]);
+	for(int j=0; j<3; ++j) {
+		Q[0][j] = A[0][j];
+		Q[1][j] = a1[j]*c + a2[j]*s;
+		Q[2][j] = a2[j]*c - a1[j]*s;
+		Q[3][j] = A[3][j];
+	}
+}
+static inline void mat3x4_rotate_Z(mat3x4 Q, mat3x4 A, float angle)
+{
+	float s = sinf(angle);
+	float c = cosf(angle);
+	vec3 a0, a1;
+	vec3_dup(a0, A[0]);
+	vec3_dup(a1, A[1]);
+	for(int j=0; j<3; ++j) {
+		Q[0][j] = a0[j]*c + a1[j]*s;
+		Q[1][j] = a1[j]*c - a0[j]*s;
+		Q[2][j] = A[2][j];
+		Q[3][j] = A[3][j];
+	}
+}
+/* general affine inverse: 3x3 cofactor inverse, t' = -L^-1 t */
+static inline void mat3x4_invert(mat3x4 T, mat3x4 A)
+{
+	float r00 = A[1][1]*A[2][2] - A[2][1]*A[1][2];
+	float r01 = A[2][1]*A[0][2] - A[0][1]*A[2][2];
+	float r02 = A[0][1]*A[1][2] - A[1][1]*A[0][2];
+	float r10 = A[2][0]*A[1][2] - A[1][0]*A[2][2];
+	float r11 = A[0][0]*A[2][2] - A[2][0]*A[0][2];
+	float r12 = A[1][0]*A[0][2] - A[0][0]*A[1][2];
+	float r20 = A[1][0]*A[2][1] - A[2][0]*A[1][1];
+	float r21 = A[2][0]*A[0][1] - A[0][0]*A[2][1];
+	float r22 = A[0][0]*A[1][1] - A[1][0]*A[0][1];
+
+	/* Assumes it is invertible */
+	float idet = 1.f / (A[0][0]*r00 + A[1][0]*r01 + A[2][0]*r02);
+	float x = A[3][0], y = A[3][1], z = A[3][2];
+
+	T[0][0] = r00*idet; T[0][1] = r01*idet; T[0][2] = r02*idet;
+	T[1][0] = r10*idet; T[1][1] = r11*idet; T[1][2] = r12*idet;
+	T[2][0] = r20*idet; T[2][1] = r21*idet; T[2][2] = r22*idet;
+	T[3][0] = -(T[0][0]*x + T[1][0]*y + T[2][0]*z);
+	T[3][1] = -(T[0][1]*x + T[1][1]*y + T[2][1]*z);
+	T[3][2] = -(T[0][2]*x + T[1][2]*y + T[2][2]*z);
+}
+/* inverse when the linear part is a pure rotation: transpose it */
+static inline void mat3x4_invert_orthonormal(mat3x4 T, mat3x4 A)
+{
+	float a01 = A[0][1], a02 = A[0][2], a12 = A[1][2];
+	float x = A[3][0], y = A[3][1], z = A[3][2];
+
+	T[0][0] = A[0][0]; T[0][1] = A[1][0]; T[0][2] = A[2][0];
+	T[1][0] = a01;     T[1][1] = A[1][1]; T[1][2] = A[2][1];
+	T[2][0] = a02;     T[2][1] = a12;     T[2][2] = A[2][2];
+	T[3][0] = -(T[0][0]*x + T[1][0]*y + T[2][0]*z);
+	T[3][1] = -(T[0][1]*x + T[1][1]*y + T[2][1]*z);
+	T[3][2] = -(T[0][2]*x + T[1][2]*y + T[2][2]*z);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// rigid
+////////////////////////////////////////////////////////////////////////////////
+
+static inline void rigid_identity(rigid* r)
+{
+	quat_identity(r->q);
+	r->t[0] = r->t[1] = r->t[2] = 0.f;
+}
+static inline void rigid_mul_point(vec3 r, rigid const* a, vec3 p)
+{
+	/* quat_mul_vec3 written out: t = 2 q.xyz x p, r = p + w t + q.xyz x t */
+	float qx = a->q[0], qy = a->q[1], qz = a->q[2], qw = a->q[3];
+	float px = p[0], py = p[1], pz = p[2];
+	float tx = 2.f * (qy*pz - qz*py);
+	float ty = 2.f * (qz*px - qx*pz);
+	float tz = 2.f * (qx*py - qy*px);
+	r[0] = px + qw*tx + (qy*tz - qz*ty) + a->t[0];
+	r[1] = py + qw*ty + (qz*tx - qx*tz) + a->t[1];
+	r[2] = pz + qw*tz + (qx*ty - qy*tx) + a->t[2];
+}
+/* r = a * b, apply b first */
+static inline void rigid_mul(rigid* r, rigid const* a, rigid const* b)
+{
+	vec3 t;
+	rigid_mul_point(t, a, (float*)b->t);
+
+	float ax = a->q[0], ay = a->q[1], az = a->q[2], aw = a->q[3];
+	float bx = b->q[0], by = b->q[1], bz = b->q[2], bw = b->q[3];
+	r->q[0] = ay*bz - az*by + ax*bw + bx*aw;
+	r->q[1] = az*bx - ax*bz + ay*bw + by*aw;
+	r->q[2] = ax*by - ay*bx + az*bw + bz*aw;
+	r->q[3] = aw*bw - (ax*bx + ay*by + az*bz);
+	vec3_dup(r->t, t);
+}
+static inline void rigid_invert(rigid* r, rigid const* a)
+{
+	rigid c;
+	c.q[0] = -a->q[0];
+	c.q[1] = -a->q[1];
+	c.q[2] = -a->q[2];
+	c.q[3] =  a->q[3];
+	c.t[0] = c.t[1] = c.t[2] = 0.f;
+	vec3 t;
+	rigid_mul_point(t, &c, (float*)a->t);
+	vec4_dup(r->q, c.q);
+	vec3_scale(r->t, t, -1.f);
+}
+static inline void rigid_rotate(rigid* r, rigid const* a, float x, float y, float z, float angle)
+{
+	quat q, p;
+	vec3 axis = { x, y, z };
+	vec3_norm(axis, axis);
+	quat_rotate(q, angle, axis);
+	quat_mul(p, (float*)a->q, q);
+	vec4_dup(r->q, p);
+	vec3_dup(r->t, (float*)a->t);
+}
+static inline void mat3x4_from_rigid(mat3x4 A, rigid const* r)
+{
+	mat4x4 M;
+	mat4x4_from_quat(M, (float*)r->q);
+	for(int i=0; i<3; ++i)
+		for(int j=0; j<3; ++j)
+			A[i][j] = M[i][j];
+	vec3_dup(A[3], (float*)r->t);
+}
+static inline void mat4x4_from_rigid(mat4x4 M, rigid const* r)
+{
+	mat4x4_from_quat(M, (float*)r->q);
+	for(int j=0; j<3; ++j)
+		M[3][j] = r->t[j];
+}
+/* M must be a rotation plus translation, any scale ends up in the quaternion norm */
+static inline void rigid_from_mat4x4(rigid* r, mat4x4 M)
+{
+	/* Shepperd's method, picks the largest of w, x, y, z to divide by */
+	float tr = M[0][0] + M[1][1] + M[2][2];
+	quat q;
+	if (tr > 0.f) {
+		float s = sqrtf(tr + 1.f) * 2.f;
+		q[3] = 0.25f * s;
+		q[0] = (M[1][2] - M[2][1]) / s;
+		q[1] = (M[2][0] - M[0][2]) / s;
+		q[2] = (M[0][1] - M[1][0]) / s;
+	} else if (M[0][0] > M[1][1] && M[0][0] > M[2][2]) {
+		float s = sqrtf(1.f + M[0][0] - M[1][1] - M[2][2]) * 2.f;
+		q[3] = (M[1][2] - M[2][1]) / s;
+		q[0] = 0.25f * s;
+		q[1] = (M[1][0] + M[0][1]) / s;
+		q[2] = (M[2][0] + M[0][2]) / s;
+	} else if (M[1][1] > M[2][2]) {
+		float s = sqrtf(1.f + M[1][1] - M[0][0] - M[2][2]) * 2.f;
+		q[3] = (M[2][0] - M[0][2]) / s;
+		q[0] = (M[1][0] + M[0][1]) / s;
+		q[1] = 0.25f * s;
+		q[2] = (M[2][1] + M[1][2]) / s;
+	} else {
+		float s = sqrtf(1.f + M[2][2] - M[0][0] - M[1][1]) * 2.f;
+		q[3] = (M[0][1] - M[1][0]) / s;
+		q[0] = (M[2][0] + M[0][2]) / s;
+		q[1] = (M[2][1] + M[1][2]) / s;
+		q[2] = 0.25f * s;
+	}
+	vec4_dup(r->q, q);
+	for(int j=0; j<3; ++j)
+		r->t[j] = M[3][j];
+}
+
+#endif // LINMATH_AFFINE_H
@@ -0,0 +1,180 @@
+#ifndef LINMATH_BATCH_H
+#define LINMATH_BATCH_H
+
+#include <stddef.h>
+#include "linmath.h"
+
+/*
+  Batch versions of the vec3 helpers working on arrays in SoA layout, one
+  array per component. The AVX2 path handles 8 elements per iteration and is
+  picked at runtime, the remainder (and cpus without AVX2) use the scalar
+  loop. Only mul/add/sub/sqrt/div are used, no FMA, so both paths give the
+  same results as the per-element linmath.h calls.
+
+  Outputs may alias inputs.
+*/
+
+typedef struct {
+	float* x;
+	float* y;
+	float* z;
+} vec3_soa;
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define LINMATH_H_BATCH_AVX2 1
+	#include <immintrin.h>
+#endif
+
+static inline void vec3_soa_transform_points_scalar(vec3_soa r, mat4x4 M, vec3_soa p, size_t b, size_t n)
+{
+	for(size_t i=b; i<n; ++i) {
+		float x = p.x[i], y = p.y[i], z = p.z[i];
+		r.x[i] = M[0][0]*x + M[1][0]*y + M[2][0]*z + M[3][0];
+		r.y[i] = M[0][1]*x + M[1][1]*y + M[2][1]*z + M[3][1];
+		r.z[i] = M[0][2]*x + M[1][2]*y + M[2][2]*z + M[3][2];
+	}
+}
+static inline void vec3_soa_norm_scalar(vec3_soa r, vec3_soa v, size_t b, size_t n)
+{
+	for(size_t i=b; i<n; ++i) {
+		float x = v.x[i], y = v.y[i], z = v.z[i];
+		float k = 1.f / sqrtf(x*x + y*y + z*z);
+		r.x[i] = x * k;
+		r.y[i] = y * k;
+		r.z[i] = z * k;
+	}
+}
+static inline void vec3_soa_tri_normals_scalar(vec3_soa r, vec3_soa p1, vec3_soa p2, vec3_soa p3, size_t b, size_t n)
+{
+	for(size_t i=b; i<n; ++i) {
+		float ax = p1.x[i] - p2.x[i], ay = p1.y[i] - p2.y[i], az = p1.z[i] - p2.z[i];
+		float bx = p3.x[i] - p2.x[i], by = p3.y[i] - p2.y[i], bz = p3.z[i] - p2.z[i];
+		float cx = ay*bz - az*by;
+		float cy = az*bx - ax*bz;
+		float cz = ax*by - ay*bx;
+		float k = 1.f / sqrtf(cx*cx + cy*cy + cz*cz);
+		r.x[i] = cx * k;
+		r.y[i] = cy * k;
+		r.z[i] = cz * k;
+	}
+}
+
+#ifdef LINMATH_H_BATCH_AVX2
+
+static inline int __lh_has_avx2(void)
+{
+	static int has = -1;
+	if (has < 0) {
+		__builtin_cpu_init();
+		has = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return has;
+}
+
+__attribute__((target("avx2")))
+static inline void vec3_soa_transform_points_avx2(vec3_soa r, mat4x4 M, vec3_soa p, size_t n)
+{
+	__m256 m[4][3];
+	for(int c=0; c<4; ++c)
+		for(int k=0; k<3; ++k)
+			m[c][k] = _mm256_set1_ps(M[c][k]);
+
+	size_t i = 0, end = n & ~(size_t)7;
+	for(; i<end; i+=8) {
+		__m256 x = _mm256_loadu_ps(p.x + i);
+		__m256 y = _mm256_loadu_ps(p.y + i);
+		__m256 z = _mm256_loadu_ps(p.z + i);
+		__m256 o[3];
+		for(int k=0; k<3; ++k) {
+			__m256 t = _mm256_mul_ps(m[0][k], x);
+			t = _mm256_add_ps(t, _mm256_mul_ps(m[1][k], y));
+			t = _mm256_add_ps(t, _mm256_mul_ps(m[2][k], z));
+			o[k] = _mm256_add_ps(t, m[3][k]);
+		}
+		_mm256_storeu_ps(r.x + i, o[0]);
+		_mm256_storeu_ps(r.y + i, o[1]);
+		_mm256_storeu_ps(r.z + i, o[2]);
+	}
+	vec3_soa_transform_points_scalar(r, M, p, i, n);
+}
+
+__attribute__((target("avx2")))
+static inline void __lh_norm8(vec3_soa r, size_t i, __m256 x, __m256 y, __m256 z)
+{
+	__m256 l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+	__m256 k = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(l2));
+	_mm256_storeu_ps(r.x + i, _mm256_mul_ps(x, k));
+	_mm256_storeu_ps(r.y + i, _mm256_mul_ps(y, k));
+	_mm256_storeu_ps(r.z + i, _mm256_mul_ps(z, k));
+}
+
+__attribute__((target("avx2")))
+static inline void vec3_soa_norm_avx2(vec3_soa r, vec3_soa v, size_t n)
+{
+	size_t i = 0, end = n & ~(size_t)7;
+	for(; i<end; i+=8)
+		__lh_norm8(r, i, _mm256_loadu_ps(v.x + i), _mm256_loadu_ps(v.y + i), _mm256_loadu_ps(v.z + i));
+	vec3_soa_norm_scalar(r, v, i, n);
+}
+
+__attribute__((target("avx2")))
+static inline void vec3_soa_tri_normals_avx2(vec3_soa r, vec3_soa p1, vec3_soa p2, vec3_soa p3, size_t n)
+{
+	size_t i = 0, end = n & ~(size_t)7;
+	for(; i<end; i+=8) {
+		__m256 x2 = _mm256_loadu_ps(p2.x + i);
+		__m256 y2 = _mm256_loadu_ps(p2.y + i);
+		__m256 z2 = _mm256_loadu_ps(p2.z + i);
+		__m256 ax = _mm256_sub_ps(_mm256_loadu_ps(p1.x + i), x2);
+		__m256 ay = _mm256_sub_ps(_mm256_loadu_ps(p1.y + i), y2);
+		__m256 az = _mm256_sub_ps(_mm256_loadu_ps(p1.z + i), z2);
+		__m256 bx = _mm256_sub_ps(_mm256_loadu_ps(p3.x + i), x2);
+		__m256 by = _mm256_sub_ps(_mm256_loadu_ps(p3.y + i), y2);
+		__m256 bz = _mm256_sub_ps(_mm256_loadu_ps(p3.z + i), z2);
+		__m256 cx = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by));
+		__m256 cy = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz));
+		__m256 cz = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+		__lh_norm8(r, i, cx, cy, cz);
+	}
+	vec3_soa_tri_normals_scalar(r, p1, p2, p3, i, n);
+}
+
+#endif // LINMATH_H_BATCH_AVX2
+
+/* r[i] = M * (p[i], 1), the w component is dropped */
+static inline void vec3_soa_transform_points(vec3_soa r, mat4x4 M, vec3_soa p, size_t n)
+{
+#ifdef LINMATH_H_BATCH_AVX2
+	if (__lh_has_avx2()) {
+		vec3_soa_transform_points_avx2(r, M, p, n);
+		return;
+	}
+#endif
+	vec3_soa_transform_points_scalar(r, M, p, 0, n);
+}
+
+/* r[i] = v[i] / |v[i]| */
+static inline void vec3_soa_norm(vec3_soa r, vec3_soa v, size_t n)
+{
+#ifdef LINMATH_H_BATCH_AVX2
+	if (__lh_has_avx2()) {
+		vec3_soa_norm_avx2(r, v, n);
+		return;
+	}
+#endif
+	vec3_soa_norm_scalar(r, v, 0, n);
+}
+
+/* r[i] = norm(cross(p1[i] - p2[i], p3[i] - p2[i])) */
+static inline void vec3_soa_tri_normals(vec3_soa r, vec3_soa p1, vec3_soa p2, vec3_soa p3, size_t n)
+{
+#ifdef LINMATH_H_BATCH_AVX2
+	if (__lh_has_avx2()) {
+		vec3_soa_tri_normals_avx2(r, p1, p2, p3, n);
+		return;
+	}
+#endif
+	vec3_soa_tri_normals_scalar(r, p1, p2, p3, 0, n);
+}
+
+#endif // LINMATH_BATCH_H
@@ -0,0 +1,284 @@
+#ifndef LINMATH_CONSTEXPR_H
+#define LINMATH_CONSTEXPR_H
+
+#include "linmath.h"
+
+/*
+  constexpr value types mirroring linmath.h, so transforms that don't change
+  at runtime are folded by the compiler into constants:
+
+    constexpr cx::mat4 tilt = cx::rotate_X(cx::identity(), 2.2f);
+    mat4x4 m;
+    tilt.store(m);
+
+  Matrices are column-major like linmath.h (c[col].v[row]) and the products
+  accumulate in the same order, so results match the runtime functions up to
+  the last bit of sin/cos.
+*/
+
+#ifdef LINMATH_H_ROW_MAJOR
+	#error "linmath_constexpr.h only supports the column-major layout"
+#endif
+
+namespace cx {
+
+constexpr double pi = 3.14159265358979323846;
+
+/* reduce to [-pi, pi] so the series converges fast */
+constexpr double reduce_angle(double x)
+{
+	double k = x / (2.0 * pi);
+	long long n = (long long)(k + (k >= 0 ? 0.5 : -0.5));
+	return x - (double)n * 2.0 * pi;
+}
+constexpr double sin_d(double x)
+{
+	x = reduce_angle(x);
+	double x2 = x * x, term = x, sum = x;
+	for(int i=1; i<12; ++i) {
+		term *= -x2 / ((2*i) * (2*i + 1));
+		sum += term;
+	}
+	return sum;
+}
+constexpr double cos_d(double x)
+{
+	x = reduce_angle(x);
+	double x2 = x * x, term = 1.0, sum = 1.0;
+	for(int i=1; i<12; ++i) {
+		term *= -x2 / ((2*i - 1) * (2*i));
+		sum += term;
+	}
+	return sum;
+}
+constexpr double sqrt_d(double x)
+{
+	if (x <= 0.0) return 0.0;
+	double r = x > 1.0 ? x : 1.0;
+	for(int i=0; i<64; ++i) {
+		double n = 0.5 * (r + x / r);
+		if (n == r) break;
+		r = n;
+	}
+	return r;
+}
+
+constexpr float sin(float x) { return (float)sin_d(x); }
+constexpr float cos(float x) { return (float)cos_d(x); }
+constexpr float tan(float x) { return (float)(sin_d(x) / cos_d(x)); }
+constexpr float sqrt(float x) { return (float)sqrt_d(x); }
+constexpr float abs(float x) { return x < 0 ? -x : x; }
+
+constexpr bool near(float a, float b, float eps = 1e-6f)
+{
+	return abs(a - b) <= eps * (1.f + abs(a));
+}
+
+struct vec4 {
+	float v[4];
+
+	constexpr float operator[](int i) const { return v[i]; }
+	void store(::vec4 r) const
+	{
+		for(int i=0; i<4; ++i)
+			r[i] = v[i];
+	}
+};
+
+struct mat4 {
+	vec4 c[4];
+
+	constexpr float at(int col, int row) const { return c[col].v[row]; }
+	void store(mat4x4 M) const
+	{
+		for(int i=0; i<4; ++i)
+			for(int j=0; j<4; ++j)
+				M[i][j] = c[i].v[j];
+	}
+};
+
+constexpr bool near(const mat4& a, const mat4& b, float eps = 1e-6f)
+{
+	for(int i=0; i<4; ++i)
+		for(int j=0; j<4; ++j)
+			if (!near(a.at(i, j), b.at(i, j), eps))
+				return false;
+	return true;
+}
+
+constexpr vec4 vec4_scale(const vec4& v, float s)
+{
+	return {{ v[0]*s, v[1]*s, v[2]*s, v[3]*s }};
+}
+constexpr float vec4_mul_inner(const vec4& a, const vec4& b)
+{
+	float p = 0.f;
+	for(int i=0; i<4; ++i)
+		p += b[i] * a[i];
+	return p;
+}
+
+constexpr mat4 identity()
+{
+	return {{
+		{{ 1.f, 0.f, 0.f, 0.f }},
+		{{ 0.f, 1.f, 0.f, 0.f }},
+		{{ 0.f, 0.f, 1.f, 0.f }},
+		{{ 0.f, 0.f, 0.f, 1.f }}
+	}};
+}
+constexpr mat4 transpose(const mat4& N)
+{
+	mat4 M = {};
+	for(int j=0; j<4; ++j)
+		for(int i=0; i<4; ++i)
+			M.c[i].v[j] = N.c[j].v[i];
+	return M;
+}
+constexpr mat4 mul(const mat4& a, const mat4& b)
+{
+	mat4 M = {};
+	for(int c=0; c<4; ++c) for(int r=0; r<4; ++r) {
+		float s = 0.f;
+		for(int k=0; k<4; ++k)
+			s += a.c[k].v[r] * b.c[c].v[k];
+		M.c[c].v[r] = s;
+	}
+	return M;
+}
+constexpr mat4 operator*(const mat4& a, const mat4& b) { return mul(a, b); }
+
+constexpr vec4 mul_vec4(const mat4& M, const vec4& v)
+{
+	vec4 r = {};
+	for(int j=0; j<4; ++j) {
+		float s = 0.f;
+		for(int i=0; i<4; ++i)
+			s += M.c[i].v[j] * v[i];
+		r.v[j] = s;
+	}
+	return r;
+}
+constexpr vec4 operator*(const mat4& M, const vec4& v) { return mul_vec4(M, v); }
+
+constexpr mat4 translate(float x, float y, float z)
+{
+	mat4 T = identity();
+	T.c[3].v[0] = x;
+	T.c[3].v[1] = y;
+	T.c[3].v[2] = z;
+	return T;
+}
+constexpr mat4 scale_aniso(const mat4& a, float x, float y, float z)
+{
+	mat4 M = a;
+	for(int i=0; i<4; ++i) {
+		M.c[0].v[i] = a.c[0].v[i] * x;
+		M.c[1].v[i] = a.c[1].v[i] * y;
+		M.c[2].v[i] = a.c[2].v[i] * z;
+	}
+	return M;
+}
+constexpr mat4 rotate_X(const mat4& M, float angle)
+{
+	float s = sin(angle);
+	float c = cos(angle);
+	mat4 R = {{
+		{{ 1.f, 0.f, 0.f, 0.f }},
+		{{ 0.f,   c,   s, 0.f }},
+		{{ 0.f,  -s,   c, 0.f }},
+		{{ 0.f, 0.f, 0.f, 1.f }}
+	}};
+	return mul(M, R);
+}
+constexpr mat4 rotate_Y(const mat4& M, float angle)
+{
+	float s = sin(angle);
+	float c = cos(angle);
+	mat4 R = {{
+		{{   c, 0.f,   s, 0.f }},
+		{{ 0.f, 1.f, 0.f, 0.f }},
+		{{  -s, 0.f,   c, 0.f }},
+		{{ 0.f, 0.f, 0.f, 1.f }}
+	}};
+	return mul(M, R);
+}
+constexpr mat4 rotate_Z(const mat4& M, float angle)
+{
+	float s = sin(angle);
+	float c = cos(angle);
+	mat4 R = {{
+		{{   c,   s, 0.f, 0.f }},
+		{{  -s,   c, 0.f, 0.f }},
+		{{ 0.f, 0.f, 1.f, 0.f }},
+		{{ 0.f, 0.f, 0.f, 1.f }}
+	}};
+	return mul(M, R);
+}
+constexpr mat4 frustum(float l, float r, float b, float t, float n, float f)
+{
+	return {{
+		{{ 2.f*n / (r-l), 0.f, 0.f, 0.f }},
+		{{ 0.f, 2.f*n / (t-b), 0.f, 0.f }},
+		{{ (r+l) / (r-l), (t+b) / (t-b), -(f+n) / (f-n), -1.f }},
+		{{ 0.f, 0.f, -2.f * (f*n) / (f-n), 0.f }}
+	}};
+}
+constexpr mat4 ortho(float l, float r, float b, float t, float n, float f)
+{
+	return {{
+		{{ 2.f / (r-l), 0.f, 0.f, 0.f }},
+		{{ 0.f, 2.f / (t-b), 0.f, 0.f }},
+		{{ 0.f, 0.f, -2.f / (f-n), 0.f }},
+		{{ -(r+l) / (r-l), -(t+b) / (t-b), -(f+n) / (f-n), 1.f }}
+	}};
+}
+constexpr mat4 perspective(float y_fov, float aspect, float n, float f)
+{
+	float const a = 1.f / tan(y_fov / 2.f);
+	return {{
+		{{ a / aspect, 0.f, 0.f, 0.f }},
+		{{ 0.f, a, 0.f, 0.f }},
+		{{ 0.f, 0.f, -((f+n) / (f-n)), -1.f }},
+		{{ 0.f, 0.f, -((2.f*f*n) / (f-n)), 0.f }}
+	}};
+}
+constexpr mat4 look_at(const vec4& eye, const vec4& center, const vec4& up)
+{
+	float f[3] = { center[0]-eye[0], center[1]-eye[1], center[2]-eye[2] };
+	float fl = 1.f / sqrt(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+	for(int i=0; i<3; ++i) f[i] *= fl;
+
+	float s[3] = { f[1]*up[2] - f[2]*up[1], f[2]*up[0] - f[0]*up[2], f[0]*up[1] - f[1]*up[0] };
+	float sl = 1.f / sqrt(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+	for(int i=0; i<3; ++i) s[i] *= sl;
+
+	float t[3] = { s[1]*f[2] - s[2]*f[1], s[2]*f[0] - s[0]*f[2], s[0]*f[1] - s[1]*f[0] };
+
+	mat4 m = {{
+		{{ s[0], t[0], -f[0], 0.f }},
+		{{ s[1], t[1], -f[1], 0.f }},
+		{{ s[2], t[2], -f[2], 0.f }},
+		{{  0.f,  0.f,   0.f, 1.f }}
+	}};
+	/* translate_in_place by -eye */
+	for(int i=0; i<4; ++i) {
+		vec4 r = {{ m.c[0].v[i], m.c[1].v[i], m.c[2].v[i], m.c[3].v[i] }};
+		vec4 tr = {{ -eye[0], -eye[1], -eye[2], 0.f }};
+		m.c[3].v[i] += vec4_mul_inner(r, tr);
+	}
+	return m;
+}
+
+/* sanity checks of the compile-time math itself */
+static_assert(near(sin(0.f), 0.f), "cx::sin");
+static_assert(near(sin((float)(pi / 2)), 1.f), "cx::sin");
+static_assert(near(cos((float)pi), -1.f), "cx::cos");
+static_assert(near(sin(100.f), -0.50636564f, 1e-5f), "cx::sin range reduction");
+static_assert(near(sqrt(2.f), 1.41421356f), "cx::sqrt");
+static_assert(near(rotate_Z(rotate_Z(identity(), 0.7f), -0.7f), identity(), 1e-6f), "cx::rotate_Z");
+static_assert(near((ortho(-2.f, 2.f, -1.f, 1.f, 1.f, -1.f) * vec4{{ 2.f, 1.f, 0.f, 1.f }})[0], 1.f), "cx::ortho");
+
+} // namespace cx
+
+#endif // LINMATH_CONSTEXPR_H
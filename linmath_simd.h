@@ -0,0 +1,255 @@
+#ifndef LINMATH_SIMD_H
+#define LINMATH_SIMD_H
+
+#include "linmath.h"
+
+/*
+  SSE/AVX versions of the hot mat4x4 routines. Every function takes the same
+  arguments as its scalar counterpart in linmath.h (mat4x4_mul_simd for
+  mat4x4_mul and so on), so call sites can switch by renaming. Inputs and
+  outputs may alias, like in linmath.h.
+
+  mat4x4a / vec4a are the same layout as mat4x4 / vec4 but aligned, so they
+  can be passed to both the scalar and the SIMD functions. The SIMD code
+  uses unaligned loads and works on plain mat4x4 too, aligned storage just
+  keeps matrices from straddling cache lines.
+
+  Only the column-major layout is vectorized, with LINMATH_H_ROW_MAJOR (or
+  on non-x86 targets) the functions forward to the scalar ones.
+*/
+
+#ifdef _MSC_VER
+	#define LINMATH_H_ALIGN(n) __declspec(align(n))
+	typedef LINMATH_H_ALIGN(16) vec4 vec4a;
+	typedef LINMATH_H_ALIGN(32) vec4 mat4x4a[4];
+#else
+	#define LINMATH_H_ALIGN(n) __attribute__((aligned(n)))
+	typedef float vec4a[4] LINMATH_H_ALIGN(16);
+	typedef vec4 mat4x4a[4] LINMATH_H_ALIGN(32);
+#endif
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(LINMATH_H_ROW_MAJOR)
+	#define LINMATH_H_SIMD 1
+	#include <immintrin.h>
+#endif
+
+#ifdef LINMATH_H_SIMD
+
+#define __LH_SHUF(x,y,z,w) ((x) | ((y)<<2) | ((z)<<4) | ((w)<<6))
+#define __LH_SPLAT(v,i) _mm_shuffle_ps(v, v, __LH_SHUF(i,i,i,i))
+
+static inline __m128 __lh_mul_vec4(__m128 c0, __m128 c1, __m128 c2, __m128 c3, __m128 v)
+{
+	__m128 r = _mm_mul_ps(c0, __LH_SPLAT(v, 0));
+	r = _mm_add_ps(r, _mm_mul_ps(c1, __LH_SPLAT(v, 1)));
+	r = _mm_add_ps(r, _mm_mul_ps(c2, __LH_SPLAT(v, 2)));
+	r = _mm_add_ps(r, _mm_mul_ps(c3, __LH_SPLAT(v, 3)));
+	return r;
+}
+
+static inline void __lh_mat4x4_mul_sse(mat4x4 M, mat4x4 a, mat4x4 b)
+{
+	__m128 a0 = _mm_loadu_ps(a[0]), a1 = _mm_loadu_ps(a[1]);
+	__m128 a2 = _mm_loadu_ps(a[2]), a3 = _mm_loadu_ps(a[3]);
+	__m128 r0 = __lh_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[0]));
+	__m128 r1 = __lh_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[1]));
+	__m128 r2 = __lh_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[2]));
+	__m128 r3 = __lh_mul_vec4(a0, a1, a2, a3, _mm_loadu_ps(b[3]));
+	_mm_storeu_ps(M[0], r0);
+	_mm_storeu_ps(M[1], r1);
+	_mm_storeu_ps(M[2], r2);
+	_mm_storeu_ps(M[3], r3);
+}
+
+/* the AVX product is compiled with a target attribute and picked at run
+   time, unless the whole build targets AVX anyway */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define LINMATH_H_SIMD_AVX 1
+	#define __LH_TARGET_AVX __attribute__((target("avx")))
+#elif defined(__AVX__)
+	#define __LH_TARGET_AVX
+#endif
+
+#ifdef LINMATH_H_SIMD_AVX
+static inline int __lh_has_avx(void)
+{
+	static int has = -1;
+	if (has < 0) {
+		__builtin_cpu_init();
+		has = __builtin_cpu_supports("avx") ? 1 : 0;
+	}
+	return has;
+}
+#endif
+
+#ifdef __LH_TARGET_AVX
+__LH_TARGET_AVX
+static inline void __lh_mat4x4_mul_avx(mat4x4 M, mat4x4 a, mat4x4 b)
+{
+	/* two result columns per iteration, a's columns duplicated in both lanes */
+	__m256 a0 = _mm256_broadcast_ps((const __m128*)a[0]);
+	__m256 a1 = _mm256_broadcast_ps((const __m128*)a[1]);
+	__m256 a2 = _mm256_broadcast_ps((const __m128*)a[2]);
+	__m256 a3 = _mm256_broadcast_ps((const __m128*)a[3]);
+	__m256 b01 = _mm256_loadu_ps(b[0]);
+	__m256 b23 = _mm256_loadu_ps(b[2]);
+
+	__m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(a1, _mm256_shuffle_ps(b01, b01, 0x55)));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(a2, _mm256_shuffle_ps(b01, b01, 0xaa)));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(a3, _mm256_shuffle_ps(b01, b01, 0xff)));
+
+	__m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(a1, _mm256_shuffle_ps(b23, b23, 0x55)));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(a2, _mm256_shuffle_ps(b23, b23, 0xaa)));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(a3, _mm256_shuffle_ps(b23, b23, 0xff)));
+
+	_mm256_storeu_ps(M[0], r01);
+	_mm256_storeu_ps(M[2], r23);
+}
+#endif
+
+static inline void mat4x4_mul_simd(mat4x4 M, mat4x4 a, mat4x4 b)
+{
+#if defined(__AVX__)
+	__lh_mat4x4_mul_avx(M, a, b);
+#elif defined(LINMATH_H_SIMD_AVX)
+	if (__lh_has_avx())
+		__lh_mat4x4_mul_avx(M, a, b);
+	else
+		__lh_mat4x4_mul_sse(M, a, b);
+#else
+	__lh_mat4x4_mul_sse(M, a, b);
+#endif
+}
+static inline void mat4x4_mul_vec4_simd(vec4 r, mat4x4 M, vec4 v)
+{
+	__m128 x = __lh_mul_vec4(_mm_loadu_ps(M[0]), _mm_loadu_ps(M[1]),
+	                         _mm_loadu_ps(M[2]), _mm_loadu_ps(M[3]), _mm_loadu_ps(v));
+	_mm_storeu_ps(r, x);
+}
+static inline void mat4x4_transpose_simd(mat4x4 M, mat4x4 N)
+{
+	__m128 c0 = _mm_loadu_ps(N[0]), c1 = _mm_loadu_ps(N[1]);
+	__m128 c2 = _mm_loadu_ps(N[2]), c3 = _mm_loadu_ps(N[3]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_mm_storeu_ps(M[0], c0);
+	_mm_storeu_ps(M[1], c1);
+	_mm_storeu_ps(M[2], c2);
+	_mm_storeu_ps(M[3], c3);
+}
+
+/*
+  Block inverse: split M in four 2x2 matrices A B / C D, each held in one
+  register, and build the inverse from their adjugates and determinants.
+  Works unchanged on column-major data since inv(M^T) = inv(M)^T.
+*/
+static inline __m128 __lh_mat2_mul(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, __LH_SHUF(0,3,0,3))),
+	                  _mm_mul_ps(_mm_shuffle_ps(a, a, __LH_SHUF(1,0,3,2)), _mm_shuffle_ps(b, b, __LH_SHUF(2,1,2,1))));
+}
+static inline __m128 __lh_mat2_adj_mul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, __LH_SHUF(3,3,0,0)), b),
+	                  _mm_mul_ps(_mm_shuffle_ps(a, a, __LH_SHUF(1,1,2,2)), _mm_shuffle_ps(b, b, __LH_SHUF(2,3,0,1))));
+}
+static inline __m128 __lh_mat2_mul_adj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, __LH_SHUF(3,0,3,0))),
+	                  _mm_mul_ps(_mm_shuffle_ps(a, a, __LH_SHUF(1,0,3,2)), _mm_shuffle_ps(b, b, __LH_SHUF(2,1,2,1))));
+}
+static inline void mat4x4_invert_simd(mat4x4 T, mat4x4 M)
+{
+	__m128 m0 = _mm_loadu_ps(M[0]), m1 = _mm_loadu_ps(M[1]);
+	__m128 m2 = _mm_loadu_ps(M[2]), m3 = _mm_loadu_ps(M[3]);
+
+	__m128 A = _mm_movelh_ps(m0, m1);
+	__m128 B = _mm_movehl_ps(m1, m0);
+	__m128 C = _mm_movelh_ps(m2, m3);
+	__m128 D = _mm_movehl_ps(m3, m2);
+
+	/* (|A|, |B|, |C|, |D|) */
+	__m128 det = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(m0, m2, __LH_SHUF(0,2,0,2)), _mm_shuffle_ps(m1, m3, __LH_SHUF(1,3,1,3))),
+		_mm_mul_ps(_mm_shuffle_ps(m0, m2, __LH_SHUF(1,3,1,3)), _mm_shuffle_ps(m1, m3, __LH_SHUF(0,2,0,2))));
+	__m128 detA = __LH_SPLAT(det, 0);
+	__m128 detB = __LH_SPLAT(det, 1);
+	__m128 detC = __LH_SPLAT(det, 2);
+	__m128 detD = __LH_SPLAT(det, 3);
+
+	__m128 D_C = __lh_mat2_adj_mul(D, C);
+	__m128 A_B = __lh_mat2_adj_mul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), __lh_mat2_mul(B, D_C));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), __lh_mat2_mul(C, A_B));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), __lh_mat2_mul_adj(D, A_B));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), __lh_mat2_mul_adj(A, D_C));
+
+	/* |M| = |A||D| + |B||C| - tr((A#B)(D#C)) */
+	__m128 tr = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, __LH_SHUF(0,2,1,3)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, __LH_SHUF(2,3,0,1)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, __LH_SHUF(1,0,3,2)));
+	__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+	/* Assumes it is invertible */
+	__m128 idet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+	X = _mm_mul_ps(X, idet);
+	Y = _mm_mul_ps(Y, idet);
+	Z = _mm_mul_ps(Z, idet);
+	W = _mm_mul_ps(W, idet);
+
+	_mm_storeu_ps(T[0], _mm_shuffle_ps(X, Y, __LH_SHUF(3,1,3,1)));
+	_mm_storeu_ps(T[1], _mm_shuffle_ps(X, Y, __LH_SHUF(2,0,2,0)));
+	_mm_storeu_ps(T[2], _mm_shuffle_ps(Z, W, __LH_SHUF(3,1,3,1)));
+	_mm_storeu_ps(T[3], _mm_shuffle_ps(Z, W, __LH_SHUF(2,0,2,0)));
+}
+
+/*
+  The axis rotations only touch two columns of M, so instead of a full
+  product with the rotation matrix they blend those two columns.
+*/
+static inline void __lh_rotate_cols(mat4x4 Q, mat4x4 M, int i, int j, float angle)
+{
+	__m128 s = _mm_set1_ps(sinf(angle));
+	__m128 c = _mm_set1_ps(cosf(angle));
+	__m128 mi = _mm_loadu_ps(M[i]);
+	__m128 mj = _mm_loadu_ps(M[j]);
+	if (Q != M) {
+		for(int k=0; k<4; ++k)
+			if (k != i && k != j)
+				_mm_storeu_ps(Q[k], _mm_loadu_ps(M[k]));
+	}
+	_mm_storeu_ps(Q[i], _mm_add_ps(_mm_mul_ps(mi, c), _mm_mul_ps(mj, s)));
+	_mm_storeu_ps(Q[j], _mm_sub_ps(_mm_mul_ps(mj, c), _mm_mul_ps(mi, s)));
+}
+static inline void mat4x4_rotate_X_simd(mat4x4 Q, mat4x4 M, float angle)
+{
+	__lh_rotate_cols(Q, M, 1, 2, angle);
+}
+static inline void mat4x4_rotate_Y_simd(mat4x4 Q, mat4x4 M, float angle)
+{
+	/* column 0 picks up +s * column 2, column 2 picks up -s * column 0 */
+	__lh_rotate_cols(Q, M, 2, 0, -angle);
+}
+static inline void mat4x4_rotate_Z_simd(mat4x4 Q, mat4x4 M, float angle)
+{
+	__lh_rotate_cols(Q, M, 0, 1, angle);
+}
+
+#undef __LH_SHUF
+#undef __LH_SPLAT
+#undef __LH_TARGET_AVX
+
+#else // LINMATH_H_SIMD
+
+static inline void mat4x4_mul_simd(mat4x4 M, mat4x4 a, mat4x4 b) { mat4x4_mul(M, a, b); }
+static inline void mat4x4_mul_vec4_simd(vec4 r, mat4x4 M, vec4 v) { mat4x4_mul_vec4(r, M, v); }
+static inline void mat4x4_transpose_simd(mat4x4 M, mat4x4 N) { mat4x4_transpose(M, N); }
+static inline void mat4x4_invert_simd(mat4x4 T, mat4x4 M) { mat4x4_invert(T, M); }
+static inline void mat4x4_rotate_X_simd(mat4x4 Q, mat4x4 M, float angle) { mat4x4_rotate_X(Q, M, angle); }
+static inline void mat4x4_rotate_Y_simd(mat4x4 Q, mat4x4 M, float angle) { mat4x4_rotate_Y(Q, M, angle); }
+static inline void mat4x4_rotate_Z_simd(mat4x4 Q, mat4x4 M, float angle) { mat4x4_rotate_Z(Q, M, angle); }
+
+#endif // LINMATH_H_SIMD
+
+#endif // LINMATH_SIMD_H
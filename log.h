@@ -0,0 +1,334 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Fixed size message as it sits in the ring. id 0 marks application
+// messages, anything else is a GL debug message id.
+struct LogRecord {
+  double time;         // seconds on the steady clock
+  uint32_t id;
+  uint16_t source, type, severity;
+  uint16_t length;
+  char text[232];
+};
+static_assert(sizeof(LogRecord) == 256, "LogRecord should stay 256 bytes");
+
+// Bounded multi producer, single consumer ring (Vyukov). Every cell carries
+// a sequence number: pos when free for the producer claiming pos, pos + 1
+// once written. Push never blocks, it fails when the ring is full.
+template<size_t Capacity>
+struct LogRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "LogRing capacity must be a power of two");
+  struct Cell {
+    std::atomic<size_t> seq;
+    LogRecord record;
+  };
+  Cell cells[Capacity];
+  std::atomic<size_t> head{0}; // next slot to claim
+  size_t tail = 0;             // next slot to read, consumer only
+
+  LogRing() {
+    for(size_t i=0; i<Capacity; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  // fill(LogRecord&) writes the record in place
+  template<typename F>
+  bool Push(const F& fill) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    Cell* cell;
+    for(;;) {
+      cell = &cells[pos & (Capacity - 1)];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+    fill(cell->record);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(LogRecord& out) {
+    Cell& cell = cells[tail & (Capacity - 1)];
+    if (cell.seq.load(std::memory_order_acquire) != tail + 1) return false;
+    out = cell.record;
+    cell.seq.store(tail + Capacity, std::memory_order_release);
+    tail++;
+    return true;
+  }
+};
+
+// Log that never formats or writes on the calling thread. Callers (the GL
+// debug callback, input handlers) push a LogRecord into the ring; a
+// background thread formats and writes them. GL messages are rate limited
+// per id, at most `burst` per `window` seconds with the rest counted and
+// reported when the window closes, and a message identical to the previous
+// one is folded into a repeat count. Records that find the ring full are
+// dropped and counted.
+struct Logger {
+  static const size_t Capacity = 4096;
+
+  struct Stats {
+    uint64_t pushed, dropped, written, suppressed;
+  };
+
+  int burst = 5;
+  double window = 1.0;
+
+  LogRing<Capacity> ring;
+  std::atomic<uint64_t> pushed{0}, dropped{0};
+  std::atomic<uint64_t> written{0}, suppressed{0}; // consumer side, read by GetStats
+
+  FILE* out = nullptr;
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable wake, drained;
+  std::atomic<bool> sleeping{false};
+  bool quit = false;
+  uint64_t consumed = 0;
+
+  struct IdState {
+    double windowStart;
+    int printed;
+    uint32_t suppressed;
+  };
+  std::unordered_map<uint32_t, IdState> ids;
+  LogRecord last;
+  uint32_t repeats = 0;
+
+  Logger() { last.id = 0; last.length = 0; }
+  ~Logger() { Stop(); }
+
+  void Start(FILE* out) {
+    if (worker.joinable()) return;
+    this->out = out;
+    quit = false;
+    worker = std::thread([this]() { Run(); });
+  }
+
+  // Writes out everything pushed so far, then ends the thread
+  void Stop() {
+    if (!worker.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    wake.notify_one();
+    worker.join();
+  }
+
+  static double Now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  void Printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    Push([&](LogRecord& r) {
+      r.time = Now();
+      r.id = 0;
+      r.source = r.type = r.severity = 0;
+      int n = vsnprintf(r.text, sizeof(r.text), fmt, args);
+      r.length = n < 0 ? 0 : n < (int)sizeof(r.text) ? n : sizeof(r.text) - 1;
+    });
+    va_end(args);
+  }
+
+  void GlMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message) {
+    Push([&](LogRecord& r) {
+      r.time = Now();
+      r.id = id ? id : 0xffffffffu;
+      r.source = source;
+      r.type = type;
+      r.severity = severity;
+      size_t n = length >= 0 ? (size_t)length : strlen(message);
+      if (n > sizeof(r.text) - 1) n = sizeof(r.text) - 1;
+      memcpy(r.text, message, n);
+      r.text[n] = 0;
+      r.length = n;
+    });
+  }
+
+  // Blocks until the writer has handled everything pushed before the call
+  void Flush() {
+    if (!worker.joinable()) return;
+    uint64_t target = pushed.load();
+    wake.notify_one();
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [&]() { return consumed >= target; });
+  }
+
+  Stats GetStats() {
+    Stats s = { pushed.load(), dropped.load(), written.load(), suppressed.load() };
+    return s;
+  }
+
+private:
+  template<typename F>
+  void Push(const F& fill) {
+    if (!ring.Push(fill)) {
+      dropped++;
+      return;
+    }
+    pushed++;
+    if (sleeping.load(std::memory_order_relaxed)) wake.notify_one();
+  }
+
+  void Run() {
+    LogRecord r;
+    for(;;) {
+      bool any = false;
+      while (ring.Pop(r)) {
+        Handle(r);
+        any = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        consumed++;
+      }
+      if (any) fflush(out);
+      CloseWindows(Now(), false);
+
+      std::unique_lock<std::mutex> lock(mutex);
+      drained.notify_all();
+      if (quit && ring.head.load() == ring.tail) break;
+      // pushes don't take the mutex, so a wake up can be missed; the
+      // timeout bounds how late such a message gets written
+      sleeping = true;
+      wake.wait_for(lock, std::chrono::milliseconds(10));
+      sleeping = false;
+    }
+    FoldRepeats();
+    CloseWindows(0, true);
+    fflush(out);
+  }
+
+  void Handle(const LogRecord& r) {
+    if (r.id) {
+      if (r.id == last.id && r.length == last.length && !memcmp(r.text, last.text, r.length)) {
+        repeats++;
+        suppressed++;
+        return;
+      }
+      IdState& s = ids.emplace(r.id, IdState{ r.time, 0, 0 }).first->second;
+      if (r.time - s.windowStart >= window) {
+        ReportSuppressed(r.id, s);
+        s.windowStart = r.time;
+        s.printed = 0;
+      }
+      if (s.printed >= burst) {
+        s.suppressed++;
+        suppressed++;
+        return;
+      }
+      s.printed++;
+    }
+    FoldRepeats();
+    Write(r);
+    last = r;
+  }
+
+  void FoldRepeats() {
+    if (!repeats) return;
+    fprintf(out, "GL %u: last message repeated %u times\n", last.id, repeats);
+    written++;
+    repeats = 0;
+  }
+
+  void ReportSuppressed(uint32_t id, IdState& s) {
+    if (!s.suppressed) return;
+    FoldRepeats();
+    fprintf(out, "GL %u: %u more messages suppressed\n", id, s.suppressed);
+    written++;
+    s.suppressed = 0;
+  }
+
+  // Reports windows that ended by `now`, or all of them
+  void CloseWindows(double now, bool all) {
+    for(auto& e : ids)
+      if (e.second.suppressed && (all || now - e.second.windowStart >= window)) ReportSuppressed(e.first, e.second);
+  }
+
+  void Write(const LogRecord& r) {
+    written++;
+    if (!r.id) {
+      fprintf(out, "%s\n", r.text);
+      return;
+    }
+    fprintf(out, "GL %u [%s %s %s]: %s\n", r.id, SourceName(r.source), TypeName(r.type), SeverityName(r.severity), r.text);
+  }
+
+  static const char* SourceName(GLenum source) {
+    switch (source) {
+      case GL_DEBUG_SOURCE_API:             return "API";
+      case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "Window System";
+      case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
+      case GL_DEBUG_SOURCE_THIRD_PARTY:     return "Third Party";
+      case GL_DEBUG_SOURCE_APPLICATION:     return "Application";
+      default:                              return "Other";
+    }
+  }
+
+  static const char* TypeName(GLenum type) {
+    switch (type) {
+      case GL_DEBUG_TYPE_ERROR:               return "Error";
+      case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "Deprecated Behaviour";
+      case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "Undefined Behaviour";
+      case GL_DEBUG_TYPE_PORTABILITY:         return "Portability";
+      case GL_DEBUG_TYPE_PERFORMANCE:         return "Performance";
+      case GL_DEBUG_TYPE_MARKER:              return "Marker";
+      case GL_DEBUG_TYPE_PUSH_GROUP:          return "Push Group";
+      case GL_DEBUG_TYPE_POP_GROUP:           return "Pop Group";
+      default:                                return "Other";
+    }
+  }
+
+  static const char* SeverityName(GLenum severity) {
+    switch (severity) {
+      case GL_DEBUG_SEVERITY_HIGH:         return "high";
+      case GL_DEBUG_SEVERITY_MEDIUM:       return "medium";
+      case GL_DEBUG_SEVERITY_LOW:          return "low";
+      case GL_DEBUG_SEVERITY_NOTIFICATION: return "notification";
+      default:                             return "unknown";
+    }
+  }
+};
+
+inline Logger& GlobalLog() {
+  static Logger log;
+  return log;
+}
+
+// How the GL debug output reaches the log. GL_LOG=sync|async|off in the
+// environment overrides the build default: async, or off with NDEBUG.
+enum GlLogMode { GL_LOG_OFF, GL_LOG_ASYNC, GL_LOG_SYNC };
+
+inline GlLogMode GlLogModeFromEnv() {
+#ifdef NDEBUG
+  GlLogMode mode = GL_LOG_OFF;
+#else
+  GlLogMode mode = GL_LOG_ASYNC;
+#endif
+  const char* e = getenv("GL_LOG");
+  if (e && !strcmp(e, "sync")) mode = GL_LOG_SYNC;
+  if (e && !strcmp(e, "async")) mode = GL_LOG_ASYNC;
+  if (e && !strcmp(e, "off")) mode = GL_LOG_OFF;
+  return mode;
+}
+
+#endif // LOG_H
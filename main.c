@@ -1,24 +1,40 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <iostream>
 
 #define GL_GLEXT_PROTOTYPES 1
 #define GL3_PROTOTYPES 1
 #include <GLFW/glfw3.h>
 
 #include "linmath.h"
+#include "linmath_simd.h"
+#include "linmath_batch.h"
+#include "linmath_constexpr.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "log.h"
+#include "pixelconv.h"
+#include "vertexpack.h"
+#include "cpucompute.h"
+#include "glstate.h"
+#include "gpumemory.h"
+#include "glresource.h"
+#include "framegraph.h"
 #include "shader.h"
+#include "vertexlayout.h"
+#include "vertexpool.h"
 #include "vertexbuf.h"
+#include "culling.h"
+#include "terrain.h"
+#include "effects.h"
+#include "transform.h"
 
 void error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description); }
 
-void APIENTRY gl_debug_output(const GLenum source, const GLenum type, const GLuint id, const GLenum severity, const GLsizei, const GLchar *message, void *) {
+void APIENTRY gl_debug_output(const GLenum source, const GLenum type, const GLuint id, const GLenum severity, const GLsizei length, const GLchar *message, void *) {
 	// Skip buffer info messages, framebuffer info messages, texture usage state warning, redundant state change buffer
 	if (id == 131185 // ?
 		|| id == 131169 // ?
@@ -29,52 +45,37 @@ void APIENTRY gl_debug_output(const GLenum source, const GLenum type, const GLui
 		return;
 	}
 
-	//if (id == 131218) return;
-
-	std::cout << "---------------" << std::endl;
-	std::cout << "Debug message (" << id << "): " << message << std::endl;
-
-	switch (source) {
-		case GL_DEBUG_SOURCE_API:             std::cout << "Source: API"; break;
-		case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   std::cout << "Source: Window System"; break;
-		case GL_DEBUG_SOURCE_SHADER_COMPILER: std::cout << "Source: Shader Compiler"; break;
-		case GL_DEBUG_SOURCE_THIRD_PARTY:     std::cout << "Source: Third Party"; break;
-		case GL_DEBUG_SOURCE_APPLICATION:     std::cout << "Source: Application"; break;
-		case GL_DEBUG_SOURCE_OTHER:           std::cout << "Source: Other"; break;
-		default: break;
-	}
-	std::cout << std::endl;
-
-	switch (type) {
-		case GL_DEBUG_TYPE_ERROR:               std::cout << "Type: Error"; break;
-		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: std::cout << "Type: Deprecated Behaviour"; break;
-		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  std::cout << "Type: Undefined Behaviour"; break;
-		case GL_DEBUG_TYPE_PORTABILITY:         std::cout << "Type: Portability"; break;
-		case GL_DEBUG_TYPE_PERFORMANCE:         std::cout << "Type: Performance"; break;
-		case GL_DEBUG_TYPE_MARKER:              std::cout << "Type: Marker"; break;
-		case GL_DEBUG_TYPE_PUSH_GROUP:          std::cout << "Type: Push Group"; break;
-		case GL_DEBUG_TYPE_POP_GROUP:           std::cout << "Type: Pop Group"; break;
-		case GL_DEBUG_TYPE_OTHER:               std::cout << "Type: Other"; break;
-		default: break;
-	}
-	std::cout << std::endl;
-
-	switch (severity) {
-		case GL_DEBUG_SEVERITY_HIGH:         std::cout << "Severity: high"; break;
-		case GL_DEBUG_SEVERITY_MEDIUM:       std::cout << "Severity: medium"; break;
-		case GL_DEBUG_SEVERITY_LOW:          std::cout << "Severity: low"; break;
-		case GL_DEBUG_SEVERITY_NOTIFICATION: std::cout << "Severity: notification"; break;
-		default: break;
-	}
-	std::cout << std::endl;
+	GlobalLog().GlMessage(source, type, id, severity, length, message);
 }
 
 void loop(GLFWwindow* window);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 float time_correction = 0.0f;
 
+VertexPool vertexPool;
 VertexMesh mesh;
 Quad quad;
+TransformStore transforms;
+InstanceBuffer instances;
+GpuCuller culler;
+TransformId meshTransform;
+Heightfield heightfield;
+CdlodTerrain terrain;
+TessTerrain tessTerrain;
+FrameGraph frameGraph;
+EffectChain effects;
+
+// T cycles through these
+enum TerrainMode { TERRAIN_OFF, TERRAIN_CDLOD, TERRAIN_TESSELLATION, TERRAIN_MODES };
+const char* terrainModeNames[TERRAIN_MODES] = { "off", "cdlod", "tessellation" };
+int terrainMode = TERRAIN_OFF;
+// C toggles the culled, indirectly drawn mesh
+bool drawMesh = false;
+// E runs the effect chain a kernel per stage, Q cycles the format of its
+// intermediates
+bool fuseEffects = true;
+const GLenum effectFormats[] = { GL_RGBA32F, GL_RGBA16F, GL_R11F_G11F_B10F, GL_RGBA8 };
+int effectFormat = 0;
 
 float vertices[] = {
   -1.0f,  -1.0f, 1.0f,
@@ -94,6 +95,11 @@ int main(int argc, char** argv) {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
 
+  // Without debug output there's no point in error checking either
+  GlLogMode logMode = GlLogModeFromEnv();
+  if (logMode == GL_LOG_OFF) glfwWindowHint(GLFW_CONTEXT_NO_ERROR, GLFW_TRUE);
+  GlobalLog().Start(stdout);
+
   // Create window
   GLFWwindow* window = glfwCreateWindow(640, 480, "Roiboi", NULL, NULL);
   if (!window) {
@@ -104,11 +110,14 @@ int main(int argc, char** argv) {
   //Bind the window
   glfwMakeContextCurrent(window);
 
-  //Enable debugging
-  glEnable(GL_DEBUG_OUTPUT);
-	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-	glDebugMessageCallback(GLDEBUGPROC(gl_debug_output), nullptr);
-	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+  //Enable debugging, synchronous only when asked for: it stalls the driver
+  //on every call to report messages from the calling thread
+  if (logMode != GL_LOG_OFF) {
+    glEnable(GL_DEBUG_OUTPUT);
+    if (logMode == GL_LOG_SYNC) glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(GLDEBUGPROC(gl_debug_output), nullptr);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+  }
 
 
   //Set key callback
@@ -116,19 +125,32 @@ int main(int argc, char** argv) {
 
   // Print info
   const GLubyte* vendor = glGetString(GL_VENDOR);
-  printf("Video card:\t%s\n", vendor);
+  GlobalLog().Printf("Video card:\t%s", vendor);
   const GLubyte* renderer = glGetString(GL_RENDERER);
-  printf("Renderer:\t%s\n", renderer);
+  GlobalLog().Printf("Renderer:\t%s", renderer);
   const GLubyte* version = glGetString(GL_VERSION);
-  printf("OpenGL version:\t%s\n", version);
-  printf("------------\n");
+  GlobalLog().Printf("OpenGL version:\t%s", version);
+  GlobalLog().Printf("------------");
 
   //Enable vsync
   glfwSwapInterval(1);
 
   //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-  mesh.Init(20, 20);
-  quad.Init();
+  vertexPool.Init(1 << 16);
+  mesh.Init(20, 20, vertexPool);
+  quad.Init(vertexPool);
+  effects.Add(ChromaticStage());
+  effects.Add(WarpStage());
+  effects.Build(quad.worker.w, quad.worker.h, EFFECT_TO_FRAGMENT, fuseEffects, effectFormats[effectFormat]);
+  instances.Init(1024);
+  meshTransform = transforms.Create();
+  culler.Init(1024);
+  culler.AddDraw(mesh.firstVertex, mesh.vertexCount / 4, mesh.bounds);
+  culler.SetObjects(nullptr, transforms.Count());
+  heightfield.Generate(1024, 1.0f, 120.0f);
+  heightfield.Upload();
+  terrain.Init(heightfield);
+  tessTerrain.Init(heightfield);
 
   if (argc > 1) glfwSetWindowShouldClose(window, GLFW_TRUE);
 
@@ -140,36 +162,99 @@ int main(int argc, char** argv) {
     glfwSwapBuffers(window);
   }
 
-  printf("Window was closed\n");
+  GlobalLog().Printf("Window was closed");
   glfwDestroyWindow(window);
   glfwTerminate();
+  GlobalLog().Stop();
   return 0;
 }
 
 
+// Constant parts of the mvp, evaluated at compile time
+constexpr cx::mat4 kTilt = cx::rotate_X(cx::identity(), 2.2f);
+constexpr cx::mat4 kTranslate = cx::translate(0, 0, 0);
+
+// cosf(2.2f) and sinf(2.2f), as used by mat4x4_rotate_X
+static_assert(cx::near(kTilt.at(1, 1), -0.588501155f) && cx::near(kTilt.at(1, 2), 0.808496356f)
+    && cx::near(kTilt.at(2, 1), -0.808496356f) && cx::near(kTilt.at(2, 2), -0.588501155f),
+    "kTilt differs from mat4x4_rotate_X(m, I, 2.2f)");
+// so the translation can be left out of the product below
+static_assert(cx::near(kTranslate, cx::identity(), 0), "kTranslate is no longer the identity");
+
+// Camera circling over the middle of the heightfield
+void loop_terrain(int width, int height) {
+  const float fov = 60.0f * (float)M_PI / 180.0f;
+  float t = glfwGetTime() * 0.05f;
+  float half = heightfield.size * heightfield.spacing / 2;
+  vec3 eye = { half + cosf(t) * half * 0.6f, half + sinf(t) * half * 0.6f, heightfield.scale * 2.0f };
+  vec3 center = { half, half, heightfield.scale * 0.3f };
+  vec3 up = { 0, 0, 1 };
+  mat4x4 v, p, vp;
+  mat4x4_look_at(v, eye, center, up);
+  mat4x4_perspective(p, fov, width / (float)height, 1.0f, 4 * half);
+  mat4x4_mul(vp, p, v);
+
+  glEnable(GL_DEPTH_TEST);
+  if (terrainMode == TERRAIN_CDLOD) {
+    terrain.SetView(fov, height, 2.0f);
+    terrain.Select(vp, eye);
+    terrain.Draw(vp, eye);
+  } else {
+    tessTerrain.SetView(fov, height, 8.0f);
+    tessTerrain.Draw(vp);
+  }
+  glDisable(GL_DEPTH_TEST);
+}
+
 void loop(GLFWwindow* window) {
   float ratio;
   int width, height;
-  mat4x4 m, p, t, s, mvp;
+  mat4x4a m, p;
+  mat3x4 model;
 
   glfwGetFramebufferSize(window, &width, &height);
   ratio = width / (float)height;
 
-  mat4x4_identity(m);
-  mat4x4_rotate_X(m, m, 2.2f);
-  mat4x4_rotate_Z(m, m, glfwGetTime() - time_correction);
+  float meshTime = glfwGetTime() - time_correction;
+  kTilt.store(m);
+  mat4x4_rotate_Z_simd(m, m, meshTime);
   mat4x4_ortho(p, -ratio, ratio, -1.0f, 1.0f, 1.0f, -1.0f);
-  mat4x4_translate(t, 0, 0, 0);
 
-  mat4x4_mul(mvp, p, m);
-  mat4x4_mul(mvp, t, mvp);
+  mat3x4_from_mat4x4(model, m);
+  transforms.SetLocal(meshTransform, model);
+  transforms.Update(instances.Begin(), instances.capacity, instances.stride, InstanceBuffer::Copies);
 
-  glViewport(0, 0, width, height);
-  glClear(GL_COLOR_BUFFER_BIT);
+  GlState().Viewport(0, 0, width, height);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-  quad.Draw(glfwGetTime());
-//  mesh.Draw(mvp, time_correction);
+  // The effect and culling passes are always declared, the graph drops
+  // them when nothing this frame draws what they write
+  FrameGraph& fg = frameGraph;
+  float time = glfwGetTime();
+  fg.Reset();
+  FgResource photo = fg.ImportTexture("quad texture", quad.tex);
+  FgResource shaded = effects.AddPasses(fg, photo, time);
+  FgResource visible = fg.ImportBuffer("visible", culler.visible);
+  FgResource commands = fg.ImportBuffer("commands", culler.commands);
+  fg.AddPass("cull", [&]() { culler.Dispatch(p, instances); })
+    .Write(visible, FG_STORAGE).Write(commands, FG_STORAGE);
+  if (terrainMode != TERRAIN_OFF) {
+    fg.AddPass("terrain", [&]() { loop_terrain(width, height); }).SideEffect();
+  } else {
+    fg.AddPass("quad", [&, shaded, time]() {
+      effects.BindFragment(fg.Texture(shaded), time, quad.pool != nullptr);
+      quad.DrawVertices();
+    }).Read(shaded, FG_SAMPLED).SideEffect();
+  }
+  if (drawMesh) {
+    fg.AddPass("mesh", [&]() { mesh.DrawIndirect(p, meshTime, instances, culler.visible, culler.commands, culler.DrawCount()); })
+      .Read(visible, FG_VERTEX).Read(commands, FG_INDIRECT).SideEffect();
+  }
+  fg.Execute();
+  instances.End();
+  GlState().EndFrame();
+  GpuMem().Tick(glfwGetTime());
 
   if (time_correction > 0) 
     time_correction -= 0.01f;
@@ -178,6 +263,29 @@ void loop(GLFWwindow* window) {
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
   if (key == 32 && action == GLFW_RELEASE) { // space
     time_correction += 0.5f;
-    printf("whoop whoop\n");
+    GlobalLog().Printf("whoop whoop");
+  }
+  if (key == GLFW_KEY_T && action == GLFW_RELEASE) {
+    terrainMode = (terrainMode + 1) % TERRAIN_MODES;
+    GlobalLog().Printf("terrain %s", terrainModeNames[terrainMode]);
+  }
+  if (key == GLFW_KEY_G && action == GLFW_RELEASE) {
+    GlStateCache::Counters c = GlState().last;
+    GlobalLog().Printf("gl state calls last frame: %u issued, %u elided", c.issued, c.elided);
+  }
+  if (key == GLFW_KEY_M && action == GLFW_RELEASE) GpuMem().Report();
+  if (key == GLFW_KEY_C && action == GLFW_RELEASE) {
+    drawMesh = !drawMesh;
+    GlobalLog().Printf("mesh %s", drawMesh ? "on" : "off");
+  }
+  if ((key == GLFW_KEY_E || key == GLFW_KEY_Q) && action == GLFW_RELEASE) {
+    if (key == GLFW_KEY_E) fuseEffects = !fuseEffects;
+    else effectFormat = (effectFormat + 1) % 4;
+    effects.Build(effects.w, effects.h, EFFECT_TO_FRAGMENT, fuseEffects, effectFormats[effectFormat]);
+    GlobalLog().Printf("effects: %zu kernels, %.2f MB of intermediates", effects.kernels.size(), effects.IntermediateBytes() / 1048576.0);
+  }
+  if (key == GLFW_KEY_F && action == GLFW_RELEASE) {
+    FrameGraph::Stats s = frameGraph.stats;
+    GlobalLog().Printf("frame graph: %u passes, %u culled, %u barriers, %u transients in %u objects", s.passes, s.culled, s.barriers, s.transients, s.physical);
   }
 }
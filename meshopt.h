@@ -0,0 +1,172 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Bake time optimizations for indexed triangle lists, templated on the
+// index type (uint16_t or uint32_t). Run OptimizeVertexCache first, it only
+// reorders triangles, then OptimizeVertexFetch, which renumbers vertices in
+// the order the reordered triangles first touch them.
+
+// ACMR: vertices transformed per triangle, 0.5 at best on a regular grid,
+// 3 with no reuse at all. ATVR: vertices transformed per referenced vertex,
+// 1 at best. Both simulated with a FIFO post-transform cache.
+struct VertexCacheStats {
+  float acmr;
+  float atvr;
+};
+
+template<typename I>
+static VertexCacheStats AnalyzeVertexCache(const I* indices, size_t indexCount, size_t vertexCount, size_t cacheSize = 16)
+{
+  std::vector<uint32_t> stamp(vertexCount, 0);
+  std::vector<uint8_t> used(vertexCount, 0);
+  // a vertex is in the FIFO while fewer than cacheSize misses happened since it went in
+  uint32_t misses = 0, referenced = 0;
+  for(size_t i=0; i<indexCount; i++) {
+    I v = indices[i];
+    if (!used[v]) {
+      used[v] = 1;
+      referenced++;
+    }
+    if (stamp[v] == 0 || misses - stamp[v] >= cacheSize) {
+      stamp[v] = ++misses;
+    }
+  }
+  VertexCacheStats s;
+  s.acmr = indexCount ? misses / (indexCount / 3.0f) : 0;
+  s.atvr = referenced ? misses / (float)referenced : 0;
+  return s;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimization: greedily emits the
+// triangle with the best score, where a vertex scores higher the more
+// recently it was used (LRU of ForsythCacheSize) and the fewer triangles it
+// has left, so fans get finished instead of leaving stragglers behind.
+static const int ForsythCacheSize = 32;
+
+static inline float ForsythVertexScore(int cachePos, uint32_t remaining)
+{
+  if (remaining == 0) return -1.0f;
+  float score = 0;
+  if (cachePos >= 0) {
+    // the last triangle's vertices get a fixed score so the next triangle
+    // doesn't just reuse the same edge
+    if (cachePos < 3) score = 0.75f;
+    else score = powf(1.0f - (cachePos - 3) * (1.0f / (ForsythCacheSize - 3)), 1.5f);
+  }
+  return score + 2.0f / sqrtf((float)remaining);
+}
+
+template<typename I>
+static void OptimizeVertexCache(I* dst, const I* indices, size_t indexCount, size_t vertexCount)
+{
+  const size_t triCount = indexCount / 3;
+  const uint32_t None = ~0u;
+
+  // triangles of each vertex, the first remaining[v] of them not emitted yet
+  std::vector<uint32_t> offsets(vertexCount + 1, 0), remaining(vertexCount, 0);
+  for(size_t i=0; i<indexCount; i++) remaining[indices[i]]++;
+  for(size_t v=0; v<vertexCount; v++) offsets[v + 1] = offsets[v] + remaining[v];
+  std::vector<uint32_t> adjacency(indexCount), fill(offsets.begin(), offsets.end() - 1);
+  for(size_t i=0; i<indexCount; i++) adjacency[fill[indices[i]]++] = i / 3;
+
+  std::vector<int> cachePos(vertexCount, -1);
+  std::vector<float> vertexScore(vertexCount);
+  for(size_t v=0; v<vertexCount; v++) vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+  std::vector<float> triScore(triCount);
+  std::vector<uint8_t> emitted(triCount, 0);
+  uint32_t best = None;
+  float bestScore = -1;
+  for(size_t t=0; t<triCount; t++) {
+    triScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t + 1]] + vertexScore[indices[3*t + 2]];
+    if (triScore[t] > bestScore) {
+      bestScore = triScore[t];
+      best = t;
+    }
+  }
+
+  uint32_t cache[ForsythCacheSize + 3];
+  int cacheCount = 0;
+  size_t scan = 0;
+  for(size_t out=0; out<triCount; out++) {
+    // nothing left around the cache, continue with the next triangle in input order
+    if (best == None) {
+      while (emitted[scan]) scan++;
+      best = scan;
+    }
+    const I* tri = indices + 3 * best;
+    memcpy(dst + 3 * out, tri, 3 * sizeof(I));
+    emitted[best] = 1;
+
+    for(int k=0; k<3; k++) {
+      uint32_t v = tri[k];
+      uint32_t* list = &adjacency[offsets[v]];
+      for(uint32_t j=0; j<remaining[v]; j++)
+        if (list[j] == best) {
+          list[j] = list[remaining[v] - 1];
+          remaining[v]--;
+          break;
+        }
+    }
+
+    // the triangle's vertices move to the front, the rest shift back
+    uint32_t next[ForsythCacheSize + 3];
+    int n = 0;
+    for(int k=0; k<3; k++) next[n++] = tri[k];
+    for(int c=0; c<cacheCount; c++)
+      if (cache[c] != tri[0] && cache[c] != tri[1] && cache[c] != tri[2]) next[n++] = cache[c];
+    for(int i=0; i<n; i++) {
+      uint32_t v = next[i];
+      cachePos[v] = i < ForsythCacheSize ? i : -1;
+      vertexScore[v] = ForsythVertexScore(cachePos[v], remaining[v]);
+    }
+    cacheCount = n < ForsythCacheSize ? n : ForsythCacheSize;
+    memcpy(cache, next, cacheCount * sizeof(uint32_t));
+
+    // only triangles around the touched vertices changed score
+    best = None;
+    bestScore = -1;
+    for(int i=0; i<n; i++) {
+      uint32_t v = next[i];
+      for(uint32_t j=0; j<remaining[v]; j++) {
+        uint32_t t = adjacency[offsets[v] + j];
+        triScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t + 1]] + vertexScore[indices[3*t + 2]];
+        if (triScore[t] > bestScore) {
+          bestScore = triScore[t];
+          best = t;
+        }
+      }
+    }
+  }
+}
+
+// Renumbers the vertices in order of first use and moves their `stride`
+// byte records to match, so the vertex fetch walks memory front to back.
+// Vertices no index refers to end up past the returned count.
+template<typename I>
+static size_t OptimizeVertexFetch(void* vertices, size_t stride, I* indices, size_t indexCount, size_t vertexCount)
+{
+  const uint32_t None = ~0u;
+  std::vector<uint32_t> remap(vertexCount, None);
+  uint32_t next = 0;
+  for(size_t i=0; i<indexCount; i++) {
+    I v = indices[i];
+    if (remap[v] == None) remap[v] = next++;
+    indices[i] = remap[v];
+  }
+  uint32_t unused = next;
+  for(size_t v=0; v<vertexCount; v++)
+    if (remap[v] == None) remap[v] = unused++;
+
+  char* data = (char*)vertices;
+  std::vector<char> copy(data, data + vertexCount * stride);
+  for(size_t v=0; v<vertexCount; v++)
+    memcpy(data + remap[v] * stride, copy.data() + v * stride, stride);
+  return next;
+}
+
+#endif // MESHOPT_H
@@ -0,0 +1,508 @@
+#ifndef PIXELCONV_H
+#define PIXELCONV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "threadpool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+  #define PC_X86 1
+  #include <immintrin.h>
+#endif
+
+// Outputs at least this large are written with non-temporal stores, they are
+// handed straight to the driver and would only evict the cache on the way.
+#ifndef PC_STREAM_BYTES
+  #define PC_STREAM_BYTES (4u << 20)
+#endif
+
+// Inputs at least this large are split in chunks over the thread pool.
+#ifndef PC_PARALLEL_BYTES
+  #define PC_PARALLEL_BYTES (1u << 20)
+#endif
+
+enum PcLevel { PC_SCALAR, PC_SSE, PC_AVX2, PC_LEVEL_COUNT };
+
+enum PcKernelId {
+  PC_U8_TO_F32,       // 1 byte  -> 1 float, times scale
+  PC_RGB_TO_RGBA,     // 3 bytes -> 4 bytes, alpha filled in
+  PC_RGB_TO_RGBA_F32, // 3 bytes -> 4 floats, times scale, alpha filled in
+  PC_U8_TO_F16,       // 1 byte  -> 1 half, times scale
+  PC_SRGB_TO_LINEAR,  // 1 byte  -> 1 float through the sRGB EOTF
+  PC_SWIZZLE_RGBA,    // 4 bytes -> 4 bytes, dst[k] = src[order[k]]
+  PC_KERNEL_COUNT
+};
+
+struct PcParams {
+  float scale;
+  float alpha;
+  uint8_t order[4];
+};
+
+typedef void (*PcKernel)(void* dst, const void* src, size_t n, const PcParams* p, bool stream);
+
+// element sizes in bytes, used to split and align work
+static const size_t pc_in_size[PC_KERNEL_COUNT]  = { 1, 3, 3, 1, 1, 4 };
+static const size_t pc_out_size[PC_KERNEL_COUNT] = { 4, 4, 16, 2, 4, 4 };
+// names for reports, only the bench prints them
+[[maybe_unused]] static const char* pc_kernel_names[PC_KERNEL_COUNT] = {
+  "u8_to_f32", "rgb_to_rgba", "rgb_to_rgba_f32", "u8_to_f16", "srgb_to_linear", "swizzle_rgba"
+};
+[[maybe_unused]] static const char* pc_level_names[PC_LEVEL_COUNT] = { "scalar", "sse", "avx2" };
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar reference kernels
+////////////////////////////////////////////////////////////////////////////////
+
+static inline uint16_t pc_float_to_half(float f)
+{
+  uint32_t x;
+  memcpy(&x, &f, 4);
+  uint32_t sign = (x >> 16) & 0x8000;
+  int32_t exp = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = x & 0x7fffff;
+
+  if (exp >= 31) return sign | 0x7c00;
+  if (exp <= 0) {
+    if (exp < -10) return sign;
+    mant |= 0x800000;
+    uint32_t shift = 14 - exp;
+    uint32_t h = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) h++;
+    return sign | h;
+  }
+  uint32_t h = ((uint32_t)exp << 10) | (mant >> 13);
+  uint32_t rem = mant & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+  return sign | h;
+}
+
+static inline const float* pc_srgb_lut()
+{
+  static float lut[256];
+  static bool built = [] {
+    for(int i=0; i<256; i++) {
+      float c = i / 255.0f;
+      lut[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return true;
+  }();
+  (void)built;
+  return lut;
+}
+
+static void pc_u8_to_f32_scalar(void* d, const void* s, size_t n, const PcParams* p, bool)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  for(size_t i=0; i<n; i++) dst[i] = src[i] * p->scale;
+}
+
+static void pc_rgb_to_rgba_scalar(void* d, const void* s, size_t n, const PcParams* p, bool)
+{
+  uint8_t* dst = (uint8_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  uint8_t a = (uint8_t)p->alpha;
+  for(size_t i=0; i<n; i++) {
+    dst[4*i+0] = src[3*i+0];
+    dst[4*i+1] = src[3*i+1];
+    dst[4*i+2] = src[3*i+2];
+    dst[4*i+3] = a;
+  }
+}
+
+static void pc_rgb_to_rgba_f32_scalar(void* d, const void* s, size_t n, const PcParams* p, bool)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  for(size_t i=0; i<n; i++) {
+    dst[4*i+0] = src[3*i+0] * p->scale;
+    dst[4*i+1] = src[3*i+1] * p->scale;
+    dst[4*i+2] = src[3*i+2] * p->scale;
+    dst[4*i+3] = p->alpha;
+  }
+}
+
+static void pc_u8_to_f16_scalar(void* d, const void* s, size_t n, const PcParams* p, bool)
+{
+  uint16_t* dst = (uint16_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  for(size_t i=0; i<n; i++) dst[i] = pc_float_to_half(src[i] * p->scale);
+}
+
+static void pc_srgb_to_linear_scalar(void* d, const void* s, size_t n, const PcParams*, bool)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const float* lut = pc_srgb_lut();
+  for(size_t i=0; i<n; i++) dst[i] = lut[src[i]];
+}
+
+static void pc_swizzle_rgba_scalar(void* d, const void* s, size_t n, const PcParams* p, bool)
+{
+  uint8_t* dst = (uint8_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  for(size_t i=0; i<n; i++) {
+    uint8_t px[4] = { src[4*i+0], src[4*i+1], src[4*i+2], src[4*i+3] };
+    for(int k=0; k<4; k++) dst[4*i+k] = px[p->order[k]];
+  }
+}
+
+#ifdef PC_X86
+////////////////////////////////////////////////////////////////////////////////
+// SSE kernels (SSE2, plus SSSE3 pshufb for the byte shuffles)
+////////////////////////////////////////////////////////////////////////////////
+
+#define PC_STORE_PS(ptr, v) (stream ? _mm_stream_ps(ptr, v) : _mm_storeu_ps(ptr, v))
+#define PC_STORE_SI(ptr, v) (stream ? _mm_stream_si128((__m128i*)(ptr), v) : _mm_storeu_si128((__m128i*)(ptr), v))
+
+static void pc_u8_to_f32_sse(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const __m128i z = _mm_setzero_si128();
+  const __m128 k = _mm_set1_ps(p->scale);
+  size_t i = 0;
+  for(; i+16<=n; i+=16) {
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i lo = _mm_unpacklo_epi8(b, z);
+    __m128i hi = _mm_unpackhi_epi8(b, z);
+    PC_STORE_PS(dst + i +  0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, z)), k));
+    PC_STORE_PS(dst + i +  4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, z)), k));
+    PC_STORE_PS(dst + i +  8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, z)), k));
+    PC_STORE_PS(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, z)), k));
+  }
+  pc_u8_to_f32_scalar(dst + i, src + i, n - i, p, false);
+}
+
+// 4 rgb pixels in the low 12 bytes -> 4 rgba pixels with a zero alpha byte
+#define PC_RGB_SHUFFLE 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+
+__attribute__((target("ssse3")))
+static void pc_rgb_to_rgba_sse(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  uint8_t* dst = (uint8_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const __m128i shuf = _mm_setr_epi8(PC_RGB_SHUFFLE);
+  const __m128i alpha = _mm_set1_epi32((int)((uint32_t)(uint8_t)p->alpha << 24));
+  size_t i = 0;
+  // the 16 byte load reads 4 bytes past the 4 pixels we use
+  for(; 3*i+16<=3*n; i+=4) {
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + 3*i));
+    PC_STORE_SI(dst + 4*i, _mm_or_si128(_mm_shuffle_epi8(b, shuf), alpha));
+  }
+  pc_rgb_to_rgba_scalar(dst + 4*i, src + 3*i, n - i, p, false);
+}
+
+__attribute__((target("ssse3")))
+static void pc_rgb_to_rgba_f32_sse(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const __m128i shuf = _mm_setr_epi8(PC_RGB_SHUFFLE);
+  const __m128i z = _mm_setzero_si128();
+  const __m128 k = _mm_set1_ps(p->scale);
+  // alpha lanes are zero after the shuffle, adding puts the alpha value in
+  const __m128 a = _mm_setr_ps(0, 0, 0, p->alpha);
+  size_t i = 0;
+  for(; 3*i+16<=3*n; i+=4) {
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 3*i)), shuf);
+    __m128i lo = _mm_unpacklo_epi8(b, z);
+    __m128i hi = _mm_unpackhi_epi8(b, z);
+    PC_STORE_PS(dst + 4*i +  0, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, z)), k), a));
+    PC_STORE_PS(dst + 4*i +  4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, z)), k), a));
+    PC_STORE_PS(dst + 4*i +  8, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, z)), k), a));
+    PC_STORE_PS(dst + 4*i + 12, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, z)), k), a));
+  }
+  pc_rgb_to_rgba_f32_scalar(dst + 4*i, src + 3*i, n - i, p, false);
+}
+
+__attribute__((target("ssse3")))
+static void pc_swizzle_rgba_sse(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  uint8_t* dst = (uint8_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const uint8_t* o = p->order;
+  const __m128i shuf = _mm_setr_epi8(
+      o[0],    o[1],    o[2],    o[3],    o[0]+4,  o[1]+4,  o[2]+4,  o[3]+4,
+      o[0]+8,  o[1]+8,  o[2]+8,  o[3]+8,  o[0]+12, o[1]+12, o[2]+12, o[3]+12);
+  size_t i = 0;
+  for(; i+4<=n; i+=4) {
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + 4*i));
+    PC_STORE_SI(dst + 4*i, _mm_shuffle_epi8(b, shuf));
+  }
+  pc_swizzle_rgba_scalar(dst + 4*i, src + 4*i, n - i, p, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2 / F16C kernels
+////////////////////////////////////////////////////////////////////////////////
+
+#define PC_STORE256_PS(ptr, v) (stream ? _mm256_stream_ps(ptr, v) : _mm256_storeu_ps(ptr, v))
+#define PC_STORE256_SI(ptr, v) (stream ? _mm256_stream_si256((__m256i*)(ptr), v) : _mm256_storeu_si256((__m256i*)(ptr), v))
+
+__attribute__((target("avx2")))
+static void pc_u8_to_f32_avx2(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const __m256 k = _mm256_set1_ps(p->scale);
+  size_t i = 0;
+  for(; i+32<=n; i+=32) {
+    for(int j=0; j<32; j+=8) {
+      __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + j)));
+      PC_STORE256_PS(dst + i + j, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+    }
+  }
+  pc_u8_to_f32_scalar(dst + i, src + i, n - i, p, false);
+}
+
+// 8 rgb pixels -> 8 rgba pixels with zero alpha, 4 pixels per 128 bit lane
+__attribute__((target("avx2")))
+static inline __m256i pc_load_rgb8_avx2(const uint8_t* src)
+{
+  const __m256i shuf = _mm256_setr_epi8(PC_RGB_SHUFFLE, PC_RGB_SHUFFLE);
+  __m256i b = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+      _mm_loadu_si128((const __m128i*)(src + 12)), 1);
+  return _mm256_shuffle_epi8(b, shuf);
+}
+
+__attribute__((target("avx2")))
+static void pc_rgb_to_rgba_avx2(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  uint8_t* dst = (uint8_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const __m256i alpha = _mm256_set1_epi32((int)((uint32_t)(uint8_t)p->alpha << 24));
+  size_t i = 0;
+  for(; 3*i+28<=3*n; i+=8)
+    PC_STORE256_SI(dst + 4*i, _mm256_or_si256(pc_load_rgb8_avx2(src + 3*i), alpha));
+  pc_rgb_to_rgba_scalar(dst + 4*i, src + 3*i, n - i, p, false);
+}
+
+__attribute__((target("avx2")))
+static void pc_rgb_to_rgba_f32_avx2(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const __m256 k = _mm256_set1_ps(p->scale);
+  const __m256 a = _mm256_setr_ps(0, 0, 0, p->alpha, 0, 0, 0, p->alpha);
+  size_t i = 0;
+  for(; 3*i+28<=3*n; i+=8) {
+    __m256i b = pc_load_rgb8_avx2(src + 3*i);
+    __m128i lo = _mm256_castsi256_si128(b);
+    __m128i hi = _mm256_extracti128_si256(b, 1);
+    __m256i q0 = _mm256_cvtepu8_epi32(lo);
+    __m256i q1 = _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8));
+    __m256i q2 = _mm256_cvtepu8_epi32(hi);
+    __m256i q3 = _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8));
+    PC_STORE256_PS(dst + 4*i +  0, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(q0), k), a));
+    PC_STORE256_PS(dst + 4*i +  8, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(q1), k), a));
+    PC_STORE256_PS(dst + 4*i + 16, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(q2), k), a));
+    PC_STORE256_PS(dst + 4*i + 24, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(q3), k), a));
+  }
+  pc_rgb_to_rgba_f32_scalar(dst + 4*i, src + 3*i, n - i, p, false);
+}
+
+__attribute__((target("avx2,f16c")))
+static void pc_u8_to_f16_avx2(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  uint16_t* dst = (uint16_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const __m256 k = _mm256_set1_ps(p->scale);
+  size_t i = 0;
+  for(; i+16<=n; i+=16) {
+    __m256i v0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+    __m256i v1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 8)));
+    __m128i h0 = _mm256_cvtps_ph(_mm256_mul_ps(_mm256_cvtepi32_ps(v0), k), _MM_FROUND_TO_NEAREST_INT);
+    __m128i h1 = _mm256_cvtps_ph(_mm256_mul_ps(_mm256_cvtepi32_ps(v1), k), _MM_FROUND_TO_NEAREST_INT);
+    PC_STORE256_SI(dst + i, _mm256_inserti128_si256(_mm256_castsi128_si256(h0), h1, 1));
+  }
+  pc_u8_to_f16_scalar(dst + i, src + i, n - i, p, false);
+}
+
+__attribute__((target("avx2")))
+static void pc_srgb_to_linear_avx2(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  float* dst = (float*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const float* lut = pc_srgb_lut();
+  size_t i = 0;
+  for(; i+16<=n; i+=16) {
+    __m256i i0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+    __m256i i1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 8)));
+    PC_STORE256_PS(dst + i,     _mm256_i32gather_ps(lut, i0, 4));
+    PC_STORE256_PS(dst + i + 8, _mm256_i32gather_ps(lut, i1, 4));
+  }
+  pc_srgb_to_linear_scalar(dst + i, src + i, n - i, p, false);
+}
+
+__attribute__((target("avx2")))
+static void pc_swizzle_rgba_avx2(void* d, const void* s, size_t n, const PcParams* p, bool stream)
+{
+  uint8_t* dst = (uint8_t*)d;
+  const uint8_t* src = (const uint8_t*)s;
+  const uint8_t* o = p->order;
+  const __m256i shuf = _mm256_setr_epi8(
+      o[0],    o[1],    o[2],    o[3],    o[0]+4,  o[1]+4,  o[2]+4,  o[3]+4,
+      o[0]+8,  o[1]+8,  o[2]+8,  o[3]+8,  o[0]+12, o[1]+12, o[2]+12, o[3]+12,
+      o[0],    o[1],    o[2],    o[3],    o[0]+4,  o[1]+4,  o[2]+4,  o[3]+4,
+      o[0]+8,  o[1]+8,  o[2]+8,  o[3]+8,  o[0]+12, o[1]+12, o[2]+12, o[3]+12);
+  size_t i = 0;
+  for(; i+8<=n; i+=8) {
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + 4*i));
+    PC_STORE256_SI(dst + 4*i, _mm256_shuffle_epi8(b, shuf));
+  }
+  pc_swizzle_rgba_scalar(dst + 4*i, src + 4*i, n - i, p, false);
+}
+
+#undef PC_STORE_PS
+#undef PC_STORE_SI
+#undef PC_STORE256_PS
+#undef PC_STORE256_SI
+#endif // PC_X86
+
+////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+////////////////////////////////////////////////////////////////////////////////
+
+struct PcDispatch {
+  PcKernel table[PC_LEVEL_COUNT][PC_KERNEL_COUNT];
+  PcLevel supported;
+  PcLevel level;
+  bool threads;
+
+  PcDispatch() {
+    PcKernel scalar[PC_KERNEL_COUNT] = {
+      pc_u8_to_f32_scalar, pc_rgb_to_rgba_scalar, pc_rgb_to_rgba_f32_scalar,
+      pc_u8_to_f16_scalar, pc_srgb_to_linear_scalar, pc_swizzle_rgba_scalar
+    };
+    for(int l=0; l<PC_LEVEL_COUNT; l++)
+      memcpy(table[l], scalar, sizeof(scalar));
+    supported = PC_SCALAR;
+
+#ifdef PC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+      PcKernel sse[PC_KERNEL_COUNT] = {
+        pc_u8_to_f32_sse, pc_rgb_to_rgba_sse, pc_rgb_to_rgba_f32_sse,
+        pc_u8_to_f16_scalar, pc_srgb_to_linear_scalar, pc_swizzle_rgba_sse
+      };
+      memcpy(table[PC_SSE], sse, sizeof(sse));
+      memcpy(table[PC_AVX2], sse, sizeof(sse));
+      supported = PC_SSE;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      PcKernel avx2[PC_KERNEL_COUNT] = {
+        pc_u8_to_f32_avx2, pc_rgb_to_rgba_avx2, pc_rgb_to_rgba_f32_avx2,
+        __builtin_cpu_supports("f16c") ? pc_u8_to_f16_avx2 : pc_u8_to_f16_scalar,
+        pc_srgb_to_linear_avx2, pc_swizzle_rgba_avx2
+      };
+      memcpy(table[PC_AVX2], avx2, sizeof(avx2));
+      supported = PC_AVX2;
+    }
+#endif
+    level = supported;
+    threads = true;
+  }
+};
+
+static inline PcDispatch& pc_dispatch()
+{
+  static PcDispatch dispatch;
+  return dispatch;
+}
+
+// Force a lower instruction set level, e.g. for benchmarking. Levels above
+// what the cpu supports are clamped.
+static inline PcLevel PcSetLevel(PcLevel level)
+{
+  PcDispatch& d = pc_dispatch();
+  d.level = level < d.supported ? level : d.supported;
+  return d.level;
+}
+
+static inline PcLevel PcGetLevel() { return pc_dispatch().level; }
+static inline void PcSetThreads(bool enabled) { pc_dispatch().threads = enabled; }
+
+// Runs kernel `id` over n elements: aligns the destination for streaming
+// stores when the output is large, and splits large inputs over the pool.
+static inline void pc_run(PcKernelId id, void* dst, const void* src, size_t n, const PcParams& p)
+{
+  PcDispatch& d = pc_dispatch();
+  PcKernel kernel = d.table[d.level][id];
+  size_t in = pc_in_size[id], out = pc_out_size[id];
+  uint8_t* o = (uint8_t*)dst;
+  const uint8_t* i = (const uint8_t*)src;
+
+  bool stream = d.level != PC_SCALAR && n * out >= PC_STREAM_BYTES && ((uintptr_t)o % out) == 0;
+  if (stream) {
+    size_t head = ((32 - ((uintptr_t)o & 31)) & 31) / out;
+    if (head > n) head = n;
+    d.table[PC_SCALAR][id](o, i, head, &p, false);
+    o += head * out;
+    i += head * in;
+    n -= head;
+  }
+
+  if (d.threads && n * in >= PC_PARALLEL_BYTES && GlobalPool().Size() > 1) {
+    // 64 elements keeps every chunk start 32 byte aligned
+    size_t chunk = (PC_PARALLEL_BYTES / 4 / in) & ~(size_t)63;
+    ParallelFor(n, chunk, [&](size_t b, size_t e) {
+      kernel(o + b * out, i + b * in, e - b, &p, stream);
+    });
+  } else {
+    kernel(o, i, n, &p, stream);
+  }
+
+#ifdef PC_X86
+  if (stream) _mm_sfence();
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public conversions
+////////////////////////////////////////////////////////////////////////////////
+
+static inline void ConvertU8ToF32(float* dst, const uint8_t* src, size_t n, float scale)
+{
+  PcParams p = { scale, 0, {0, 1, 2, 3} };
+  pc_run(PC_U8_TO_F32, dst, src, n, p);
+}
+
+static inline void ConvertRgbToRgba(uint8_t* dst, const uint8_t* src, size_t pixels, uint8_t alpha = 255)
+{
+  PcParams p = { 1, (float)alpha, {0, 1, 2, 3} };
+  pc_run(PC_RGB_TO_RGBA, dst, src, pixels, p);
+}
+
+static inline void ConvertRgbToRgbaF32(float* dst, const uint8_t* src, size_t pixels, float scale, float alpha = 1.0f)
+{
+  PcParams p = { scale, alpha, {0, 1, 2, 3} };
+  pc_run(PC_RGB_TO_RGBA_F32, dst, src, pixels, p);
+}
+
+static inline void ConvertU8ToHalf(uint16_t* dst, const uint8_t* src, size_t n, float scale)
+{
+  PcParams p = { scale, 0, {0, 1, 2, 3} };
+  pc_run(PC_U8_TO_F16, dst, src, n, p);
+}
+
+static inline void ConvertSrgbToLinear(float* dst, const uint8_t* src, size_t n)
+{
+  PcParams p = { 1, 0, {0, 1, 2, 3} };
+  pc_run(PC_SRGB_TO_LINEAR, dst, src, n, p);
+}
+
+// e.g. order {2, 1, 0, 3} turns BGRA into RGBA and back
+static inline void SwizzleRgba(uint8_t* dst, const uint8_t* src, size_t pixels, const uint8_t order[4])
+{
+  PcParams p = { 1, 0, {order[0], order[1], order[2], order[3]} };
+  pc_run(PC_SWIZZLE_RGBA, dst, src, pixels, p);
+}
+
+#endif // PIXELCONV_H
@@ -1,4 +1,7 @@
 #include <stdexcept>
+#include <initializer_list>
+#include <string>
+#include <vector>
 
 #define WORK_GROUP_SIZE 8
 
@@ -30,40 +33,79 @@ inline static GLuint CompileShader(GLint type, const GLchar* const* source)
   return shader;
 };
 
+// Links the compiled shaders into a program. They are only flagged for
+// deletion and go away with the program.
+inline static GlProgram LinkProgram(std::initializer_list<GLuint> shaders)
+{
+  GlProgram program(glCreateProgram());
+  for(GLuint shader : shaders) glAttachShader(program, shader);
+  glLinkProgram(program);
+  for(GLuint shader : shaders) {
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+  }
+  return program;
+}
+
+// Layout qualifier of an image bound with `format`, for the intermediate
+// formats the effect kernels can write
+inline static const char* ImageFormatQualifier(GLenum format)
+{
+  switch (format) {
+    case GL_RGBA16F: return "rgba16f";
+    case GL_RGBA8: return "rgba8";
+    case GL_R11F_G11F_B10F: return "r11f_g11f_b10f";
+    default: return "rgba32f";
+  }
+}
+
 struct BareShader {
   static const char* vs;
   static const char* fs;
-  GLint vPos, uvPos;
-  GLuint vertex_shader, fragment_shader;
-  GLuint program;
+  GLint vPos, uvPos, pulled;
+  GlProgram program;
 
   BareShader() {}
   void Init() {
-    vertex_shader = CompileShader(GL_VERTEX_SHADER, &vs);
-    fragment_shader = CompileShader(GL_FRAGMENT_SHADER, &fs);
-
-    program = glCreateProgram();
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
+    program = LinkProgram({ CompileShader(GL_VERTEX_SHADER, &vs), CompileShader(GL_FRAGMENT_SHADER, &fs) });
 
     vPos = glGetAttribLocation(program, "vPos");
     uvPos = glGetAttribLocation(program, "uvPos");
+    pulled = glGetUniformLocation(program, "pulled");
   }
 
   void Bind() {
-    glUseProgram(program);
+    GlState().UseProgram(program);
+  }
+
+  // Read vertices from the VertexPool instead of the attributes
+  void SetPulled(bool on) {
+    glUniform1i(pulled, on);
   }
 };
 
 const char* BareShader::vs = R"(
-#version 330 core
+#version 430 core
 layout(location = 0) in vec3 vPos;
-layout(location = 0) in vec2 uvPos;
+layout(location = 1) in vec2 uvPos;
+struct PoolVertex {
+  vec4 position;
+  vec4 normal;
+};
+layout(std430, binding = 6) readonly buffer Vertices {
+  PoolVertex vertices[];
+};
+uniform bool pulled;
 
 out vec2 texCoord;
 
 void main() {
+   if (pulled) {
+     PoolVertex v = vertices[gl_VertexID];
+     gl_Position = vec4(v.position.xyz, 1);
+     texCoord = vec2(v.position.w, v.normal.w);
+     return;
+   }
    gl_Position = vec4(vPos, 1);
    texCoord = uvPos;
 })";
@@ -83,49 +125,121 @@ void main() {
 struct DefaultShader {
   static const char* vs;
   static const char* fs;
-  GLint vPos, vNormal, MVP, iTime;
-  GLuint vertex_shader, fragment_shader;
-  GLuint program;
+  GLint vPos, vNormal, VP, iTime, gridSize, heightScale, pulled, octNormals;
+  GlProgram program;
 
   DefaultShader() {}
   void Init() {
-    vertex_shader = CompileShader(GL_VERTEX_SHADER, &vs);
-    fragment_shader = CompileShader(GL_FRAGMENT_SHADER, &fs);
-
-    program = glCreateProgram();
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
+    program = LinkProgram({ CompileShader(GL_VERTEX_SHADER, &vs), CompileShader(GL_FRAGMENT_SHADER, &fs) });
 
     vPos = glGetAttribLocation(program, "vPos");
     vNormal = glGetAttribLocation(program, "vNormal");
-    MVP  = glGetUniformLocation(program, "MVP");
+    VP  = glGetUniformLocation(program, "VP");
     iTime  = glGetUniformLocation(program, "iTime");
+    gridSize = glGetUniformLocation(program, "gridSize");
+    heightScale = glGetUniformLocation(program, "heightScale");
+    pulled = glGetUniformLocation(program, "pulled");
+    octNormals = glGetUniformLocation(program, "octNormals");
+  }
+
+  // `time` drives the color animation, in seconds
+  void Bind(mat4x4 vp, float time) {
+    GlState().UseProgram(program);
+    glUniformMatrix4fv(VP, 1, GL_FALSE, (const GLfloat*) vp);
+    glUniform1f(iTime, time);
   }
 
-  void Bind(mat4x4 mvp, float time_correction) {
-    glUseProgram(program);
-    glUniformMatrix4fv(MVP, 1, GL_FALSE, (const GLfloat*) mvp);
-    glUniform1f(iTime, glfwGetTime() - time_correction);
+  // w x h quads generated from gl_VertexID with heights from `heights`,
+  // 0 x 0 reads vPos and vNormal instead
+  void BindGrid(int w, int h, GLuint heights, float scale) {
+    glUniform2i(gridSize, w, h);
+    glUniform1f(heightScale, scale);
+    if (heights) GlState().BindTextureUnit(1, heights);
+  }
+
+  // Read vertices from the VertexPool instead of vPos and vNormal
+  void SetPulled(bool on) {
+    glUniform1i(pulled, on);
+  }
+
+  // Take the normal from the octahedral vOctNormal instead of vNormal
+  void SetOctNormals(bool on) {
+    glUniform1i(octNormals, on);
   }
 };
 
 const char* DefaultShader::vs = R"(
-#version 330 core
+#version 430 core
 layout(location = 0) in vec4 vPos;
 layout(location = 1) in vec4 vNormal;
+layout(location = 2) in uint instanceIndex;
+layout(location = 3) in vec2 vOctNormal;
+struct Instance {
+  mat4 model;
+  vec4 color;
+  float timeOffset;
+};
+layout(std430, binding = 0) readonly buffer Instances {
+  Instance instances[];
+};
 out vec4 fColor;
-uniform mat4 MVP; 
+uniform mat4 VP;
 uniform float iTime;
+uniform ivec2 gridSize;
+uniform float heightScale;
+layout(binding = 1) uniform sampler2D heights;
+struct PoolVertex {
+  vec4 position;
+  vec4 normal;
+};
+layout(std430, binding = 6) readonly buffer Vertices {
+  PoolVertex vertices[];
+};
+uniform bool pulled;
+uniform bool octNormals;
+
+// Inverse of oct_encode in vertexpack.h
+vec3 OctDecode(vec2 e) {
+   vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+   if (n.z < 0) n.xy = (1 - abs(n.yx)) * vec2(n.x >= 0 ? 1 : -1, n.y >= 0 ? 1 : -1);
+   return normalize(n);
+}
+
+float GridHeight(ivec2 p) {
+   return texelFetch(heights, clamp(p, ivec2(0), gridSize), 0).r * heightScale;
+}
+
+// Vertex of the procedural grid, corners in the order VertexMesh::Init uses
+void GridVertex(out vec4 pos, out vec4 normal) {
+   int quad = gl_VertexID / 6, corner = gl_VertexID % 6;
+   ivec2 p = ivec2(quad % gridSize.x, quad / gridSize.x);
+   p += ivec2(corner == 2 || corner == 3 || corner == 5, corner == 1 || corner == 4 || corner == 5);
+   vec2 cells = vec2(gridSize) / 2.0;
+   pos = vec4(vec2(p) / cells - 1, GridHeight(p), 1);
+   float dx = GridHeight(p + ivec2(1, 0)) - GridHeight(p - ivec2(1, 0));
+   float dy = GridHeight(p + ivec2(0, 1)) - GridHeight(p - ivec2(0, 1));
+   normal = vec4(normalize(vec3(-dx * cells.x, -dy * cells.y, 2)), 0);
+}
+
 void main() {
+   vec4 pos = vPos, norm = vNormal;
+   if (gridSize.x > 0) GridVertex(pos, norm);
+   else if (pulled) {
+     PoolVertex v = vertices[gl_VertexID];
+     pos = vec4(v.position.xyz, 1);
+     norm = vec4(v.normal.xyz, 0);
+   } else if (octNormals) norm = vec4(OctDecode(vOctNormal), 0);
+   Instance inst = instances[instanceIndex];
+   mat4 MVP = VP * inst.model;
+   float t = iTime + inst.timeOffset;
    vec4 lightPos = MVP * vec4(0, 0, 2, 1);
-   vec4 lightVec = lightPos - vPos;
+   vec4 lightVec = lightPos - pos;
    vec4 lightDir = normalize(lightVec); 
    float lightDis = dot(lightVec, lightVec);
-   vec4 normal = MVP * vNormal;
+   vec4 normal = MVP * norm;
    float theta = max(dot(normal, lightDir),0);
-   gl_Position =  vec4((MVP * vPos).xyz, 1);
-   fColor = 5 * vec4(1, cos(iTime), -sin(iTime), 1) * theta / (lightDis * lightDis);
+   gl_Position =  vec4((MVP * pos).xyz, 1);
+   fColor = 5 * vec4(1, cos(t), -sin(t), 1) * inst.color * theta / (lightDis * lightDis);
    fColor += vec4(0.1f);
 })";
 
@@ -137,157 +251,234 @@ void main(){
   color = fColor;
 })";
 
+// Flat normal pass of VertexMesh. One invocation per triangle overwrites
+// the normals of its 3 interleaved MeshLayout records in place. With the
+// CPU backend CpuFlatNormals works on a copy of the records read back once
+// and uploads them, the buffer needs GL_DYNAMIC_STORAGE_BIT then.
 struct ComputeShader {
-  bool initialized;
-  GLuint program;
-  GLuint compute_shader;
-  GLuint input_buffer;
-  GLuint output_buffer;
-  GLuint source;
-  GLuint target;
-  size_t buf_size;
   static const char* src;
+  GlProgram program;
+  GLuint buffer;
+  GLint triangleCount;
+  size_t triangles;
+  ComputeBackend backend = COMPUTE_GL;
+  std::vector<float> records; // CPU backend
 
   ComputeShader() {}
-  void Init(GLuint source, GLuint target, size_t buf_size) {
-    this->source = source;
-    this->target = target;
-    this->buf_size = buf_size;
-    program = glCreateProgram();
-    compute_shader = CompileShader(GL_COMPUTE_SHADER, &src);
-    glAttachShader(program, compute_shader);
-    glLinkProgram(program);
-
-
-    // Generate input buffer
-    glGenBuffers(1, &input_buffer);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, input_buffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, buf_size, NULL, GL_STATIC_DRAW);
-
-    // Map input buffer and fill it
-    /*
-    GLint bufMask = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT; 
-    float* data = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, buf_size, bufMask);
-
-    for(int i=0; i<64; i++)
-    {
-      //data[i] = (float)i;
-      data[i] = -429;
-    }
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-    */
-
+  void Init(GLuint buffer, size_t triangles) {
+    this->buffer = buffer;
+    this->triangles = triangles;
+    program = LinkProgram({ CompileShader(GL_COMPUTE_SHADER, &src) });
+    triangleCount = glGetUniformLocation(program, "triangles");
+    records.clear();
+    SetBackend(ComputeBackendFromEnv());
+  }
 
-    // Generate outpt buffer and allocate size
-    glGenBuffers(1, &output_buffer);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, output_buffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, buf_size, NULL, GL_STATIC_DRAW);
+  void SetBackend(ComputeBackend b) {
+    backend = b;
+    if (b != COMPUTE_CPU || !records.empty()) return;
+    records.resize(triangles * 24);
+    glGetNamedBufferSubData(buffer, 0, records.size() * sizeof(float), records.data());
   }
 
   void Run() { 
-    // Copy source data to the shader data
-    glCopyNamedBufferSubData(source, input_buffer, 0, 0, buf_size);
-
-    // Match buffer objects to shader mounts
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, input_buffer);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, output_buffer);
-
-    glUseProgram(program); 
-    int job_count = buf_size / (sizeof(vec3) * 3);
-
-    glDispatchCompute(job_count / WORK_GROUP_SIZE, 1, 1);
-    
-    // Ensure all writes of previous shaders have completed
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-
-    // Copy result back to output buffer
-    glCopyNamedBufferSubData(output_buffer, target, 0, 0, buf_size);
+    Dispatch();
+    // Ensure the normals are written before the vertex fetch reads them
+    if (backend == COMPUTE_GL) glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  }
 
-    // Mount the result buffer and print it
-    glBindBuffer(GL_ARRAY_BUFFER, output_buffer);
+  // Run without the barrier, for a FrameGraph pass
+  void Dispatch() {
+    if (backend == COMPUTE_CPU) {
+      CpuFlatNormals(records.data(), triangles);
+      glNamedBufferSubData(buffer, 0, records.size() * sizeof(float), records.data());
+      return;
+    }
+    GlState().BindStorageBuffer(4, buffer);
+    GlState().UseProgram(program);
+    glUniform1ui(triangleCount, triangles);
+    glDispatchCompute((triangles + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
   }
 };
 
 const char* ComputeShader::src = R"(
 # version 430 core
 layout(local_size_x = 8, local_size_y = 1) in;
-layout(std430, binding=4) buffer inBuf
-{
-  vec3 vertices[];
+struct MeshVertex {
+  vec4 position;
+  vec4 normal;
 };
-
-layout(std430, binding=5) buffer outBuf
+layout(std430, binding=4) buffer Vertices
 {
-  vec3 normals[];
+  MeshVertex vertices[];
 };
+uniform uint triangles;
 
 void main() {
+  if (gl_GlobalInvocationID.x >= triangles) return;
   uint pos = gl_GlobalInvocationID.x * 3;
-  vec3 p1 = vertices[pos + 0];
-  vec3 p2 = vertices[pos + 1];
-  vec3 p3 = vertices[pos + 2];
+  vec3 p1 = vertices[pos + 0].position.xyz;
+  vec3 p2 = vertices[pos + 1].position.xyz;
+  vec3 p3 = vertices[pos + 2].position.xyz;
 
   vec3 v1 = p1 - p2;
   vec3 v2 = p3 - p2;
 
-  vec3 n = normalize(cross(v1, v2));
-  normals[pos + 0] = n; 
-  normals[pos + 1] = n; 
-  normals[pos + 2] = n; 
+  vec4 n = vec4(normalize(cross(v1, v2)), 0);
+  vertices[pos + 0].normal = n; 
+  vertices[pos + 1].normal = n; 
+  vertices[pos + 2].normal = n; 
 }
 )";
 
+// Normal pass for packed meshes. Works in place on the interleaved 12 byte
+// PackedVertex records, seen as 3 uints per vertex: decodes the triangle's
+// positions, then overwrites the octahedral normal word of its 3 vertices.
+struct PackedNormalShader {
+  static const char* src;
+  GlProgram program;
+  GLuint buffer;
+  GLint halfPositions, triangleCount;
+  size_t triangles;
+  bool half;
+
+  PackedNormalShader() {}
+  // positionFormat is GL_HALF_FLOAT or GL_SHORT, as in PackVertex
+  void Init(GLuint buffer, size_t triangles, GLenum positionFormat) {
+    this->buffer = buffer;
+    this->triangles = triangles;
+    half = positionFormat == GL_HALF_FLOAT;
+    program = LinkProgram({ CompileShader(GL_COMPUTE_SHADER, &src) });
+    halfPositions = glGetUniformLocation(program, "halfPositions");
+    triangleCount = glGetUniformLocation(program, "triangles");
+  }
+
+  void Run() {
+    Dispatch();
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  }
+
+  void Dispatch() {
+    GlState().BindStorageBuffer(4, buffer);
+    GlState().UseProgram(program);
+    glUniform1i(halfPositions, half);
+    glUniform1ui(triangleCount, triangles);
+    glDispatchCompute((triangles + 63) / 64, 1, 1);
+  }
+};
+
+const char* PackedNormalShader::src = R"(
+#version 430 core
+layout(local_size_x = 64) in;
+layout(std430, binding = 4) buffer Packed {
+  uint words[];
+};
+uniform bool halfPositions;
+uniform uint triangles;
+
+vec3 Position(uint v) {
+  vec2 xy = halfPositions ? unpackHalf2x16(words[3*v]) : unpackSnorm2x16(words[3*v]);
+  vec2 z = halfPositions ? unpackHalf2x16(words[3*v + 1]) : unpackSnorm2x16(words[3*v + 1]);
+  return vec3(xy, z.x);
+}
+
+// Same as oct_encode in vertexpack.h
+vec2 OctEncode(vec3 n) {
+  vec2 e = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+  if (n.z < 0) e = (1 - abs(e.yx)) * vec2(e.x >= 0 ? 1 : -1, e.y >= 0 ? 1 : -1);
+  return e;
+}
+
+void main() {
+  uint t = gl_GlobalInvocationID.x;
+  if (t >= triangles) return;
+  vec3 p1 = Position(3*t + 0);
+  vec3 p2 = Position(3*t + 1);
+  vec3 p3 = Position(3*t + 2);
+  uint n = packSnorm2x16(OctEncode(normalize(cross(p1 - p2, p3 - p2))));
+  words[9*t + 2] = n;
+  words[9*t + 5] = n;
+  words[9*t + 8] = n;
+}
+)";
+
+// Chromatic aberration of src_tex. Run() writes tex, made on first use so
+// a FrameGraph that hands Dispatch() its own output never allocates it.
+// The output is stored as `format`, its qualifier generated in the shader.
+// The CPU backend reads src_tex back once, runs CpuChromatic into `pixels`
+// and uploads them.
 struct TextureComputeShader {
   static const char* src;
   GLuint src_tex;
-  GLuint tex;
-  GLuint shader;
-  GLuint program;
+  GlTexture tex;
+  GlProgram program;
   GLuint w;
   GLuint h;
+  GLenum format;
   GLint iTime, iSize;
+  ComputeBackend backend = COMPUTE_GL;
+  std::vector<float> source, pixels; // CPU backend
 
-  void Init(GLuint src_tex, int w, int h) {
+  void Init(GLuint src_tex, int w, int h, GLenum format = GL_RGBA32F) {
     this->src_tex = src_tex;
     this->w = w;
     this->h = h;
+    this->format = format;
 
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
-
-    glBindImageTexture(0, src_tex, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
-    glBindImageTexture(1, tex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-
-    shader = CompileShader(GL_COMPUTE_SHADER, &src);
-    program = glCreateProgram();
-    glAttachShader(program, shader);
-    glLinkProgram(program);
+    // a source of the same size again gets the same texture back
+    GlPool().Recycle(tex);
 
+    std::string text = std::string("#version 450 core\n#define OUTPUT_FORMAT ") + ImageFormatQualifier(format) + src;
+    const char* code = text.c_str();
+    program = LinkProgram({ CompileShader(GL_COMPUTE_SHADER, &code) });
 
     iTime = glGetUniformLocation(program, "iTime");
     iSize = glGetUniformLocation(program, "img_size");
+    source.clear();
+    SetBackend(ComputeBackendFromEnv());
+  }
+
+  void SetBackend(ComputeBackend b) {
+    backend = b;
+    if (b != COMPUTE_CPU || !source.empty()) return;
+    source.resize(w * h * 4);
+    pixels.resize(w * h * 4);
+    glGetTextureImage(src_tex, 0, GL_RGBA, GL_FLOAT, source.size() * sizeof(float), source.data());
   }
 
   void Run(float time) {
-    glUseProgram(program);
+    if (!tex) {
+      tex = GlPool().AcquireTexture(MEM_EFFECTS, format, w, h);
+      glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+    Dispatch(time, tex);
+    // the output is sampled, not loaded as an image
+    if (backend == COMPUTE_GL) glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  }
+
+  // Writes a w x h `output` of the format, without a barrier
+  void Dispatch(float time, GLuint output) {
+    if (backend == COMPUTE_CPU) {
+      CpuChromatic(pixels.data(), source.data(), w, h, time);
+      glTextureSubImage2D(output, 0, 0, 0, w, h, GL_RGBA, GL_FLOAT, pixels.data());
+      return;
+    }
+    GlState().UseProgram(program);
+    GlState().BindImageTexture(0, src_tex, 0, GL_READ_ONLY, GL_RGBA32F);
+    GlState().BindImageTexture(1, output, 0, GL_WRITE_ONLY, format);
     glUniform1f(iTime, time);
     glUniform2i(iSize, w, h);
     glDispatchCompute(w, h, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
   }
 };
 
 const char* TextureComputeShader::src = R"(
-  #version 450 core
   layout(local_size_x = 1, local_size_y = 1) in;
   layout(rgba32f, binding = 0) uniform image2D img_input;
-  layout(rgba32f, binding = 1) uniform image2D img_output;
+  layout(OUTPUT_FORMAT, binding = 1) uniform image2D img_output;
   uniform float iTime;
   uniform ivec2 img_size;
 
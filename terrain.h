@@ -0,0 +1,575 @@
+#include <vector>
+#include <math.h>
+#include <float.h>
+#include "threadpool.h"
+#include "meshopt.h"
+
+// Hash based value noise in [0, 1)
+static inline float HashNoise(int x, int y, uint32_t seed) {
+  uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u + seed * 2246822519u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  h ^= h >> 16;
+  return (h & 0xffffff) * (1.0f / 16777216.0f);
+}
+
+static inline float ValueNoise(float x, float y, uint32_t seed) {
+  int ix = (int)floorf(x), iy = (int)floorf(y);
+  float fx = x - ix, fy = y - iy;
+  fx = fx * fx * (3 - 2 * fx);
+  fy = fy * fy * (3 - 2 * fy);
+  float a = HashNoise(ix, iy, seed), b = HashNoise(ix + 1, iy, seed);
+  float c = HashNoise(ix, iy + 1, seed), d = HashNoise(ix + 1, iy + 1, seed);
+  return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fy;
+}
+
+// Square heightfield of (size+1)^2 samples in [0, 1]. Sample (x, y) sits at
+// world (x * spacing, y * spacing, height * scale), z is up.
+struct Heightfield {
+  uint32_t size;
+  float spacing;
+  float scale;
+  std::vector<float> heights;
+  GlTexture tex;
+
+  Heightfield() {}
+
+  float At(uint32_t x, uint32_t y) const { return heights[y * (size + 1) + x]; }
+  size_t Bytes() const { return heights.size() * sizeof(float); }
+
+  // Fractal value noise, features about 256 samples across
+  void Generate(uint32_t size, float spacing, float scale, uint32_t seed = 1) {
+    this->size = size;
+    this->spacing = spacing;
+    this->scale = scale;
+    uint32_t n = size + 1;
+    heights.resize((size_t)n * n);
+    const int Octaves = 6;
+    float norm = 0;
+    for(int o=0; o<Octaves; o++) norm += 1.0f / (1 << o);
+    ParallelFor(n, 16, [&](size_t b, size_t e) {
+      for(size_t y=b; y<e; y++)
+        for(uint32_t x=0; x<n; x++) {
+          float h = 0, f = 1.0f / 256;
+          for(int o=0; o<Octaves; o++, f *= 2)
+            h += ValueNoise(x * f, y * f, seed + o) / (1 << o);
+          heights[y * n + x] = h / norm;
+        }
+    });
+  }
+
+  void Upload() {
+    GlPool().Recycle(tex);
+    tex = GlPool().AcquireTexture(MEM_TERRAIN, GL_R32F, size + 1, size + 1);
+    glTextureSubImage2D(tex, 0, 0, 0, size + 1, size + 1, GL_RED, GL_FLOAT, heights.data());
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  }
+};
+
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// Patch grid position in [0, 1]^2, shared by CdlodTerrain and TessTerrain
+typedef VertexLayout<Attr<0, 2, GL_FLOAT>> PatchLayout;
+
+// Continuous distance-dependent LOD terrain (CDLOD). The heightfield is
+// covered by a quadtree whose nodes all draw the same PatchSize^2 grid,
+// scaled to the node, so one vertex and one index buffer serve every level.
+// Each level has a range in which its quads stay under `pixelError` pixels
+// on screen; Select() walks the tree and keeps the coarsest node that is in
+// range, or just the quadrants of it whose children are not. Vertices morph
+// onto the grid of the next coarser level as they approach the end of their
+// range, so neighbours that differ by a level meet without cracks.
+// All selected nodes go out in one glMultiDrawElementsIndirect; the node
+// position and level is an instanced attribute indexed by baseInstance.
+struct CdlodTerrain {
+  static const uint32_t PatchSize = 32;
+  static const int MaxLevels = 16;
+  static const char* vs;
+  static const char* fs;
+
+  struct Node {
+    float x, y;  // first sample
+    float size;  // samples across
+    float level;
+  };
+  // a Node per instance
+  typedef VertexLayout<Attr<1, 4, GL_FLOAT>> NodeLayout;
+  static_assert(NodeLayout::stride == sizeof(Node), "NodeLayout must match Node");
+  struct MinMax {
+    float lo, hi;
+  };
+
+  Heightfield* field;
+  int levels;
+  std::vector<MinMax> bounds[MaxLevels]; // per level, nodes row by row
+  float ranges[MaxLevels];
+  float morph[MaxLevels][2];             // morph start and end distance
+
+  GlProgram program;
+  GLint VP, camera, morphLoc, patchSize, mapSize, spacing, scale;
+  GlVertexArray vao;
+  GlBuffer vertexBuffer, indexBuffer;
+  // per frame node and command streams, pool buffers of power of two
+  // sizes that are only replaced when the selection outgrows them
+  GlBuffer nodeBuffer, commandBuffer;
+  size_t nodeCapacity, commandCapacity;
+  GLuint indexCount;
+
+  std::vector<Node> nodes;
+  std::vector<DrawElementsIndirectCommand> commands;
+  size_t triangles;
+
+  CdlodTerrain() {}
+
+  void Init(Heightfield& field) {
+    this->field = &field;
+    levels = 1;
+    while ((PatchSize << (levels - 1)) < field.size) levels++;
+    if ((PatchSize << (levels - 1)) != field.size || levels > MaxLevels)
+      throw std::runtime_error("CdlodTerrain: heightfield size must be PatchSize * 2^n");
+    BuildBounds();
+
+    program = LinkProgram({ CompileShader(GL_VERTEX_SHADER, &vs), CompileShader(GL_FRAGMENT_SHADER, &fs) });
+    VP = glGetUniformLocation(program, "VP");
+    camera = glGetUniformLocation(program, "camera");
+    morphLoc = glGetUniformLocation(program, "morph");
+    patchSize = glGetUniformLocation(program, "patchSize");
+    mapSize = glGetUniformLocation(program, "mapSize");
+    spacing = glGetUniformLocation(program, "spacing");
+    scale = glGetUniformLocation(program, "heightScale");
+
+    std::vector<float> grid;
+    std::vector<uint16_t> indices;
+    BuildPatch(grid, indices, true);
+    indexCount = indices.size();
+
+    GlPool().Recycle(vertexBuffer);
+    GlPool().Recycle(indexBuffer);
+    GlPool().Recycle(nodeBuffer);
+    GlPool().Recycle(commandBuffer);
+    nodeCapacity = commandCapacity = 0;
+    vertexBuffer = GlPool().AcquireBuffer(MEM_TERRAIN, grid.size() * sizeof(float), grid.data());
+    indexBuffer = GlPool().AcquireBuffer(MEM_TERRAIN, indices.size() * sizeof(uint16_t), indices.data());
+
+    vao = CreateVertexArray();
+    PatchLayout::Apply(vao, 0);
+    PatchLayout::Bind(vao, 0, vertexBuffer);
+    glVertexArrayElementBuffer(vao, indexBuffer);
+    NodeLayout::Apply(vao, 1, 1);
+
+    SetView(60.0f * (float)M_PI / 180.0f, 1080, 2.0f);
+    triangles = 0;
+  }
+
+  // Patch grid in [0, 1]^2, indices ordered by quadrant so a quadrant can
+  // be drawn on its own. `optimize` reorders the triangles of each quadrant
+  // for the vertex cache and then the vertices for fetch locality.
+  static void BuildPatch(std::vector<float>& grid, std::vector<uint16_t>& indices, bool optimize) {
+    const uint32_t n = PatchSize + 1, half = PatchSize / 2;
+    grid.clear();
+    for(uint32_t y=0; y<n; y++)
+      for(uint32_t x=0; x<n; x++) {
+        grid.push_back((float)x / PatchSize);
+        grid.push_back((float)y / PatchSize);
+      }
+    indices.clear();
+    for(uint32_t q=0; q<4; q++)
+      for(uint32_t y=(q >> 1) * half; y<((q >> 1) + 1) * half; y++)
+        for(uint32_t x=(q & 1) * half; x<((q & 1) + 1) * half; x++) {
+          uint16_t a = y * n + x, b = a + 1, c = a + n, d = c + 1;
+          uint16_t quad[6] = { a, b, d, a, d, c };
+          indices.insert(indices.end(), quad, quad + 6);
+        }
+    if (!optimize) return;
+    size_t quadrant = indices.size() / 4;
+    std::vector<uint16_t> sorted(indices.size());
+    for(uint32_t q=0; q<4; q++)
+      OptimizeVertexCache(&sorted[q * quadrant], &indices[q * quadrant], quadrant, n * n);
+    indices.swap(sorted);
+    OptimizeVertexFetch(grid.data(), 2 * sizeof(float), indices.data(), indices.size(), n * n);
+  }
+
+  // Height range of every node, bottom up
+  void BuildBounds() {
+    for(int l=0; l<levels; l++) {
+      uint32_t count = field->size / (PatchSize << l);
+      bounds[l].resize((size_t)count * count);
+      for(uint32_t ny=0; ny<count; ny++)
+        for(uint32_t nx=0; nx<count; nx++) {
+          MinMax mm = { FLT_MAX, -FLT_MAX };
+          if (l == 0) {
+            for(uint32_t y=ny*PatchSize; y<=(ny+1)*PatchSize; y++)
+              for(uint32_t x=nx*PatchSize; x<=(nx+1)*PatchSize; x++) {
+                float h = field->At(x, y);
+                mm.lo = fminf(mm.lo, h);
+                mm.hi = fmaxf(mm.hi, h);
+              }
+          } else {
+            for(uint32_t q=0; q<4; q++) {
+              const MinMax& c = bounds[l-1][(2*ny + (q >> 1)) * 2 * count + 2*nx + (q & 1)];
+              mm.lo = fminf(mm.lo, c.lo);
+              mm.hi = fmaxf(mm.hi, c.hi);
+            }
+          }
+          bounds[l][ny * count + nx] = mm;
+        }
+    }
+  }
+
+  // Level ranges for a projection with vertical field of view fovY onto
+  // viewportHeight pixels: a quad of level l spans pixelError pixels at
+  // distance ranges[l]. The last level covers everything beyond.
+  void SetView(float fovY, float viewportHeight, float pixelError) {
+    float k = viewportHeight / (2 * tanf(fovY / 2)) / pixelError;
+    float prev = 0;
+    for(int l=0; l<levels; l++) {
+      if (l == levels - 1) {
+        ranges[l] = FLT_MAX;
+        morph[l][0] = 1e30f;
+        morph[l][1] = 2e30f;
+        break;
+      }
+      ranges[l] = field->spacing * (1 << l) * k;
+      morph[l][0] = prev + (ranges[l] - prev) * 0.7f;
+      morph[l][1] = ranges[l];
+      prev = ranges[l];
+    }
+  }
+
+  static bool BoxInFrustum(vec4 planes[6], const float lo[3], const float hi[3]) {
+    for(int i=0; i<6; i++) {
+      float d = planes[i][3];
+      for(int k=0; k<3; k++) d += planes[i][k] * (planes[i][k] > 0 ? hi[k] : lo[k]);
+      if (d < 0) return false;
+    }
+    return true;
+  }
+
+  static bool BoxInSphere(const float lo[3], const float hi[3], vec3 center, float r) {
+    float d2 = 0;
+    for(int k=0; k<3; k++) {
+      float d = fmaxf(fmaxf(lo[k] - center[k], 0), center[k] - hi[k]);
+      d2 += d * d;
+    }
+    return d2 <= r * r;
+  }
+
+  // quadrant < 0 adds the whole node
+  void Add(int level, uint32_t nx, uint32_t ny, int quadrant) {
+    float size = (float)(PatchSize << level);
+    Node node = { nx * size, ny * size, size, (float)level };
+    DrawElementsIndirectCommand c = { indexCount, 1, 0, 0, (GLuint)nodes.size() };
+    if (quadrant >= 0) {
+      c.count = indexCount / 4;
+      c.firstIndex = quadrant * c.count;
+    }
+    nodes.push_back(node);
+    commands.push_back(c);
+    triangles += c.count / 3;
+  }
+
+  // Returns false when the node is out of its level's range, the parent
+  // then draws its area
+  bool SelectNode(int level, uint32_t nx, uint32_t ny, vec4 planes[6], vec3 eye) {
+    uint32_t size = PatchSize << level;
+    const MinMax& mm = bounds[level][ny * (field->size / size) + nx];
+    float lo[3] = { nx * size * field->spacing, ny * size * field->spacing, mm.lo * field->scale };
+    float hi[3] = { (nx + 1) * size * field->spacing, (ny + 1) * size * field->spacing, mm.hi * field->scale };
+
+    if (!BoxInFrustum(planes, lo, hi)) return true;
+    if (!BoxInSphere(lo, hi, eye, ranges[level])) return false;
+    if (level == 0 || !BoxInSphere(lo, hi, eye, ranges[level-1])) {
+      Add(level, nx, ny, -1);
+      return true;
+    }
+    for(int q=0; q<4; q++)
+      if (!SelectNode(level - 1, 2*nx + (q & 1), 2*ny + (q >> 1), planes, eye))
+        Add(level, nx, ny, q);
+    return true;
+  }
+
+  void Select(mat4x4 vp, vec3 eye) {
+    nodes.clear();
+    commands.clear();
+    triangles = 0;
+    vec4 planes[6];
+    frustum_planes(planes, vp);
+    SelectNode(levels - 1, 0, 0, planes, eye);
+  }
+
+  // GPU memory besides the height texture
+  size_t Bytes() const {
+    return (PatchSize + 1) * (PatchSize + 1) * 2 * sizeof(float) + indexCount * sizeof(uint16_t)
+        + nodes.size() * sizeof(Node) + commands.size() * sizeof(DrawElementsIndirectCommand);
+  }
+
+  static void Stream(GlBuffer& buffer, size_t& capacity, const void* data, size_t size) {
+    if (size > capacity) {
+      capacity = 256;
+      while (capacity < size) capacity *= 2;
+      GlPool().Recycle(buffer);
+      buffer = GlPool().AcquireBuffer(MEM_TERRAIN, capacity);
+    }
+    glNamedBufferSubData(buffer, 0, size, data);
+  }
+
+  void Draw(mat4x4 vp, vec3 eye) {
+    if (commands.empty()) return;
+    Stream(nodeBuffer, nodeCapacity, nodes.data(), nodes.size() * sizeof(Node));
+    Stream(commandBuffer, commandCapacity, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+    NodeLayout::Bind(vao, 1, nodeBuffer);
+
+    GlState().UseProgram(program);
+    glUniformMatrix4fv(VP, 1, GL_FALSE, (const GLfloat*)vp);
+    glUniform3fv(camera, 1, eye);
+    glUniform2fv(morphLoc, levels, (const GLfloat*)morph);
+    glUniform1f(patchSize, PatchSize);
+    glUniform1f(mapSize, field->size + 1);
+    glUniform1f(spacing, field->spacing);
+    glUniform1f(scale, field->scale);
+    GlState().BindTextureUnit(0, field->tex);
+
+    GlState().BindVertexArray(vao);
+    GlState().BindIndirectBuffer(commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)0, commands.size(), 0);
+  }
+};
+
+const char* CdlodTerrain::vs = R"(
+#version 430 core
+layout(location = 0) in vec2 gridPos;
+layout(location = 1) in vec4 node;
+layout(binding = 0) uniform sampler2D heightmap;
+uniform mat4 VP;
+uniform vec3 camera;
+uniform vec2 morph[16];
+uniform float patchSize;
+uniform float mapSize;
+uniform float spacing;
+uniform float heightScale;
+out vec3 fNormal;
+out float fHeight;
+
+float Height(vec2 p) {
+  return texture(heightmap, (p + 0.5) / mapSize).r * heightScale;
+}
+
+void main() {
+  vec2 p = node.xy + gridPos * node.z;
+  float dist = distance(camera, vec3(p * spacing, Height(p)));
+  vec2 range = morph[int(node.w)];
+  float k = clamp((dist - range.x) / (range.y - range.x), 0, 1);
+
+  // odd grid lines slide onto the even ones, the coarser level's grid
+  vec2 g = gridPos * patchSize;
+  g -= fract(g * 0.5) * 2.0 * k;
+  p = node.xy + g / patchSize * node.z;
+
+  float step = node.z / patchSize;
+  float dx = Height(p + vec2(step, 0)) - Height(p - vec2(step, 0));
+  float dy = Height(p + vec2(0, step)) - Height(p - vec2(0, step));
+  fNormal = normalize(vec3(-dx, -dy, 2 * step * spacing));
+  fHeight = Height(p) / heightScale;
+  gl_Position = VP * vec4(p * spacing, Height(p), 1);
+})";
+
+const char* CdlodTerrain::fs = R"(
+#version 430 core
+in vec3 fNormal;
+in float fHeight;
+out vec4 color;
+void main() {
+  vec3 light = normalize(vec3(0.4, 0.3, 0.8));
+  vec3 albedo = mix(vec3(0.2, 0.35, 0.15), vec3(0.55, 0.5, 0.45), smoothstep(0.4, 0.7, fHeight));
+  color = vec4(albedo * (0.2 + 0.8 * max(dot(normalize(fNormal), light), 0)), 1);
+})";
+
+// Terrain amplified by the tessellator. Only a coarse grid of quad patches,
+// PatchSamples heightfield samples across, lives in a buffer. The control
+// shader sets each edge's level from the on-screen size of the edge so that
+// its segments span about `edgePixels` pixels; a level only depends on the
+// edge's own end points, so neighbouring patches agree and there are no
+// cracks. Patches outside the frustum get level 0 and are dropped. The
+// evaluation shader displaces the generated vertices from the height texture.
+struct TessTerrain {
+  static const uint32_t PatchSamples = 64;
+  static const char* vs;
+  static const char* tcs;
+  static const char* tes;
+  static const char* fs;
+
+  Heightfield* field;
+  GlProgram program;
+  GLint VP, planes, projScale, edgePixels, mapSize, spacing, scale;
+  GlVertexArray vao;
+  GlBuffer vertexBuffer;
+  GLsizei vertexCount;
+  float pixelsPerUnit; // pixels per world unit at distance 1
+  float targetPixels;
+
+  TessTerrain() {}
+
+  void Init(Heightfield& field) {
+    this->field = &field;
+    if (field.size % PatchSamples)
+      throw std::runtime_error("TessTerrain: heightfield size must be a multiple of PatchSamples");
+
+    program = LinkProgram({
+      CompileShader(GL_VERTEX_SHADER, &vs),
+      CompileShader(GL_TESS_CONTROL_SHADER, &tcs),
+      CompileShader(GL_TESS_EVALUATION_SHADER, &tes),
+      CompileShader(GL_FRAGMENT_SHADER, &fs),
+    });
+    VP = glGetUniformLocation(program, "VP");
+    planes = glGetUniformLocation(program, "planes");
+    projScale = glGetUniformLocation(program, "projScale");
+    edgePixels = glGetUniformLocation(program, "edgePixels");
+    mapSize = glGetUniformLocation(program, "mapSize");
+    spacing = glGetUniformLocation(program, "spacing");
+    scale = glGetUniformLocation(program, "heightScale");
+
+    // corners of each patch in sample coordinates, counter-clockwise
+    uint32_t count = field.size / PatchSamples;
+    std::vector<float> corners;
+    for(uint32_t y=0; y<count; y++)
+      for(uint32_t x=0; x<count; x++) {
+        float x0 = x * PatchSamples, y0 = y * PatchSamples, x1 = x0 + PatchSamples, y1 = y0 + PatchSamples;
+        float quad[8] = { x0, y0, x1, y0, x1, y1, x0, y1 };
+        corners.insert(corners.end(), quad, quad + 8);
+      }
+    vertexCount = corners.size() / 2;
+
+    GlPool().Recycle(vertexBuffer);
+    vertexBuffer = GlPool().AcquireBuffer(MEM_TERRAIN, corners.size() * sizeof(float), corners.data());
+    vao = CreateVertexArray();
+    PatchLayout::Apply(vao, 0);
+    PatchLayout::Bind(vao, 0, vertexBuffer);
+
+    SetView(60.0f * (float)M_PI / 180.0f, 1080, 8.0f);
+  }
+
+  // Same parameters as CdlodTerrain::SetView, except that edgePixels is the
+  // length the tessellated edges should have on screen
+  void SetView(float fovY, float viewportHeight, float edgePixels) {
+    pixelsPerUnit = viewportHeight / (2 * tanf(fovY / 2));
+    targetPixels = edgePixels;
+  }
+
+  size_t Bytes() const { return vertexCount * 2 * sizeof(float); }
+
+  void Draw(mat4x4 vp) {
+    vec4 frustum[6];
+    frustum_planes(frustum, vp);
+
+    GlState().UseProgram(program);
+    glUniformMatrix4fv(VP, 1, GL_FALSE, (const GLfloat*)vp);
+    glUniform4fv(planes, 6, (const GLfloat*)frustum);
+    glUniform1f(projScale, pixelsPerUnit);
+    glUniform1f(edgePixels, targetPixels);
+    glUniform1f(mapSize, field->size + 1);
+    glUniform1f(spacing, field->spacing);
+    glUniform1f(scale, field->scale);
+    GlState().BindTextureUnit(0, field->tex);
+
+    GlState().BindVertexArray(vao);
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    glDrawArrays(GL_PATCHES, 0, vertexCount);
+  }
+};
+
+const char* TessTerrain::vs = R"(
+#version 430 core
+layout(location = 0) in vec2 corner;
+out vec2 vSample;
+void main() {
+  vSample = corner;
+})";
+
+const char* TessTerrain::tcs = R"(
+#version 430 core
+layout(vertices = 4) out;
+layout(binding = 0) uniform sampler2D heightmap;
+in vec2 vSample[];
+out vec2 tcSample[];
+uniform mat4 VP;
+uniform vec4 planes[6];
+uniform float projScale;
+uniform float edgePixels;
+uniform float mapSize;
+uniform float spacing;
+uniform float heightScale;
+
+vec3 World(vec2 s) {
+  return vec3(s * spacing, texture(heightmap, (s + 0.5) / mapSize).r * heightScale);
+}
+
+// Screen size of the sphere around the edge, independent of its direction
+float Level(vec2 a, vec2 b) {
+  vec3 pa = World(a), pb = World(b);
+  vec4 clip = VP * vec4((pa + pb) * 0.5, 1);
+  float pixels = distance(pa, pb) * projScale / max(clip.w, 1e-3);
+  return clamp(pixels / edgePixels, 1, 64);
+}
+
+bool Visible() {
+  vec3 lo = vec3(min(vSample[0], vSample[2]) * spacing, 0);
+  vec3 hi = vec3(max(vSample[0], vSample[2]) * spacing, heightScale);
+  for(int i=0; i<6; i++) {
+    vec3 p = mix(lo, hi, greaterThan(planes[i].xyz, vec3(0)));
+    if (dot(planes[i].xyz, p) + planes[i].w < 0) return false;
+  }
+  return true;
+}
+
+void main() {
+  tcSample[gl_InvocationID] = vSample[gl_InvocationID];
+  if (gl_InvocationID != 0) return;
+
+  if (!Visible()) {
+    gl_TessLevelOuter[0] = gl_TessLevelOuter[1] = gl_TessLevelOuter[2] = gl_TessLevelOuter[3] = 0;
+    gl_TessLevelInner[0] = gl_TessLevelInner[1] = 0;
+    return;
+  }
+  gl_TessLevelOuter[0] = Level(vSample[3], vSample[0]);
+  gl_TessLevelOuter[1] = Level(vSample[0], vSample[1]);
+  gl_TessLevelOuter[2] = Level(vSample[1], vSample[2]);
+  gl_TessLevelOuter[3] = Level(vSample[2], vSample[3]);
+  gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+  gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+})";
+
+const char* TessTerrain::tes = R"(
+#version 430 core
+layout(quads, fractional_even_spacing, ccw) in;
+layout(binding = 0) uniform sampler2D heightmap;
+in vec2 tcSample[];
+out vec3 fNormal;
+out float fHeight;
+uniform mat4 VP;
+uniform float mapSize;
+uniform float spacing;
+uniform float heightScale;
+
+float Height(vec2 s) {
+  return texture(heightmap, (s + 0.5) / mapSize).r * heightScale;
+}
+
+void main() {
+  vec2 u = gl_TessCoord.xy;
+  vec2 s = mix(mix(tcSample[0], tcSample[1], u.x), mix(tcSample[3], tcSample[2], u.x), u.y);
+  float dx = Height(s + vec2(1, 0)) - Height(s - vec2(1, 0));
+  float dy = Height(s + vec2(0, 1)) - Height(s - vec2(0, 1));
+  fNormal = normalize(vec3(-dx, -dy, 2 * spacing));
+  fHeight = Height(s) / heightScale;
+  gl_Position = VP * vec4(s * spacing, Height(s), 1);
+})";
+
+const char* TessTerrain::fs = CdlodTerrain::fs;
@@ -0,0 +1,114 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+// Persistent worker pool used for chunked CPU work (pixel conversion, transform
+// updates, CPU compute backend). Work is handed out as [begin, end) ranges of
+// `grain` items, the calling thread participates too.
+struct ThreadPool {
+  typedef void (*RangeFn)(void* ctx, size_t begin, size_t end);
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool quit = false;
+  unsigned generation = 0;
+
+  // current job
+  RangeFn fn = nullptr;
+  void* ctx = nullptr;
+  size_t count = 0, grain = 1;
+  std::atomic<size_t> next{0};
+  std::atomic<unsigned> busy{0};
+
+  ThreadPool() {}
+  explicit ThreadPool(unsigned threads) { Init(threads); }
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    wake.notify_all();
+    for(auto& t : workers) t.join();
+  }
+
+  void Init(unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    // the caller is one of the threads
+    for(unsigned i=1; i<threads; i++)
+      workers.emplace_back([this]() { WorkerLoop(); });
+  }
+
+  unsigned Size() const { return workers.size() + 1; }
+
+  void Drain() {
+    for(;;) {
+      size_t b = next.fetch_add(grain);
+      if (b >= count) return;
+      size_t e = b + grain < count ? b + grain : count;
+      fn(ctx, b, e);
+    }
+  }
+
+  void WorkerLoop() {
+    unsigned seen = 0;
+    for(;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return quit || generation != seen; });
+        if (quit) return;
+        seen = generation;
+      }
+      Drain();
+      if (busy.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.notify_one();
+      }
+    }
+  }
+
+  void Run(size_t count, size_t grain, RangeFn fn, void* ctx) {
+    if (grain == 0) grain = 1;
+    if (workers.empty() || count <= grain) {
+      if (count) fn(ctx, 0, count);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      this->fn = fn;
+      this->ctx = ctx;
+      this->count = count;
+      this->grain = grain;
+      next = 0;
+      busy = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+    Drain();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return busy.load() == 0; });
+  }
+};
+
+inline ThreadPool& GlobalPool() {
+  static ThreadPool pool(0);
+  return pool;
+}
+
+// ParallelFor(n, grain, [&](size_t begin, size_t end) { ... });
+template<typename F>
+inline void ParallelFor(size_t count, size_t grain, const F& f) {
+  struct Thunk {
+    static void Call(void* ctx, size_t b, size_t e) { (*(const F*)ctx)(b, e); }
+  };
+  GlobalPool().Run(count, grain, &Thunk::Call, (void*)&f);
+}
+
+#endif // THREADPOOL_H
@@ -0,0 +1,147 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include "linmath_affine.h"
+#include "threadpool.h"
+
+typedef uint32_t TransformId;
+#define NO_TRANSFORM 0xffffffffu
+
+// Transform hierarchy for many objects. Every component lives in its own
+// array indexed by TransformId. `order` holds the ids sorted by depth, so a
+// parent is always finished before its children and all transforms of one
+// depth can be updated in parallel. Only transforms whose local matrix or
+// any ancestor changed are recomputed.
+struct TransformStore {
+  struct Affine { mat3x4 m; };
+
+  std::vector<TransformId> parent;
+  std::vector<uint32_t> depth;
+  std::vector<Affine> local;
+  std::vector<Affine> world;
+  std::vector<uint8_t> dirty;         // local changed since the last Update
+  std::vector<uint8_t> changed;       // world recomputed in the last Update
+  std::vector<uint32_t> changedFrame; // Update in which world last changed
+
+  std::vector<TransformId> order;
+  std::vector<uint32_t> levels;       // order[levels[d], levels[d+1]) have depth d
+  bool orderValid = false;
+  uint32_t frame = 0;
+
+  TransformStore() {}
+
+  size_t Count() const { return parent.size(); }
+
+  TransformId Create(TransformId p = NO_TRANSFORM) {
+    TransformId id = parent.size();
+    Affine identity;
+    mat3x4_identity(identity.m);
+    parent.push_back(p);
+    depth.push_back(0);
+    local.push_back(identity);
+    world.push_back(identity);
+    dirty.push_back(1);
+    changed.push_back(0);
+    changedFrame.push_back(0);
+    orderValid = false;
+    return id;
+  }
+
+  void SetParent(TransformId id, TransformId p) {
+    parent[id] = p;
+    dirty[id] = 1;
+    orderValid = false;
+  }
+
+  void SetLocal(TransformId id, mat3x4 m) {
+    mat3x4_dup(local[id].m, m);
+    dirty[id] = 1;
+  }
+
+  const Affine& World(TransformId id) const { return world[id]; }
+
+  void RebuildOrder() {
+    size_t n = parent.size();
+    // depth by walking up to the first ancestor with a known depth
+    std::vector<uint8_t> known(n, 0);
+    std::vector<TransformId> stack;
+    for(TransformId id=0; id<n; id++) {
+      TransformId x = id;
+      while (x != NO_TRANSFORM && !known[x]) {
+        stack.push_back(x);
+        x = parent[x];
+      }
+      uint32_t d = x == NO_TRANSFORM ? 0 : depth[x] + 1;
+      while (!stack.empty()) {
+        depth[stack.back()] = d++;
+        known[stack.back()] = 1;
+        stack.pop_back();
+      }
+    }
+
+    // counting sort by depth, ids stay ascending within a level
+    uint32_t maxDepth = 0;
+    for(size_t i=0; i<n; i++) if (depth[i] > maxDepth) maxDepth = depth[i];
+    levels.assign(maxDepth + 2, 0);
+    for(size_t i=0; i<n; i++) levels[depth[i] + 1]++;
+    for(size_t d=1; d<levels.size(); d++) levels[d] += levels[d-1];
+    order.resize(n);
+    std::vector<uint32_t> fill(levels.begin(), levels.end() - 1);
+    for(TransformId id=0; id<n; id++) order[fill[depth[id]]++] = id;
+
+    orderValid = true;
+  }
+
+  // Recomputes the world matrices that changed. When `out` is set, the world
+  // matrix of transform i is written as a column-major mat4 at
+  // out + i * stride, for the i below `capacity`, the records `out` holds;
+  // transforms past it are still updated but not written. With `copies` > 1
+  // the caller cycles through that many buffers, so a matrix is rewritten
+  // until every copy has seen its change. Returns the number of world
+  // matrices recomputed.
+  size_t Update(void* out = nullptr, size_t capacity = 0, size_t stride = 16 * sizeof(float), uint32_t copies = 1) {
+    if (!orderValid) RebuildOrder();
+    frame++;
+
+    std::atomic<size_t> updated{0};
+    for(size_t d=0; d+1<levels.size(); d++) {
+      uint32_t begin = levels[d], end = levels[d+1];
+      ParallelFor(end - begin, 1024, [&](size_t b, size_t e) {
+        size_t count = 0;
+        for(size_t i=begin+b; i<begin+e; i++) {
+          TransformId id = order[i];
+          TransformId p = parent[id];
+          bool c = dirty[id] || (p != NO_TRANSFORM && changed[p]);
+          changed[id] = c;
+          if (c) {
+            if (p == NO_TRANSFORM) mat3x4_dup(world[id].m, local[id].m);
+            else mat3x4_mul(world[id].m, world[p].m, local[id].m);
+            changedFrame[id] = frame;
+            count++;
+          }
+          if (out && id < capacity && frame - changedFrame[id] < copies)
+            WriteMat4((char*)out + id * stride, world[id].m);
+        }
+        updated += count;
+      });
+    }
+    memset(dirty.data(), 0, dirty.size());
+    return updated;
+  }
+
+  static void WriteMat4(void* dst, mat3x4 A) {
+    float m[16] = {
+      A[0][0], A[0][1], A[0][2], 0.f,
+      A[1][0], A[1][1], A[1][2], 0.f,
+      A[2][0], A[2][1], A[2][2], 0.f,
+      A[3][0], A[3][1], A[3][2], 1.f,
+    };
+    memcpy(dst, m, sizeof(m));
+  }
+};
+
+#endif // TRANSFORM_H
@@ -1,144 +1,449 @@
 #include <stdexcept>
+#include <vector>
+
+// Per-instance record, laid out like the std430 Instance struct in DefaultShader
+struct Instance {
+  mat4x4 model;
+  vec4 color;
+  float timeOffset;
+  float pad[3];
+};
+
+// Persistently mapped buffer of Instance records. It is split in `Copies`
+// regions used round robin, each guarded by a fence, so writing the next
+// frame never stalls on the GPU still reading the last one. Model matrices
+// are written every frame by the TransformStore; colors and time offsets
+// change rarely, so SetAttributes queues them for each region instead.
+// `ids` holds 0..capacity-1 and feeds the per-instance record index when
+// every instance is drawn; GpuCuller supplies a compacted list instead.
+struct InstanceBuffer {
+  static const int Copies = 3;
+  static const size_t stride = sizeof(Instance);
+  struct Attributes {
+    vec4 color;
+    float timeOffset;
+  };
+
+  GlBuffer buffer;
+  GlBuffer ids;
+  size_t capacity;
+  size_t regionSize;
+  char* mapped;
+  GlFence fences[Copies];
+  int current;
+  std::vector<Attributes> attributes;
+  std::vector<uint32_t> pending[Copies];
+
+  InstanceBuffer() {}
+  void Init(size_t capacity) {
+    this->capacity = capacity;
+    // regions must start on a valid SSBO offset
+    GLint align = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+    regionSize = (capacity * stride + align - 1) / align * align;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    buffer = CreateBuffer(MEM_INSTANCES, regionSize * Copies, NULL, flags);
+    mapped = (char*)glMapNamedBufferRange(buffer, 0, regionSize * Copies, flags);
+    for(int i=0; i<Copies; i++) fences[i].Reset();
+    current = 0;
+
+    std::vector<uint32_t> sequence(capacity);
+    for(size_t i=0; i<capacity; i++) sequence[i] = i;
+    ids = CreateBuffer(MEM_INSTANCES, capacity * sizeof(uint32_t), sequence.data(), 0);
+
+    Attributes white = { {1, 1, 1, 1}, 0 };
+    attributes.assign(capacity, white);
+    for(int c=0; c<Copies; c++)
+      for(size_t i=0; i<capacity; i++) {
+        Instance* inst = Record(c, i);
+        mat4x4_identity(inst->model);
+        vec4_dup(inst->color, white.color);
+        inst->timeOffset = 0;
+      }
+  }
 
+  Instance* Record(int region, size_t i) {
+    return (Instance*)(mapped + region * regionSize + i * stride);
+  }
+
+  void SetAttributes(uint32_t i, vec4 color, float timeOffset) {
+    vec4_dup(attributes[i].color, color);
+    attributes[i].timeOffset = timeOffset;
+    for(int c=0; c<Copies; c++) pending[c].push_back(i);
+  }
+
+  // Next region to write, waits until the GPU is done with it
+  void* Begin() {
+    current = (current + 1) % Copies;
+    if (fences[current]) {
+      glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, ~0ull);
+      fences[current].Reset();
+    }
+    for(uint32_t i : pending[current]) {
+      Instance* inst = Record(current, i);
+      vec4_dup(inst->color, attributes[i].color);
+      inst->timeOffset = attributes[i].timeOffset;
+    }
+    pending[current].clear();
+    return mapped + current * regionSize;
+  }
+
+  void Bind(GLuint binding) {
+    GlState().BindStorageBufferRange(binding, buffer, current * regionSize, capacity * stride);
+  }
+
+  // Call after the last draw reading the current region
+  void End() {
+    fences[current].Reset(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+  }
+};
+
+enum MeshSource { MESH_VERTEX_BUFFERS, MESH_PROCEDURAL, MESH_PULLED, MESH_PACKED, MESH_STRIPS };
+
+// Interleaved position and normal, the vertex record of VertexMesh and the
+// VertexPool
+typedef VertexLayout<Attr<0, 4, GL_FLOAT>, Attr<1, 4, GL_FLOAT>> MeshLayout;
+static_assert(MeshLayout::stride == sizeof(PoolVertex), "MeshLayout must match PoolVertex");
+
+// PackedVertex with half or snorm16 positions
+typedef VertexLayout<Attr<0, 3, GL_HALF_FLOAT>, Pad<2>, Attr<3, 2, GL_SHORT, GL_TRUE>> PackedHalfLayout;
+typedef VertexLayout<Attr<0, 3, GL_SHORT, GL_TRUE>, Pad<2>, Attr<3, 2, GL_SHORT, GL_TRUE>> PackedSnormLayout;
+static_assert(PackedHalfLayout::stride == sizeof(PackedVertex) && PackedHalfLayout::Offset<2>() == offsetof(PackedVertex, normal),
+    "PackedHalfLayout must match PackedVertex");
+
+// Height grid of w x h quads, 6 vertices each. Normally the interleaved
+// positions and normals live in one vertex buffer and the normals are
+// refreshed in place by a compute pass every frame. A procedural mesh keeps
+// only the (w+1) x (h+1) heights in a texture; DefaultShader rebuilds each
+// vertex from gl_VertexID and takes normals from central differences of the
+// heights. A pulled mesh is a range of records in a VertexPool with its
+// normals baked in. A packed mesh keeps 12 byte PackedVertex records in one
+// interleaved buffer, half or snorm16 positions and octahedral normals,
+// refreshed by a compute pass that writes the packed form directly. A strip
+// mesh shares the (w+1) x (h+1) vertices, with central difference normals
+// like the procedural one, and draws a triangle strip per row of quads,
+// rows separated by the primitive restart index.
 struct VertexMesh {
   uint w, h;
   VertexMesh() {}
   size_t vertexCount;
-  GLuint vertexBuffer;
-  GLuint normalBuffer;
-  GLuint vao;
+  GLint firstVertex;
+  MeshSource source;
+  VertexPool* pool;
+  GlBuffer vertexBuffer;
+  GlBuffer indexBuffer;
+  GLsizei indexCount;
+  GLenum indexType;
+  GlTexture heightTex;
+  float heightScale;
+  GLenum positionFormat;
+  GlVertexArray ownVao;
+  GLuint vao; // ownVao, or the pool's for pulled meshes
+  vec4 bounds; // bounding sphere in model space, center and radius
   ComputeShader worker;
+  PackedNormalShader packedWorker;
   DefaultShader shader;
 
-  void Draw(mat4x4 mvp, float time_correction) {
-    worker.Run();
-    shader.Bind(mvp, time_correction);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+  // Draws `count` instances with a single call, each with the model matrix,
+  // color and time offset of its record in `instances`
+  void Draw(mat4x4 vp, float time, InstanceBuffer& instances, GLsizei count) {
+    if (source == MESH_VERTEX_BUFFERS) worker.Run();
+    else if (source == MESH_PACKED) packedWorker.Run();
+    DrawInstances(vp, time, instances, count);
+  }
+
+  void Bind(mat4x4 vp, float time, InstanceBuffer& instances, GLuint instanceIds) {
+    shader.Bind(vp, time);
+    if (source == MESH_PROCEDURAL) shader.BindGrid(w, h, heightTex, heightScale);
+    else shader.BindGrid(0, 0, 0, 0);
+    shader.SetPulled(source == MESH_PULLED);
+    shader.SetOctNormals(source == MESH_PACKED);
+    instances.Bind(0);
+    InstanceIdLayout::Bind(vao, InstanceIdBinding, instanceIds);
+    if (pool) pool->Bind();
+    else GlState().BindVertexArray(vao);
   }
 
-  void Init(uint w, uint h) {
+  void DrawInstances(mat4x4 vp, float time, InstanceBuffer& instances, GLsizei count) {
+    Bind(vp, time, instances, instances.ids);
+    if (source == MESH_STRIPS) {
+      // restart index is all ones of indexType. It stays enabled, no other
+      // indexed draw has that index
+      GlState().Enable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+      glDrawElementsInstanced(GL_TRIANGLE_STRIP, indexCount, indexType, 0, count);
+      return;
+    }
+    // vertexCount counts floats, 4 per vertex
+    glDrawArraysInstanced(GL_TRIANGLES, firstVertex, vertexCount / 4, count);
+  }
+
+  // Draws from GPU written DrawArraysIndirectCommands. Instance i of a
+  // command uses the record visibleIds[baseInstance + i]. Not for strip
+  // meshes, GpuCuller writes array commands.
+  void DrawIndirect(mat4x4 vp, float time, InstanceBuffer& instances, GLuint visibleIds, GLuint commands, GLsizei drawCount) {
+    Bind(vp, time, instances, visibleIds);
+    GlState().BindIndirectBuffer(commands);
+    glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)0, drawCount, 0);
+  }
+
+  // heightFormat is GL_R32F or GL_R16 and only matters for procedural meshes
+  void Init(uint w, uint h, bool procedural = false, GLenum heightFormat = GL_R32F) {
+    Init(w, h, procedural ? MESH_PROCEDURAL : MESH_VERTEX_BUFFERS, heightFormat, nullptr);
+  }
+
+  void Init(uint w, uint h, VertexPool& pool) {
+    Init(w, h, MESH_PULLED, GL_R32F, &pool);
+  }
+
+  // `format` is the height format (GL_R32F, GL_R16) of a procedural mesh or
+  // the position format (GL_HALF_FLOAT, GL_SHORT) of a packed one, strip
+  // meshes ignore it
+  void Init(uint w, uint h, MeshSource source, GLenum format, VertexPool* pool) {
+    this->w = w;
+    this->h = h;
+    this->source = source;
+    this->pool = pool;
+    firstVertex = 0;
+    // Init again hands the old storage to the pool, a mesh of the same
+    // size gets it right back
+    GlPool().Recycle(vertexBuffer);
+    GlPool().Recycle(indexBuffer);
+    GlPool().Recycle(heightTex);
+    ownVao.Reset();
     shader.Init();
     vertexCount = w * h * 24;
-    float* grid = (float*)malloc(sizeof(float) * vertexCount);
-    float* normals = (float*)malloc(sizeof(float) * vertexCount);
     float* height = (float*)malloc(sizeof(float) * (w+1) * (h+1));
     for(int i=0; i<(w+1)*(h+1); i++) {
       height[i] = static_cast<float> (rand()) / static_cast<float>(RAND_MAX) * 0.1f;
     }
-    int q = 0;
+    if (source == MESH_PROCEDURAL) {
+      InitProcedural(height, format);
+      free(height);
+      return;
+    }
+    if (source == MESH_STRIPS) {
+      InitStrips(height);
+      free(height);
+      return;
+    }
+    // One MeshLayout record per vertex, the corners of each quad's two
+    // triangles in the order GridVertex in DefaultShader uses
+    std::vector<PoolVertex> records(vertexCount / 4);
     float scalex = (float)w / 2.0f;
     float scaley = (float)h / 2.0f;
+    const int cornerX[6] = { 0, 0, 1, 1, 0, 1 }, cornerY[6] = { 0, 1, 0, 0, 1, 1 };
+    size_t vertex = 0;
     for(int y=0; y<h; y++)
-      for(int x=0; x<w; x++) {
-        grid[q+0] = x/scalex - 1;
-        grid[q+1] = y/scaley - 1;
-        grid[q+2] = height[x + y * h];
-        grid[q+3] = 1;
-
-        grid[q+4] = x/scalex - 1;
-        grid[q+5] = (y+1)/scaley - 1;
-        grid[q+6] = height[x + (y+1) * h];
-        grid[q+7] = 1;
-
-        grid[q+8] = (x+1)/scalex - 1;
-        grid[q+9] = y/scaley- 1;
-        grid[q+10] = height[(x+1) + y * h];
-        grid[q+11] = 1;
-
-        grid[q+12] = (x+1)/scalex - 1;
-        grid[q+13] = y/scaley - 1;
-        grid[q+14] = height[(x+1) + y * h];
-        grid[q+15] = 1;
-
-        grid[q+16] = x/scalex - 1;
-        grid[q+17] = (y+1)/scaley - 1;
-        grid[q+18] = height[x + (y+1) * h];
-        grid[q+19] = 1;
-
-        grid[q+20] = (x+1)/scalex - 1;
-        grid[q+21] = (y+1)/scaley - 1;
-        grid[q+22] = height[(x+1) + (y+1) * h];
-        grid[q+23] = 1;
-        q+=24;
+      for(int x=0; x<w; x++)
+        for(int c=0; c<6; c++, vertex++) {
+          int cx = x + cornerX[c], cy = y + cornerY[c];
+          float* p = MeshLayout::Get<0>(records.data(), vertex);
+          p[0] = cx/scalex - 1;
+          p[1] = cy/scaley - 1;
+          p[2] = height[cx + cy * (w+1)];
+          p[3] = 1;
+        }
+    free(height);
+
+    // Flat normals, computed 8 triangles at a time on SoA copies of the corners
+    size_t triangles = records.size() / 3;
+    float* soa = (float*)malloc(sizeof(float) * triangles * 12);
+    vec3_soa corner[3], tri_normal;
+    for(int k=0; k<4; k++) {
+      vec3_soa& v = k < 3 ? corner[k] : tri_normal;
+      v.x = soa + triangles * (3*k + 0);
+      v.y = soa + triangles * (3*k + 1);
+      v.z = soa + triangles * (3*k + 2);
+    }
+    for(size_t t=0; t<triangles; t++)
+      for(int k=0; k<3; k++) {
+        const float* p = MeshLayout::Get<0>(records.data(), 3*t + k);
+        corner[k].x[t] = p[0];
+        corner[k].y[t] = p[1];
+        corner[k].z[t] = p[2];
       }
 
-    for(int i=0; i<vertexCount; i+=12) {
-      vec3 p1 = { grid[i+0], grid[i+1], grid[i+2] }; 
-      vec3 p2 = { grid[i+4], grid[i+5], grid[i+6] }; 
-      vec3 p3 = { grid[i+8], grid[i+9], grid[i+10] }; 
-
-      vec3 v1, v2;
-      vec3_sub(v1, p1, p2);
-      vec3_sub(v2, p3, p2);
-
-      vec3 cross, normal;
-      vec3_mul_cross(cross, v1, v2);
-      vec3_norm(normal, cross);
-
-      normals[i+0] = normal[0];
-      normals[i+1] = normal[1];
-      normals[i+2] = normal[2];
-      normals[i+3] = 0;
-
-      normals[i+4] = normal[0];
-      normals[i+5] = normal[1];
-      normals[i+6] = normal[2];
-      normals[i+7] = 0;
-
-      normals[i+8] = normal[0];
-      normals[i+9] = normal[1];
-      normals[i+10] = normal[2];
-      normals[i+11] = 0;
-    }
-
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vertexBuffer); 
-    glGenBuffers(1, &normalBuffer); 
-
-    glBindVertexArray(vao);
-
-    // Activate attributes 0 and 1
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-
-    // Mount the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    //Send vertices to GPU
-    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(float), grid, GL_STATIC_DRAW);
-    // Connect the mounted vertex buffer to attribute 0
-    glVertexAttribPointer(
-        shader.vPos, //atrib index
-        4, // elements per vertex
-        GL_FLOAT,
-        GL_FALSE, // normalized
-        0, // bytes padding per vertex
-        (void*)(sizeof(float) * 0));
-    
-    // Mount thhe normal buffer
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    // Send vertices to GPU
-    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(float), normals, GL_STATIC_DRAW);
-    // Connect the mounted normal buffer to attribute 1
-    glVertexAttribPointer(
-        shader.vNormal, //atrib index
-        4, // elements per normal
-        GL_FLOAT,
-        GL_TRUE, // normalized
-        0, // bytes padding per normal
-        (void*)(sizeof(float) * 0));
-
-    free(grid);
-    free(normals);
-    free(height);
+    vec3_soa_tri_normals(tri_normal, corner[0], corner[1], corner[2], triangles);
+
+    for(size_t t=0; t<triangles; t++)
+      for(int k=0; k<3; k++) {
+        float* n = MeshLayout::Get<1>(records.data(), 3*t + k);
+        n[0] = tri_normal.x[t];
+        n[1] = tri_normal.y[t];
+        n[2] = tri_normal.z[t];
+        n[3] = 0;
+      }
+    free(soa);
+
+    // grid spans [-1, 1] in x and y, heights are in [0, 0.1]
+    vec3 lo = { records[0].position[0], records[0].position[1], records[0].position[2] };
+    vec3 hi = { lo[0], lo[1], lo[2] };
+    for(const PoolVertex& r : records)
+      for(int k=0; k<3; k++) {
+        lo[k] = fminf(lo[k], r.position[k]);
+        hi[k] = fmaxf(hi[k], r.position[k]);
+      }
+    vec3 extent;
+    vec3_sub(extent, hi, lo);
+    for(int k=0; k<3; k++) bounds[k] = 0.5f * (lo[k] + hi[k]);
+    bounds[3] = 0.5f * vec3_len(extent);
+
+    if (source == MESH_PULLED) {
+      firstVertex = pool->Add(records.data(), records.size()).first;
+      vao = pool->vao;
+      return;
+    }
+    if (source == MESH_PACKED) {
+      InitPacked(records, format);
+      return;
+    }
 
-    worker.Init(vertexBuffer, normalBuffer, vertexCount * sizeof(float));
+    vertexBuffer = GlPool().AcquireBuffer(MEM_MESH, records.size() * sizeof(PoolVertex), records.data());
+    vao = ownVao = CreateVertexArray();
+    MeshLayout::Apply(vao, 0);
+    MeshLayout::Bind(vao, 0, vertexBuffer);
+    InstanceIdLayout::Apply(vao, InstanceIdBinding, 1);
+
+    worker.Init(vertexBuffer, triangles);
+  }
+
+  void InitProcedural(const float* height, GLenum heightFormat) {
+    heightTex = GlPool().AcquireTexture(MEM_MESH, heightFormat, w + 1, h + 1);
+    size_t n = (w + 1) * (h + 1);
+    if (heightFormat == GL_R16) {
+      // unorm over [0, 0.1]
+      heightScale = 0.1f;
+      std::vector<uint16_t> texels(n);
+      for(size_t i=0; i<n; i++) texels[i] = (uint16_t)(height[i] / heightScale * 65535.0f + 0.5f);
+      glTextureSubImage2D(heightTex, 0, 0, 0, w + 1, h + 1, GL_RED, GL_UNSIGNED_SHORT, texels.data());
+    } else {
+      heightScale = 1.0f;
+      glTextureSubImage2D(heightTex, 0, 0, 0, w + 1, h + 1, GL_RED, GL_FLOAT, height);
+    }
+
+    HeightBounds(height);
+
+    // no vertex buffers, only the per-instance record index
+    vao = ownVao = CreateVertexArray();
+    InstanceIdLayout::Apply(vao, InstanceIdBinding, 1);
+  }
+
+  // Bounding sphere of the [-1, 1]^2 grid over `height`
+  void HeightBounds(const float* height) {
+    size_t n = (w + 1) * (h + 1);
+    float lo = height[0], hi = height[0];
+    for(size_t i=0; i<n; i++) {
+      lo = fminf(lo, height[i]);
+      hi = fmaxf(hi, height[i]);
+    }
+    vec3 extent = { 2, 2, hi - lo };
+    bounds[0] = 0;
+    bounds[1] = 0;
+    bounds[2] = 0.5f * (lo + hi);
+    bounds[3] = 0.5f * vec3_len(extent);
+  }
+
+  void InitStrips(const float* height) {
+    const uint32_t n = w + 1;
+    vertexCount = n * (h + 1) * 4;
+    HeightBounds(height);
+
+    // normals from central differences, as GridVertex in DefaultShader
+    auto H = [&](int x, int y) {
+      x = x < 0 ? 0 : x > (int)w ? w : x;
+      y = y < 0 ? 0 : y > (int)h ? h : y;
+      return height[x + y * n];
+    };
+    float cellsx = (float)w / 2.0f, cellsy = (float)h / 2.0f;
+    std::vector<PoolVertex> records(n * (h + 1));
+    for(int y=0; y<=(int)h; y++)
+      for(int x=0; x<=(int)w; x++) {
+        float* p = MeshLayout::Get<0>(records.data(), x + y * n);
+        p[0] = x/cellsx - 1;
+        p[1] = y/cellsy - 1;
+        p[2] = H(x, y);
+        p[3] = 1;
+        vec3 normal = { -(H(x + 1, y) - H(x - 1, y)) * cellsx, -(H(x, y + 1) - H(x, y - 1)) * cellsy, 2 };
+        vec3_norm(normal, normal);
+        float* nrm = MeshLayout::Get<1>(records.data(), x + y * n);
+        nrm[0] = normal[0];
+        nrm[1] = normal[1];
+        nrm[2] = normal[2];
+        nrm[3] = 0;
+      }
+
+    // Row y alternates (x, y) and (x, y+1), which gives the same triangles
+    // with the same winding as the list: strip triangle 2x is
+    // (x, y) (x, y+1) (x+1, y), 2x+1 is (x+1, y) (x, y+1) (x+1, y+1)
+    std::vector<uint32_t> indices;
+    indices.reserve((size_t)h * (2 * n + 1));
+    for(uint32_t y=0; y<h; y++) {
+      if (y) indices.push_back(0xffffffffu);
+      for(uint32_t x=0; x<n; x++) {
+        indices.push_back(x + y * n);
+        indices.push_back(x + (y + 1) * n);
+      }
+    }
+    indexCount = indices.size();
+
+    // 16 bit indices while they fit under the 0xffff restart index
+    if (records.size() < 0xffff) {
+      indexType = GL_UNSIGNED_SHORT;
+      std::vector<uint16_t> shorts(indices.begin(), indices.end());
+      indexBuffer = GlPool().AcquireBuffer(MEM_MESH, shorts.size() * sizeof(uint16_t), shorts.data());
+    } else {
+      indexType = GL_UNSIGNED_INT;
+      indexBuffer = GlPool().AcquireBuffer(MEM_MESH, indices.size() * sizeof(uint32_t), indices.data());
+    }
+    vertexBuffer = GlPool().AcquireBuffer(MEM_MESH, records.size() * sizeof(PoolVertex), records.data());
+
+    vao = ownVao = CreateVertexArray();
+    MeshLayout::Apply(vao, 0);
+    MeshLayout::Bind(vao, 0, vertexBuffer);
+    glVertexArrayElementBuffer(vao, indexBuffer);
+    InstanceIdLayout::Apply(vao, InstanceIdBinding, 1);
+  }
+
+  void InitPacked(const std::vector<PoolVertex>& records, GLenum format) {
+    positionFormat = format;
+    std::vector<PackedVertex> packed(records.size());
+    for(size_t i=0; i<records.size(); i++)
+      PackVertex(&packed[i], records[i].position, records[i].normal, format);
+    vertexBuffer = GlPool().AcquireBuffer(MEM_MESH, packed.size() * sizeof(PackedVertex), packed.data());
+
+    vao = ownVao = CreateVertexArray();
+    if (format == GL_HALF_FLOAT) {
+      PackedHalfLayout::Apply(vao, 0);
+      PackedHalfLayout::Bind(vao, 0, vertexBuffer);
+    } else {
+      PackedSnormLayout::Apply(vao, 0);
+      PackedSnormLayout::Bind(vao, 0, vertexBuffer);
+    }
+    InstanceIdLayout::Apply(vao, InstanceIdBinding, 1);
+
+    packedWorker.Init(vertexBuffer, records.size() / 3, format);
+  }
+
+  // GPU memory for the geometry
+  size_t Bytes() const {
+    if (source == MESH_PROCEDURAL) return (w + 1) * (h + 1) * (heightScale == 1.0f ? sizeof(float) : sizeof(uint16_t));
+    if (source == MESH_PACKED) return vertexCount / 4 * sizeof(PackedVertex);
+    if (source == MESH_STRIPS) return vertexCount / 4 * sizeof(PoolVertex) + indexCount * (indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+    return vertexCount / 4 * sizeof(PoolVertex);
   }
 };
 
+// vPos and uvPos of BareShader
+typedef VertexLayout<Attr<0, 3, GL_FLOAT>, Attr<1, 2, GL_FLOAT>> QuadLayout;
+
 struct Quad {
-  GLuint vao, vbo, uvbo;
-  GLuint tex;
+  GlVertexArray ownVao;
+  GLuint vao; // ownVao, or the pool's
+  GlBuffer vbo;
+  GLint firstVertex;
+  VertexPool* pool;
+  GlTexture tex;
   BareShader shader;
   TextureComputeShader worker;
   float vertices[18] = {
@@ -162,80 +467,106 @@ struct Quad {
   };
 
   Quad() { }
-  void Init() {
+
+  // Takes its 6 vertices from `pool` instead of its own buffers
+  void Init(VertexPool& pool) {
+    PoolVertex records[6];
+    for(int i=0; i<6; i++) {
+      records[i].position[0] = vertices[3*i + 0];
+      records[i].position[1] = vertices[3*i + 1];
+      records[i].position[2] = vertices[3*i + 2];
+      records[i].position[3] = uv[2*i + 0];
+      records[i].normal[0] = 0;
+      records[i].normal[1] = 0;
+      records[i].normal[2] = 1;
+      records[i].normal[3] = uv[2*i + 1];
+    }
+    Init(&pool, pool.Add(records, 6).first);
+  }
+
+  void Init(VertexPool* pool = nullptr, GLint first = 0) {
+    this->pool = pool;
+    firstVertex = first;
     shader.Init();
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glGenBuffers(1, &uvbo);
-
-    glBindVertexArray(vao);
-    glEnableVertexAttribArray(shader.vPos);
-    glEnableVertexAttribArray(shader.uvPos);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, 18*sizeof(float), vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(
-        shader.vPos,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        0,
-        (void*)(sizeof(float) * 0));
-
-    glBindBuffer(GL_ARRAY_BUFFER, uvbo);
-    glBufferData(GL_ARRAY_BUFFER, 12*sizeof(float), uv, GL_STATIC_DRAW);
-    glVertexAttribPointer(
-        shader.uvPos,
-        2,
-        GL_FLOAT,
-        GL_FALSE,
-        0,
-        (void*)(sizeof(float) * 0));
+    ownVao.Reset();
+    GlPool().Recycle(vbo);
+    if (pool) {
+      vao = pool->vao;
+      InitTexture();
+      return;
+    }
+    // positions and uvs interleaved in one buffer
+    float records[6 * QuadLayout::stride / sizeof(float)];
+    for(int i=0; i<6; i++) {
+      memcpy(QuadLayout::Get<0>(records, i), vertices + 3*i, 3 * sizeof(float));
+      memcpy(QuadLayout::Get<1>(records, i), uv + 2*i, 2 * sizeof(float));
+    }
+    vbo = GlPool().AcquireBuffer(MEM_QUAD, sizeof(records), records);
+    vao = ownVao = CreateVertexArray();
+    QuadLayout::Apply(vao, 0);
+    QuadLayout::Bind(vao, 0, vbo);
+
+    InitTexture();
+  }
 
+  void InitTexture() {
     // Texture section
     int w = 894;
     int h = 894;
     int nrChannels = 3;
-    unsigned char* data = stbi_load("texture.jpg", &w, &h, &nrChannels, 0);
+    // always ask for rgb, the conversion below expands it to rgba
+    unsigned char* data = stbi_load("texture.jpg", &w, &h, &nrChannels, 3);
     if (!data) {
       printf("Failed to load texture in quad\n");
     }
 
-    float* datax = (float*)malloc(nrChannels*w*h*sizeof(float));
-
-    for(int i=0; i<nrChannels*w*h; i++) {
-      datax[i] = data[i] / 256.0f; 
-    }
-
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexImage2D(
-        GL_TEXTURE_2D,
+    // rgba so the driver doesn't have to expand it again on upload
+    float* datax = (float*)malloc(4*w*h*sizeof(float));
+    ConvertRgbToRgbaF32(datax, data, w*h, 1.0f / 256.0f);
+
+    // DSA, so creating it leaves the texture units alone
+    int levels = 1;
+    while ((w | h) >> levels) levels++;
+    GlPool().Recycle(tex);
+    tex = GlPool().AcquireTexture(MEM_QUAD, GL_RGBA32F, w, h, levels);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTextureSubImage2D(
+        tex,
         0, // mipmap level
-        GL_RGBA32F, //desired internal format
+        0, 0, // offset
         w, // width
         h, // height
-        0, // legacy, must be 0
-        GL_RGB, // actual format
+        GL_RGBA, // actual format
         GL_FLOAT, // actual size
         datax);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glGenerateTextureMipmap(tex);
 
+    free(datax);
     stbi_image_free(data);
     worker.Init(tex, w, h);
   }
 
   void Draw(float time) {
     worker.Run(time);
+    DrawTexture(worker.tex);
+  }
+
+  // Draws `texture` in place of the effect output
+  void DrawTexture(GLuint texture) {
     shader.Bind();
-    glBindTexture(GL_TEXTURE_2D, worker.tex);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, 18);
+    shader.SetPulled(pool != nullptr);
+    GlState().BindTextureUnit(0, texture);
+    DrawVertices();
+  }
+
+  // The 6 vertices with whatever program is bound
+  void DrawVertices() {
+    if (pool) pool->Bind();
+    else GlState().BindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, firstVertex, 6);
   }
 };
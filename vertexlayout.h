@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <tuple>
+#include <utility>
+
+// C type of the components of a GL attribute type
+template<GLenum Type> struct GlComponent;
+template<> struct GlComponent<GL_FLOAT>          { typedef float type; };
+template<> struct GlComponent<GL_HALF_FLOAT>     { typedef uint16_t type; };
+template<> struct GlComponent<GL_BYTE>           { typedef int8_t type; };
+template<> struct GlComponent<GL_UNSIGNED_BYTE>  { typedef uint8_t type; };
+template<> struct GlComponent<GL_SHORT>          { typedef int16_t type; };
+template<> struct GlComponent<GL_UNSIGNED_SHORT> { typedef uint16_t type; };
+template<> struct GlComponent<GL_INT>            { typedef int32_t type; };
+template<> struct GlComponent<GL_UNSIGNED_INT>   { typedef uint32_t type; };
+
+enum AttrKind { ATTR_FLOAT, ATTR_INTEGER, ATTR_PADDING };
+
+// Attribute read as floats by the shader, `Size` components of `Type` at
+// `Location`, normalized or converted
+template<GLuint Location, GLint Size, GLenum Type, GLboolean Normalized = GL_FALSE>
+struct Attr {
+  typedef typename GlComponent<Type>::type Component;
+  static const AttrKind kind = ATTR_FLOAT;
+  static const GLuint location = Location;
+  static const GLint size = Size;
+  static const GLenum type = Type;
+  static const GLboolean normalized = Normalized;
+  static const size_t bytes = Size * sizeof(Component);
+};
+
+// Attribute read as ints or uints by the shader
+template<GLuint Location, GLint Size, GLenum Type>
+struct IAttr : Attr<Location, Size, Type> {
+  static const AttrKind kind = ATTR_INTEGER;
+};
+
+// Unused bytes in the record
+template<size_t Bytes>
+struct Pad {
+  typedef uint8_t Component;
+  static const AttrKind kind = ATTR_PADDING;
+  static const size_t bytes = Bytes;
+};
+
+template<typename... Attrs>
+constexpr size_t vertex_layout_offset(size_t n) {
+  const size_t bytes[] = { 0, Attrs::bytes... };
+  size_t offset = 0;
+  for(size_t i=1; i<=n; i++) offset += bytes[i];
+  return offset;
+}
+
+// Interleaved vertex record made of Attrs in order, offsets and stride are
+// worked out at compile time. Apply sets the VAO's formats for one buffer
+// binding holding the records, ApplySeparate puts every attribute in a
+// buffer of its own instead. Get points at an attribute inside a record
+// array, so builders fill the records in a single pass:
+//   typedef VertexLayout<Attr<0, 3, GL_FLOAT>, Attr<1, 2, GL_FLOAT>> L;
+//   L::Get<1>(data, v)[0] = u;
+template<typename... Attrs>
+struct VertexLayout {
+  static const size_t count = sizeof...(Attrs);
+  static constexpr size_t stride = vertex_layout_offset<Attrs...>(count);
+  static_assert(stride % 4 == 0, "VertexLayout: pad records to a multiple of 4 bytes");
+
+  template<size_t N> using Attribute = typename std::tuple_element<N, std::tuple<Attrs...>>::type;
+  template<size_t N> static constexpr size_t Offset() { return vertex_layout_offset<Attrs...>(N); }
+
+  template<size_t N>
+  static typename Attribute<N>::Component* Get(void* records, size_t vertex) {
+    return (typename Attribute<N>::Component*)((char*)records + vertex * stride + Offset<N>());
+  }
+
+  // All attributes read from `binding`, advanced per instance if divisor > 0
+  static void Apply(GLuint vao, GLuint binding, GLuint divisor = 0) {
+    ApplyAll(vao, binding, 0, divisor, std::make_index_sequence<count>());
+  }
+
+  static void Bind(GLuint vao, GLuint binding, GLuint buffer, GLintptr offset = 0) {
+    glVertexArrayVertexBuffer(vao, binding, buffer, offset, stride);
+  }
+
+  // Attribute N reads from binding firstBinding + N, tightly packed
+  static void ApplySeparate(GLuint vao, GLuint firstBinding, GLuint divisor = 0) {
+    ApplyAll(vao, firstBinding, 1, divisor, std::make_index_sequence<count>());
+  }
+
+  static void BindSeparate(GLuint vao, GLuint firstBinding, const GLuint* buffers) {
+    BindAll(vao, firstBinding, buffers, std::make_index_sequence<count>());
+  }
+
+private:
+  template<typename A>
+  static void Format(GLuint vao, GLuint binding, GLuint offset, GLuint divisor) {
+    if constexpr (A::kind != ATTR_PADDING) {
+      glEnableVertexArrayAttrib(vao, A::location);
+      if (A::kind == ATTR_INTEGER) glVertexArrayAttribIFormat(vao, A::location, A::size, A::type, offset);
+      else glVertexArrayAttribFormat(vao, A::location, A::size, A::type, A::normalized, offset);
+      glVertexArrayAttribBinding(vao, A::location, binding);
+      if (divisor) glVertexArrayBindingDivisor(vao, binding, divisor);
+    }
+  }
+
+  template<typename A>
+  static void BindOne(GLuint vao, GLuint binding, GLuint buffer) {
+    if constexpr (A::kind != ATTR_PADDING) glVertexArrayVertexBuffer(vao, binding, buffer, 0, A::bytes);
+  }
+
+  // step = 0: one binding at interleaved offsets, step = 1: a binding each
+  template<size_t... I>
+  static void ApplyAll(GLuint vao, GLuint binding, GLuint step, GLuint divisor, std::index_sequence<I...>) {
+    int expand[] = { 0, (Format<Attribute<I>>(vao, binding + step * I, step ? 0 : Offset<I>(), divisor), 0)... };
+    (void)expand;
+  }
+
+  template<size_t... I>
+  static void BindAll(GLuint vao, GLuint firstBinding, const GLuint* buffers, std::index_sequence<I...>) {
+    int expand[] = { 0, (BindOne<Attribute<I>>(vao, firstBinding + I, buffers[I]), 0)... };
+    (void)expand;
+  }
+};
+
+// The per-instance record index DefaultShader reads from location 2. Its
+// buffer is bound per draw: InstanceBuffer::ids, or a compacted list.
+typedef VertexLayout<IAttr<2, 1, GL_UNSIGNED_INT>> InstanceIdLayout;
+static const GLuint InstanceIdBinding = 2;
@@ -0,0 +1,96 @@
+#ifndef VERTEXPACK_H
+#define VERTEXPACK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "pixelconv.h"
+
+// 12 byte vertex for VertexMesh's packed mode. The position is three half
+// floats or three snorm16 (plus padding, w is filled in as 1 by the vertex
+// fetch), the normal is octahedral mapped into two snorm16. Layout matches
+// the 3 uints per vertex PackedNormalShader works on.
+struct PackedVertex {
+  uint16_t position[4];
+  int16_t normal[2];
+};
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must stay 12 bytes");
+
+// Same rounding as GLSL packSnorm2x16 / unpackSnorm2x16
+static inline int16_t pack_snorm16(float v)
+{
+  v = fminf(fmaxf(v, -1.0f), 1.0f);
+  return (int16_t)lrintf(v * 32767.0f);
+}
+static inline float unpack_snorm16(int16_t v)
+{
+  return fmaxf(v / 32767.0f, -1.0f);
+}
+
+static inline float unpack_half(uint16_t h)
+{
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+  float f;
+  if (exp == 0) {
+    f = ldexpf((float)mant, -24);
+    if (sign) f = -f;
+    return f;
+  }
+  uint32_t x = sign | (exp == 31 ? 0x7f800000 | (mant << 13) : ((exp + 112) << 23) | (mant << 13));
+  memcpy(&f, &x, 4);
+  return f;
+}
+
+// Unit vector onto the octahedron, then the lower half folded over the
+// upper one, so it fits in [-1, 1]^2
+static inline void oct_encode(float e[2], const float n[3])
+{
+  float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+  float x = n[0] / l1, y = n[1] / l1;
+  if (n[2] < 0) {
+    float fx = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+    float fy = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+    x = fx;
+    y = fy;
+  }
+  e[0] = x;
+  e[1] = y;
+}
+
+static inline void oct_decode(float n[3], const float e[2])
+{
+  float x = e[0], y = e[1], z = 1.0f - fabsf(x) - fabsf(y);
+  if (z < 0) {
+    float fx = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+    float fy = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+    x = fx;
+    y = fy;
+  }
+  float l = sqrtf(x*x + y*y + z*z);
+  n[0] = x / l;
+  n[1] = y / l;
+  n[2] = z / l;
+}
+
+// positionFormat is GL_HALF_FLOAT or GL_SHORT (snorm16, positions in [-1, 1])
+static inline void PackVertex(PackedVertex* v, const float position[3], const float normal[3], GLenum positionFormat)
+{
+  for(int k=0; k<3; k++)
+    v->position[k] = positionFormat == GL_HALF_FLOAT ? pc_float_to_half(position[k]) : (uint16_t)pack_snorm16(position[k]);
+  v->position[3] = 0;
+  float e[2];
+  oct_encode(e, normal);
+  v->normal[0] = pack_snorm16(e[0]);
+  v->normal[1] = pack_snorm16(e[1]);
+}
+
+static inline void UnpackVertex(float position[3], float normal[3], const PackedVertex* v, GLenum positionFormat)
+{
+  for(int k=0; k<3; k++)
+    position[k] = positionFormat == GL_HALF_FLOAT ? unpack_half(v->position[k]) : unpack_snorm16((int16_t)v->position[k]);
+  float e[2] = { unpack_snorm16(v->normal[0]), unpack_snorm16(v->normal[1]) };
+  oct_decode(normal, e);
+}
+
+#endif // VERTEXPACK_H
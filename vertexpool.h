@@ -0,0 +1,53 @@
+#include <stdexcept>
+
+// Vertex record the shaders pull from the pool by gl_VertexID. Texture
+// coordinates ride in the w components: position.w = u, normal.w = v.
+struct PoolVertex {
+  float position[4];
+  float normal[4];
+};
+
+struct MeshRange {
+  GLint first;
+  GLsizei count;
+};
+
+// One storage buffer holding the vertices of many meshes back to back, and
+// the single VAO all of them draw with. The VAO has no vertex attributes
+// apart from the per-instance record index DefaultShader reads from
+// binding 2, since the shaders fetch their vertices themselves. A mesh is a
+// range of records; glDrawArrays(first, count) hands the shader
+// gl_VertexID = first + i, so merged meshes draw with one glMultiDrawArrays.
+struct VertexPool {
+  static const GLuint Binding = 6;
+  GlBuffer buffer;
+  GlVertexArray vao;
+  size_t capacity;
+  size_t used;
+
+  VertexPool() {}
+  void Init(size_t capacity) {
+    this->capacity = capacity;
+    used = 0;
+    GlPool().Recycle(buffer);
+    buffer = GlPool().AcquireBuffer(MEM_VERTEX_POOL, capacity * sizeof(PoolVertex));
+
+    vao = CreateVertexArray();
+    InstanceIdLayout::Apply(vao, InstanceIdBinding, 1);
+  }
+
+  void Bind() {
+    GlState().BindStorageBuffer(Binding, buffer);
+    GlState().BindVertexArray(vao);
+  }
+
+  MeshRange Add(const PoolVertex* vertices, size_t count) {
+    if (used + count > capacity) throw std::runtime_error("VertexPool: out of space");
+    glNamedBufferSubData(buffer, used * sizeof(PoolVertex), count * sizeof(PoolVertex), vertices);
+    MeshRange range = { (GLint)used, (GLsizei)count };
+    used += count;
+    return range;
+  }
+
+  size_t Bytes() const { return capacity * sizeof(PoolVertex); }
+};